@@ -0,0 +1,163 @@
+/* file: bench.c		18 October 2026
+
+Microbenchmark harness for LightWAVE
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+_______________________________________________________________________________
+
+bench_run() calls a benchmark operation repeatedly, doubling the number of
+calls until a batch takes at least $LW_BENCH_TIME seconds (0.5 by default),
+and reports the time per operation and, if the number of bytes processed by
+each operation is known, the throughput.
+
+If $LW_BENCH_PERF is set, hardware counters (cycles, instructions, cache
+misses, and branch misses) are also read using perf_event_open(2) and
+reported per operation.  The counters may be unavailable (in containers, or
+if /proc/sys/kernel/perf_event_paranoid is too restrictive);  in that case
+only times are reported.
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "bench.h"
+
+FILE *bench_report;
+
+#define NCOUNTERS 4
+
+static const char *counter_name[NCOUNTERS] = {
+    "cycles", "instr", "cache-miss", "branch-miss"
+};
+static int counter_fd[NCOUNTERS] = { -1, -1, -1, -1 };
+static double min_time = 0.5;
+
+double bench_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void open_counters(void)
+{
+    static const uint64_t config[NCOUNTERS] = {
+        PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+    };
+    struct perf_event_attr pe;
+    int i;
+
+    for (i = 0; i < NCOUNTERS; i++) {
+        memset(&pe, 0, sizeof(pe));
+        pe.type = PERF_TYPE_HARDWARE;
+        pe.size = sizeof(pe);
+        pe.config = config[i];
+        pe.disabled = 1;
+        pe.exclude_kernel = 1;
+        pe.exclude_hv = 1;
+        counter_fd[i] = syscall(__NR_perf_event_open, &pe, 0, -1, -1, 0);
+        if (counter_fd[i] < 0) {
+            fprintf(bench_report, "(hardware counter %s unavailable)\n",
+                    counter_name[i]);
+        }
+    }
+}
+
+static void start_counters(void)
+{
+    int i;
+
+    for (i = 0; i < NCOUNTERS; i++) {
+        if (counter_fd[i] >= 0) {
+            ioctl(counter_fd[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(counter_fd[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+}
+
+static void stop_counters(long long *value)
+{
+    int i;
+
+    for (i = 0; i < NCOUNTERS; i++) {
+        value[i] = -1;
+        if (counter_fd[i] >= 0) {
+            ioctl(counter_fd[i], PERF_EVENT_IOC_DISABLE, 0);
+            if (read(counter_fd[i], &value[i], sizeof(value[i]))
+                != sizeof(value[i]))
+                value[i] = -1;
+        }
+    }
+}
+
+void bench_init(void)
+{
+    char *p;
+    int fd;
+
+    fflush(stdout);
+    fd = dup(STDOUT_FILENO);
+    bench_report = fdopen(fd, "w");
+    setvbuf(bench_report, NULL, _IOLBF, 0);
+    if (!freopen("/dev/null", "w", stdout)) {
+        perror("/dev/null");
+        exit(1);
+    }
+    if ((p = getenv("LW_BENCH_TIME")) && atof(p) > 0)
+        min_time = atof(p);
+    if (getenv("LW_BENCH_PERF"))
+        open_counters();
+    fprintf(bench_report, "%-36s %10s %12s %10s\n",
+            "benchmark", "ops", "ns/op", "MB/s");
+}
+
+void bench_run(const char *name, bench_fn fn, void *arg, double bytes_per_op)
+{
+    double t, elapsed;
+    long long count[NCOUNTERS];
+    long i, n;
+    int c;
+
+    fn(arg);	/* warm up caches and allocate lazily-created state */
+    for (n = 1; ; n *= 2) {
+        start_counters();
+        t = bench_now();
+        for (i = 0; i < n; i++)
+            fn(arg);
+        fflush(stdout);
+        elapsed = bench_now() - t;
+        stop_counters(count);
+        if (elapsed >= min_time || n >= (1L << 40))
+            break;
+    }
+    fprintf(bench_report, "%-36s %10ld %12.1f", name, n, elapsed * 1e9 / n);
+    if (bytes_per_op > 0)
+        fprintf(bench_report, " %10.1f", bytes_per_op * n / elapsed / 1e6);
+    else
+        fprintf(bench_report, " %10s", "-");
+    for (c = 0; c < NCOUNTERS; c++)
+        if (count[c] >= 0)
+            fprintf(bench_report, "  %s/op=%.1f", counter_name[c],
+                    (double)count[c] / n);
+    fprintf(bench_report, "\n");
+}
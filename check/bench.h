@@ -0,0 +1,35 @@
+/* file: bench.h		18 October 2026
+
+Microbenchmark harness for LightWAVE
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LIGHTWAVE_BENCH_H
+#define LIGHTWAVE_BENCH_H
+
+#include <stdio.h>
+
+/* A benchmark operation.  It is called repeatedly with the same argument. */
+typedef void (*bench_fn)(void *arg);
+
+void bench_init(void);
+void bench_run(const char *name, bench_fn fn, void *arg, double bytes_per_op);
+double bench_now(void);
+
+/* Report stream (stdout is redirected to /dev/null by bench_init(), since
+   the functions being measured write their output there). */
+extern FILE *bench_report;
+
+#endif
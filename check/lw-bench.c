@@ -0,0 +1,242 @@
+/* file: lw-bench.c		18 October 2026
+
+Microbenchmarks for the LightWAVE server
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+_______________________________________________________________________________
+
+Usage:
+    lw-bench [RECORD]
+
+lw-bench measures the server's inner loops in isolation.  It includes the
+server's sources directly (renaming the server's main()), so that static
+functions can be called and the server's global state can be set up without
+a CGI request.  Output that the server would send to the client is written
+to /dev/null.
+
+RECORD (by default, synth/bench, as generated by 'make bench' using lw-synth)
+is read from the WFDB path.  All of its signals, and its 'atr' annotations,
+are fetched in 10-second windows.
+*/
+
+/* cgi.c, which is included below, needs this before any system header. */
+#define _GNU_SOURCE
+#define main lightwave_main
+#include "../server/lightwave.c"
+#undef main
+#include "../server/cgi.c"
+#include "bench.h"
+
+/* Window length, in seconds, for the fetch benchmarks. */
+#define BENCH_DT "10"
+
+static char strjson_input[] =
+    "Lead II (MLII) \"modified\" \\ 0.5-40 Hz\tfilter, caf\xc3\xa9, "
+    "\xe2\x80\x94 \xf0\x9f\x92\x93 and an invalid byte: \xff";
+
+static void bench_strjson(void *arg)
+{
+    char *p = strjson(strjson_input);
+
+    SFREE(p);
+}
+
+static void bench_out_json(void *arg)
+{
+    out_json(strjson_input);
+    out_len = 0;
+}
+
+static double rational_input[] = {
+    1., 4., 2., 0.8, 1.28, 1./3., 0.125, 2.4
+};
+
+volatile long rational_result;
+
+static void bench_lw_rational(void *arg)
+{
+    int i;
+    long num, den;
+
+    for (i = 0; i < sizeof(rational_input) / sizeof(rational_input[0]); i++) {
+        lw_rational(rational_input[i], RS_MAXDEN, &num, &den);
+        rational_result = num + den;
+    }
+}
+
+/* The frame buffers, as set up by fetchsignals(). */
+static int framelen, imin, imax, *fmap;
+static WFDB_Sample **sb, **sp, *frame;
+
+static void setup_frames(void)
+{
+    int i, j, n;
+
+    SUALLOC(sb, nsig, sizeof(WFDB_Sample *));
+    SUALLOC(sp, nsig, sizeof(WFDB_Sample *));
+    for (n = framelen = 0; n < nsig; framelen += s[n++].spf)
+        if (sigmap[n] >= 0)
+            SUALLOC(sb[n], (int)((tf-t0)*s[n].spf + 0.5),
+                    sizeof(WFDB_Sample));
+    SUALLOC(frame, framelen, sizeof(WFDB_Sample));
+    SUALLOC(fmap, framelen, sizeof(int));
+    for (i = n = 0; n < nsig; n++)
+        for (j = 0; j < s[n].spf; j++)
+            fmap[i++] = sigmap[n];
+    for (imax = framelen-1; imax > 0 && fmap[imax] < 0; imax--)
+        ;
+    for (imin = 0; imin < imax && fmap[imin] < 0; imin++)
+        ;
+}
+
+static void bench_read_frames(void *arg)
+{
+    int n;
+
+    for (n = 0; n < nsig; n++)
+        sp[n] = sb[n];
+    read_frames(frame, fmap, imin, imax, sp);
+}
+
+/* Resample the first signal by 3/2 (as for 'resample=' with a rate 1.5 times
+   its sampling frequency). */
+static struct lw_resampler bench_rs;
+static WFDB_Sample *rs_out;
+
+static void bench_lw_resample(void *arg)
+{
+    long nin = sp[0] - sb[0];
+
+    lw_resample(&bench_rs, sb[0], nin, 0, rs_out, nin * 3 / 2);
+}
+
+/* Code the first LW_PIPE_CHUNK samples of the first signal (as for
+   'maxerr=2'). */
+static char *code_out;
+
+static void bench_lw_code(void *arg)
+{
+    long n = sp[0] - sb[0];
+    int err;
+
+    lw_code(sb[0], n < LW_PIPE_CHUNK ? n : LW_PIPE_CHUNK, 2, code_out, &err);
+}
+
+static void bench_print_samples(void *arg)
+{
+    int n;
+
+    for (n = 0; n < nsig; n++)
+        if (sigmap[n] >= 0)
+            print_samples(sb[n], sp[n]);
+}
+
+static void bench_fetchsignals(void *arg)
+{
+    fetchsignals();
+}
+
+static void bench_fetchannotations(void *arg)
+{
+    fetchannotations();
+}
+
+/* A query string with 500 URL-encoded signal names, like those sent by the
+   client for a record with many signals. */
+static char *query;
+
+static void make_query(void)
+{
+    size_t size = 0;
+    FILE *qstr = open_memstream(&query, &size);
+    int i;
+
+    fprintf(qstr, "action=fetch&db=synth&record=bench&t0=0&dt=10");
+    for (i = 0; i < 500; i++)
+        fprintf(qstr, "&signal=EEG%%20F%d-C%d%%3A%d%%2A", i % 19, i % 7, i);
+    fprintf(qstr, "&annotator=atr&callback=lw_callback");
+    fclose(qstr);
+}
+
+static void bench_parse_param(void *arg)
+{
+    parse_urlencoded(query, strlen(query));
+    cgi_end();
+}
+
+int main(int argc, char **argv)
+{
+    char *rec = argc > 1 ? argv[1] : "synth/bench", *p, param[64];
+    double sbytes = 0.;
+    int n;
+
+    bench_init();
+    wfdbquiet();
+
+    bench_run("strjson", bench_strjson, NULL, sizeof(strjson_input) - 1);
+    bench_run("out_json", bench_out_json, NULL, sizeof(strjson_input) - 1);
+    bench_run("lw_rational (8 ratios)", bench_lw_rational, NULL, 0);
+    make_query();
+    bench_run("parse_param (502 params)", bench_parse_param, NULL,
+              strlen(query));
+
+    /* Set up the server's state as fetch() would. */
+    SSTRCPY(db, rec);
+    if ((p = strrchr(db, '/')) == NULL) {
+        fprintf(stderr, "%s: RECORD must be of the form DB/RECORD\n", argv[0]);
+        exit(1);
+    }
+    *p = '\0';
+    record = p + 1;
+    prep_signals();
+    if (nsig < 1) {
+        fprintf(stderr, "%s: can't read record %s\n", argv[0], rec);
+        exit(1);
+    }
+    for (n = 0; n < nsig; n++) {
+        sprintf(param, "signal=%d", n);
+        parse_param(param, strlen(param));
+    }
+    parse_param("annotator=atr", 13);
+    parse_param("dt=" BENCH_DT, strlen("dt=" BENCH_DT));
+    map_signals();
+    prep_annotators();
+    prep_times();
+    fprintf(bench_report, "(%s: %d signals, %ld frames per window)\n",
+            rec, nsig, (long)(tf - t0));
+
+    setup_frames();
+    bench_read_frames(NULL);
+    for (n = 0; n < nsig; n++)
+        sbytes += (sp[n] - sb[n]) * sizeof(WFDB_Sample);
+    bench_run("read_frames (" BENCH_DT " s)", bench_read_frames, NULL,
+              sbytes);
+    lw_resample_init(&bench_rs, 3, 2);
+    SUALLOC(rs_out, (sp[0] - sb[0]) * 3 / 2 + 1, sizeof(WFDB_Sample));
+    bench_run("lw_resample (3/2, one signal)", bench_lw_resample, NULL,
+              (sp[0] - sb[0]) * sizeof(WFDB_Sample));
+    SUALLOC(code_out, lw_code_bound(LW_PIPE_CHUNK), 1);
+    bench_run("lw_code (maxerr=2, one chunk)", bench_lw_code, NULL,
+              ((sp[0] - sb[0]) < LW_PIPE_CHUNK ? (sp[0] - sb[0])
+               : LW_PIPE_CHUNK) * sizeof(WFDB_Sample));
+    bench_run("print_samples (" BENCH_DT " s)", bench_print_samples, NULL,
+              sbytes);
+    bench_run("fetchsignals (" BENCH_DT " s)", bench_fetchsignals, NULL,
+              sbytes);
+    bench_run("fetchannotations (" BENCH_DT " s)", bench_fetchannotations,
+              NULL, 0);
+    t0 = tf = 0;	/* fetch all annotations */
+    bench_run("fetchannotations (all)", bench_fetchannotations, NULL, 0);
+    exit(0);
+}
@@ -0,0 +1,569 @@
+/* file: lw-load.c		18 October 2026
+
+Replay requests to the LightWAVE server under concurrent load
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+_______________________________________________________________________________
+
+Usage:
+    lw-load [-c CLIENTS] [-n REQUESTS] [-d SECONDS] [-o OUTPUT]
+            [-b BASELINE [-t PERCENT]] (-x PROGRAM | -u URL) [FILE ...]
+
+lw-load reads a list of requests from each FILE (or from the standard input,
+if no FILE is given), and makes them, in order (starting again at the
+beginning of the list when it is exhausted), from CLIENTS (by default, 4)
+concurrent clients, until REQUESTS requests have been made (by default, one
+for each request in the list) or until SECONDS have elapsed.
+
+Each line of a FILE is either the query string of a request, such as
+    action=fetch&db=mitdb&record=100&signal=MLII&t0=10&dt=10
+or a line of a web server's access log in the Common or Combined Log Format
+(as written by Apache, or by 'lightwave -s'), from which the query string of
+a GET request for the server (a URL path ending in "lightwave") is taken.
+Other lines, and requests for the streaming actions ('play' and 'follow'),
+which do not end until much later, are skipped.  lw-load-mix (used by 'make
+loadtest') is a synthetic mix of requests for the record made by lw-synth
+for 'make bench'.
+
+With -x, each request is made by running PROGRAM (the lightwave binary) as a
+CGI application, as a web server would.  With -u, each request is sent to
+URL (for example, http://localhost:8000/cgi-bin/lightwave, if the server was
+started by 'lightwave -s 8000') as an HTTP/1.0 request on a new connection.
+Either way, a request ends when the whole response has been read.  It fails
+if PROGRAM exits with nonzero status, or if the HTTP status is not 200, or if
+the response reports an error ("success": false).
+
+lw-load reports the number of requests and failures, the throughput
+(requests per second), and the 50th, 95th, and 99th percentiles of latency
+(in milliseconds), for each action and for all requests.  With -o, the report
+is also written to OUTPUT, which can be given with -b in a later run to show
+the changes from that run.  If the throughput of any action has fallen, or
+its 50th or 95th percentile latency has risen, by more than PERCENT (10 by
+default), that action is marked with '*', and lw-load exits with status 1.
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <spawn.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+/* Largest number of distinct actions reported. */
+#define MAXACTIONS 32
+
+extern char **environ;
+
+/* The requests to be made (query strings), and the action of each. */
+static char **query;
+static int *qaction;
+static long nquery;
+
+/* Per-action results. */
+static struct action {
+    char name[32];
+    long count, failed;
+    double *latency;		/* in ms, sorted after the run */
+    long nlat;
+    double rps, p50, p95, p99;	/* summary (or baseline) */
+} act[MAXACTIONS + 1], base[MAXACTIONS + 1];
+static int nact, nbase;
+
+/* Shared state of the clients. */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static long nextreq, maxreq;
+static double deadline;
+
+static char *program;			/* -x */
+static char *host, *port, *path;	/* -u */
+static struct addrinfo *addr;
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void *xrealloc(void *p, size_t n)
+{
+    if ((p = realloc(p, n ? n : 1)) == NULL) {
+        fprintf(stderr, "lw-load: out of memory\n");
+        exit(2);
+    }
+    return (p);
+}
+
+/* Return the index of the named action in act[], adding it if necessary
+   (actions beyond the first MAXACTIONS are counted together as "other", in
+   act[MAXACTIONS]). */
+static int find_action(const char *name, size_t len)
+{
+    int i;
+
+    if (len >= sizeof(act[0].name))
+        len = sizeof(act[0].name) - 1;
+    for (i = 0; i < nact; i++)
+        if (strncmp(act[i].name, name, len) == 0 && act[i].name[len] == '\0')
+            return (i);
+    if (nact == MAXACTIONS) {
+        strcpy(act[nact].name, "other");
+        return (nact);
+    }
+    memcpy(act[nact].name, name, len);
+    act[nact].name[len] = '\0';
+    return (nact++);
+}
+
+/* Add a request to the list, if it is one to be replayed. */
+static void add_query(char *q)
+{
+    char *a, *p;
+    size_t len;
+
+    if ((a = strstr(q, "action=")) && (a == q || a[-1] == '&'))
+        a += 7;
+    else
+        a = "";
+    len = strcspn(a, "&");
+    if ((len == 4 && strncmp(a, "play", 4) == 0) ||
+        (len == 6 && strncmp(a, "follow", 6) == 0))
+        return;
+    query = xrealloc(query, (nquery + 1) * sizeof(char *));
+    qaction = xrealloc(qaction, (nquery + 1) * sizeof(int));
+    if ((p = strdup(q)) == NULL)
+        exit(2);
+    query[nquery] = p;
+    qaction[nquery++] = len ? find_action(a, len) : find_action("-", 1);
+}
+
+/* Read the requests in a query file or access log. */
+static void read_queries(FILE *ifile)
+{
+    char *line = NULL, *p, *q;
+    size_t size = 0;
+    ssize_t n;
+
+    while ((n = getline(&line, &size, ifile)) > 0) {
+        while (n > 0 && (line[n-1] == '\n' || line[n-1] == '\r'))
+            line[--n] = '\0';
+        if (line[0] == '#' || line[0] == '\0')
+            continue;
+        if (strchr(line, ' ') == NULL) {
+            add_query(line);	/* a query string */
+            continue;
+        }
+        if ((p = strstr(line, "\"GET ")) == NULL)
+            continue;
+        /* An access log line: find the URL path and query string. */
+        p += 5;
+        if ((q = strchr(p, ' ')) != NULL)
+            *q = '\0';
+        if ((q = strchr(p, '?')) != NULL && q - p >= 9 &&
+            strncmp(q - 9, "lightwave", 9) == 0)
+            add_query(q + 1);
+    }
+    free(line);
+}
+
+/* Return 1 if the response in buf reports an error. */
+static int response_failed(const char *buf, size_t len)
+{
+    return (memmem(buf, len, "\"success\": false", 16) != NULL);
+}
+
+/* Read from fd until end of file into *buf (of size *size), and return the
+   number of bytes read, or -1 on error. */
+static long read_all(int fd, char **buf, size_t *size)
+{
+    long len = 0;
+    ssize_t n;
+
+    for (;;) {
+        if (len == *size) {
+            *size = *size ? 2 * *size : 65536;
+            *buf = xrealloc(*buf, *size);
+        }
+        if ((n = read(fd, *buf + len, *size - len)) < 0)
+            return (-1);
+        if (n == 0)
+            return (len);
+        len += n;
+    }
+}
+
+/* Make a request by running the server as a CGI application.  Return 0 if
+   successful, or 1 if the request failed. */
+static int run_cgi(char *q, char **buf, size_t *size)
+{
+    char *argv[2], **envp, *qs;
+    int fd[2], i, n, status;
+    long len;
+    pid_t pid;
+    posix_spawn_file_actions_t fa;
+
+    for (n = 0; environ[n]; n++)
+        ;
+    envp = xrealloc(NULL, (n + 3) * sizeof(char *));
+    for (i = n = 0; environ[i]; i++)
+        if (strncmp(environ[i], "QUERY_STRING=", 13) &&
+            strncmp(environ[i], "REQUEST_METHOD=", 15))
+            envp[n++] = environ[i];
+    qs = xrealloc(NULL, strlen(q) + 14);
+    sprintf(qs, "QUERY_STRING=%s", q);
+    envp[n++] = qs;
+    envp[n++] = "REQUEST_METHOD=GET";
+    envp[n] = NULL;
+    argv[0] = program;
+    argv[1] = NULL;
+
+    /* The pipe is not inherited by the children of the other clients, so
+       that its end of file is seen when this child exits. */
+    if (pipe2(fd, O_CLOEXEC) != 0) {
+        free(qs);
+        free(envp);
+        return (1);
+    }
+    posix_spawn_file_actions_init(&fa);
+    posix_spawn_file_actions_addopen(&fa, 0, "/dev/null", O_RDONLY, 0);
+    posix_spawn_file_actions_adddup2(&fa, fd[1], 1);
+    posix_spawn_file_actions_addopen(&fa, 2, "/dev/null", O_WRONLY, 0);
+    i = posix_spawn(&pid, program, &fa, NULL, argv, envp);
+    posix_spawn_file_actions_destroy(&fa);
+    close(fd[1]);
+    free(qs);
+    free(envp);
+    if (i != 0) {
+        close(fd[0]);
+        return (1);
+    }
+    len = read_all(fd[0], buf, size);
+    close(fd[0]);
+    if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) ||
+        WEXITSTATUS(status) != 0 || len < 0)
+        return (1);
+    return (response_failed(*buf, len));
+}
+
+/* Make a request of an HTTP server.  Return 0 if successful, or 1 if the
+   request failed. */
+static int run_http(char *q, char **buf, size_t *size)
+{
+    char *req;
+    int fd, status = 0;
+    long len;
+    size_t n;
+
+    if ((fd = socket(addr->ai_family, addr->ai_socktype | SOCK_CLOEXEC,
+                     addr->ai_protocol)) < 0)
+        return (1);
+    if (connect(fd, addr->ai_addr, addr->ai_addrlen) != 0) {
+        close(fd);
+        return (1);
+    }
+    n = strlen(path) + strlen(q) + strlen(host) + 64;
+    req = xrealloc(NULL, n);
+    n = snprintf(req, n, "GET %s?%s HTTP/1.0\r\nHost: %s\r\n\r\n",
+                 path, q, host);
+    if (write(fd, req, n) != (ssize_t)n) {
+        free(req);
+        close(fd);
+        return (1);
+    }
+    free(req);
+    len = read_all(fd, buf, size);
+    close(fd);
+    if (len < 12 || sscanf(*buf, "HTTP/1.%*d %d", &status) != 1 ||
+        status != 200)
+        return (1);
+    return (response_failed(*buf, len));
+}
+
+static void *client(void *arg)
+{
+    char *buf = NULL;
+    int a, failed;
+    long i;
+    size_t size = 0;
+    double t;
+    struct action *ap;
+
+    for (;;) {
+        pthread_mutex_lock(&lock);
+        if (nextreq >= maxreq || (deadline > 0. && now() >= deadline)) {
+            pthread_mutex_unlock(&lock);
+            break;
+        }
+        i = nextreq++ % nquery;
+        pthread_mutex_unlock(&lock);
+
+        t = now();
+        failed = program ? run_cgi(query[i], &buf, &size)
+            : run_http(query[i], &buf, &size);
+        t = (now() - t) * 1000.;
+
+        a = qaction[i];
+        ap = &act[a];
+        pthread_mutex_lock(&lock);
+        ap->count++;
+        ap->failed += failed;
+        ap->latency = xrealloc(ap->latency, (ap->nlat + 1) * sizeof(double));
+        ap->latency[ap->nlat++] = t;
+        pthread_mutex_unlock(&lock);
+    }
+    free(buf);
+    return (NULL);
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return ((x > y) - (x < y));
+}
+
+/* Return the q-quantile of the n sorted values in v (by the nearest-rank
+   method). */
+static double quantile(double *v, long n, double q)
+{
+    long k = (long)ceil(q * n);
+
+    if (n < 1)
+        return (0.);
+    return (v[k > 0 ? k - 1 : 0]);
+}
+
+static void summarize(struct action *ap, double elapsed)
+{
+    qsort(ap->latency, ap->nlat, sizeof(double), compare_doubles);
+    ap->rps = elapsed > 0. ? ap->count / elapsed : 0.;
+    ap->p50 = quantile(ap->latency, ap->nlat, 0.50);
+    ap->p95 = quantile(ap->latency, ap->nlat, 0.95);
+    ap->p99 = quantile(ap->latency, ap->nlat, 0.99);
+}
+
+static void read_baseline(const char *fname)
+{
+    char line[256];
+    struct action *bp;
+    FILE *bfile;
+
+    if ((bfile = fopen(fname, "r")) == NULL) {
+        fprintf(stderr, "lw-load: can't read %s\n", fname);
+        exit(2);
+    }
+    while (nbase <= MAXACTIONS && fgets(line, sizeof(line), bfile)) {
+        bp = &base[nbase];
+        if (line[0] != '#' &&
+            sscanf(line, "%31s %ld %ld %lf %lf %lf %lf", bp->name,
+                   &bp->count, &bp->failed, &bp->rps, &bp->p50, &bp->p95,
+                   &bp->p99) == 7)
+            nbase++;
+    }
+    fclose(bfile);
+}
+
+/* Return the percentage change from b to a. */
+static double change(double a, double b)
+{
+    return (b > 0. ? 100. * (a - b) / b : 0.);
+}
+
+/* Print the report line for an action, followed by the changes from the
+   baseline (if any).  Return 1 if the action has regressed by more than
+   threshold percent, or 0 otherwise. */
+static int report(FILE *ofile, struct action *ap, double threshold)
+{
+    int i, regressed = 0;
+    struct action *bp = NULL;
+
+    for (i = 0; i < nbase; i++)
+        if (strcmp(base[i].name, ap->name) == 0)
+            bp = &base[i];
+    if (bp)
+        regressed = change(ap->rps, bp->rps) < -threshold ||
+            change(ap->p50, bp->p50) > threshold ||
+            change(ap->p95, bp->p95) > threshold;
+    fprintf(ofile, "%c%-11s %9ld %7ld %9.1f %9.2f %9.2f %9.2f",
+            regressed ? '*' : ' ', ap->name, ap->count, ap->failed, ap->rps,
+            ap->p50, ap->p95, ap->p99);
+    if (bp)
+        fprintf(ofile, "   %+6.1f%% %+6.1f%% %+6.1f%% %+6.1f%%",
+                change(ap->rps, bp->rps), change(ap->p50, bp->p50),
+                change(ap->p95, bp->p95), change(ap->p99, bp->p99));
+    fprintf(ofile, "\n");
+    return (regressed);
+}
+
+static void save(const char *fname, struct action *all)
+{
+    int i;
+    FILE *ofile;
+
+    if ((ofile = fopen(fname, "w")) == NULL) {
+        fprintf(stderr, "lw-load: can't write %s\n", fname);
+        exit(2);
+    }
+    fprintf(ofile, "#lw-load: action\trequests\tfailed\treq/s\tp50\tp95"
+            "\tp99\n");
+    for (i = 0; i <= MAXACTIONS + 1; i++) {
+        struct action *ap = (i <= MAXACTIONS) ? &act[i] : all;
+
+        if (ap->count > 0)
+            fprintf(ofile, "%s\t%ld\t%ld\t%.3f\t%.3f\t%.3f\t%.3f\n",
+                    ap->name, ap->count, ap->failed, ap->rps, ap->p50,
+                    ap->p95, ap->p99);
+    }
+    fclose(ofile);
+}
+
+/* Parse a URL of the form http://HOST[:PORT]/PATH. */
+static void parse_url(char *url)
+{
+    char *p;
+    int e;
+    struct addrinfo hints;
+
+    if (strncmp(url, "http://", 7) != 0) {
+        fprintf(stderr, "lw-load: only http:// URLs are supported\n");
+        exit(1);
+    }
+    host = strdup(url + 7);
+    if ((p = strchr(host, '/')) != NULL) {
+        path = strdup(p);
+        *p = '\0';
+    }
+    else
+        path = "/cgi-bin/lightwave";
+    port = "80";
+    if ((p = strrchr(host, ':')) != NULL) {
+        *p = '\0';
+        port = p + 1;
+    }
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if ((e = getaddrinfo(host, port, &hints, &addr)) != 0) {
+        fprintf(stderr, "lw-load: %s: %s\n", host, gai_strerror(e));
+        exit(1);
+    }
+}
+
+static void help(char *pname)
+{
+    fprintf(stderr, "usage: %s [-c CLIENTS] [-n REQUESTS] [-d SECONDS]"
+            " [-o OUTPUT]\n    [-b BASELINE [-t PERCENT]] (-x PROGRAM |"
+            " -u URL) [FILE ...]\n", pname);
+}
+
+int main(int argc, char **argv)
+{
+    char *bfname = NULL, *ofname = NULL;
+    double duration = 0., elapsed, t, threshold = 10.;
+    int c, i, nclients = 4, regressed = 0;
+    long j;
+    pthread_t *tid;
+    struct action all;
+    FILE *ifile;
+
+    while ((c = getopt(argc, argv, "b:c:d:n:o:t:u:x:h")) != -1) {
+        switch (c) {
+          case 'b': bfname = optarg; break;
+          case 'c': nclients = atoi(optarg); break;
+          case 'd': duration = atof(optarg); break;
+          case 'n': maxreq = atol(optarg); break;
+          case 'o': ofname = optarg; break;
+          case 't': threshold = atof(optarg); break;
+          case 'u': parse_url(optarg); break;
+          case 'x': program = optarg; break;
+          default: help(argv[0]); exit(1);
+        }
+    }
+    if ((program == NULL) == (addr == NULL) || nclients < 1) {
+        help(argv[0]);
+        exit(1);
+    }
+    if (optind == argc)
+        read_queries(stdin);
+    for (i = optind; i < argc; i++) {
+        if ((ifile = fopen(argv[i], "r")) == NULL) {
+            fprintf(stderr, "%s: can't read %s\n", argv[0], argv[i]);
+            exit(2);
+        }
+        read_queries(ifile);
+        fclose(ifile);
+    }
+    if (nquery < 1) {
+        fprintf(stderr, "%s: no requests to make\n", argv[0]);
+        exit(1);
+    }
+    if (maxreq <= 0)
+        maxreq = (duration > 0.) ? -1 : nquery;
+    if (maxreq < 0)
+        maxreq = 0x7fffffffL;	/* until the time is up */
+    if (bfname)
+        read_baseline(bfname);
+
+    tid = xrealloc(NULL, nclients * sizeof(pthread_t));
+    t = now();
+    if (duration > 0.)
+        deadline = t + duration;
+    for (i = 0; i < nclients; i++)
+        if (pthread_create(&tid[i], NULL, client, NULL) != 0) {
+            fprintf(stderr, "%s: can't start client %d\n", argv[0], i);
+            exit(2);
+        }
+    for (i = 0; i < nclients; i++)
+        pthread_join(tid[i], NULL);
+    elapsed = now() - t;
+
+    /* Summarize the results for each action, and for all of them. */
+    memset(&all, 0, sizeof(all));
+    strcpy(all.name, "all");
+    for (i = 0; i <= MAXACTIONS; i++) {
+        if (act[i].nlat == 0)
+            continue;
+        all.count += act[i].count;
+        all.failed += act[i].failed;
+        all.latency = xrealloc(all.latency,
+                               (all.nlat + act[i].nlat) * sizeof(double));
+        for (j = 0; j < act[i].nlat; j++)
+            all.latency[all.nlat++] = act[i].latency[j];
+        summarize(&act[i], elapsed);
+    }
+    summarize(&all, elapsed);
+
+    printf("%d clients, %ld requests in %.2f s\n", nclients, all.count,
+           elapsed);
+    printf(" %-11s %9s %7s %9s %9s %9s %9s", "action", "requests", "failed",
+           "req/s", "p50 ms", "p95 ms", "p99 ms");
+    if (nbase)
+        printf("   %7s %7s %7s %7s", "req/s", "p50", "p95", "p99");
+    printf("\n");
+    for (i = 0; i <= MAXACTIONS; i++)
+        if (act[i].count > 0)
+            regressed |= report(stdout, &act[i], threshold);
+    regressed |= report(stdout, &all, threshold);
+    if (ofname)
+        save(ofname, &all);
+    exit(regressed);
+}
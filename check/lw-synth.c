@@ -0,0 +1,152 @@
+/* file: lw-synth.c		18 October 2026
+
+Generate a synthetic WFDB record for LightWAVE benchmarks
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+_______________________________________________________________________________
+
+Usage:
+    lw-synth [-n NSIG] [-d SECONDS] [-f FREQ] [-a ANNINTERVAL] RECORD
+
+lw-synth writes RECORD.hea, two signal files, and an annotation file
+(RECORD.atr) in the current directory.  The record has NSIG signals (16 by
+default) sampled at multiples of the frame frequency FREQ (250 Hz): every
+fourth signal has 4 samples per frame, every third signal has 2, and the
+others have 1.  Even-numbered signals are written in format 212 and odd-
+numbered signals in format 16, so that both of the common decoders are
+exercised.  The record is SECONDS long (3600 by default).  An annotation is
+written every ANNINTERVAL frames (by default, every 0.3 seconds), with a mix
+of types, subtypes, channels, and aux strings.
+
+The waveforms are sums of sinusoids and noise, so that first differences
+have a realistic range of magnitudes.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <wfdb/wfdb.h>
+#include <wfdb/ecgcodes.h>
+
+static void help(char *pname)
+{
+    fprintf(stderr, "usage: %s [-n NSIG] [-d SECONDS] [-f FREQ]"
+            " [-a ANNINTERVAL] RECORD\n", pname);
+}
+
+int main(int argc, char **argv)
+{
+    char *record, fname[2][256], aux[32];
+    double freq = 250., seconds = 3600., x;
+    int c, i, j, k, nsig = 16, framelen;
+    long ainterval = 0, t, nframes;
+    WFDB_Anninfo ai;
+    WFDB_Annotation annot;
+    WFDB_Sample *v;
+    WFDB_Siginfo *si;
+    static int types[] = { NORMAL, NORMAL, NORMAL, PVC, NORMAL, APC, NORMAL,
+                           RHYTHM, NORMAL, NOTE };
+
+    while ((c = getopt(argc, argv, "n:d:f:a:")) != -1) {
+        switch (c) {
+          case 'n': nsig = atoi(optarg); break;
+          case 'd': seconds = atof(optarg); break;
+          case 'f': freq = atof(optarg); break;
+          case 'a': ainterval = atol(optarg); break;
+          default: help(argv[0]); exit(1);
+        }
+    }
+    if (optind != argc - 1 || nsig < 1 || freq <= 0. || seconds <= 0.) {
+        help(argv[0]);
+        exit(1);
+    }
+    record = argv[optind];
+    if (ainterval <= 0)
+        ainterval = (long)(0.3 * freq + 0.5);
+    nframes = (long)(seconds * freq);
+
+    SUALLOC(si, nsig, sizeof(WFDB_Siginfo));
+    sprintf(fname[0], "%s.dat", record);
+    sprintf(fname[1], "%s_16.dat", record);
+    for (i = framelen = 0; i < nsig; i++) {
+        si[i].fname = fname[i & 1];
+        SUALLOC(si[i].desc, 16, 1);
+        sprintf(si[i].desc, "S%d", i);
+        si[i].units = "mV";
+        si[i].gain = 200;
+        si[i].group = i & 1;
+        si[i].fmt = (i & 1) ? 16 : 212;
+        si[i].spf = (i % 4 == 3) ? 4 : (i % 3 == 2) ? 2 : 1;
+        si[i].adcres = (i & 1) ? 16 : 12;
+        framelen += si[i].spf;
+    }
+    SUALLOC(v, framelen, sizeof(WFDB_Sample));
+
+    setsampfreq(freq);
+    if (osigfopen(si, nsig) != nsig) {
+        fprintf(stderr, "%s: can't create signal files\n", argv[0]);
+        exit(2);
+    }
+    ai.name = "atr";
+    ai.stat = WFDB_WRITE;
+    if (annopen(record, &ai, 1) < 0) {
+        fprintf(stderr, "%s: can't create annotation file\n", argv[0]);
+        exit(2);
+    }
+
+    srand(1);
+    for (t = 0; t < nframes; t++) {
+        for (i = k = 0; i < nsig; i++) {
+            for (j = 0; j < si[i].spf; j++, k++) {
+                x = (t * si[i].spf + j) / (freq * si[i].spf);
+                v[k] = (int)(400 * sin(2 * M_PI * (1.1 + 0.1 * i) * x)
+                             + 100 * sin(2 * M_PI * 17.0 * x)
+                             + (rand() % 21) - 10);
+            }
+        }
+        if (putvec(v) < 0) {
+            fprintf(stderr, "%s: write error\n", argv[0]);
+            exit(2);
+        }
+        if (t % ainterval == 0) {
+            k = (int)(t / ainterval);
+            annot.time = t;
+            annot.anntyp = types[k % 10];
+            annot.subtyp = k % 3;
+            annot.chan = k % nsig;
+            annot.num = 0;
+            annot.aux = NULL;
+            if (annot.anntyp == RHYTHM) {
+                sprintf(aux + 1, "(%s", (k / 10) % 2 ? "AFIB" : "N");
+                aux[0] = strlen(aux + 1);
+                annot.aux = (unsigned char *)aux;
+            }
+            else if (annot.anntyp == NOTE) {
+                sprintf(aux + 1, "note %d", k);
+                aux[0] = strlen(aux + 1);
+                annot.aux = (unsigned char *)aux;
+            }
+            putann(0, &annot);
+        }
+    }
+    newheader(record);
+    wfdbquit();
+    for (i = 0; i < nsig; i++)
+        SFREE(si[i].desc);
+    SFREE(si);
+    SFREE(v);
+    exit(0);
+}
@@ -0,0 +1,115 @@
+/* file: pa-bench.c		18 October 2026
+
+Microbenchmarks for patchann
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+_______________________________________________________________________________
+
+Usage:
+    pa-bench [N]
+
+pa-bench measures patchann's in-memory annotation array by loading N
+annotations (5000 by default) in time order, as when an annotation file is
+read, and in random order, as when an edit log is applied, and then deleting
+them all.  Like lw-bench, it includes the program's source directly.
+*/
+
+#define main patchann_main
+#include "../server/patchann.c"
+#undef main
+#include "bench.h"
+
+static long nann;
+static WFDB_Annotation *alist;
+
+static void load(long *order)
+{
+    long i;
+
+    for (i = 0; i < nann; i++) {
+        annot = alist[order ? order[i] : i];
+        insert_ann();
+    }
+}
+
+static void unload(void)
+{
+    flush_pending();
+    clear_anns();
+}
+
+static void bench_insert_ordered(void *arg)
+{
+    load(NULL);
+    unload();
+}
+
+static void bench_insert_random(void *arg)
+{
+    load((long *)arg);
+    unload();
+}
+
+static void bench_delete_random(void *arg)
+{
+    long *order = arg, i;
+
+    load(NULL);
+    for (i = 0; i < nann; i++) {
+        annot = alist[order[i]];
+        delete_ann();
+    }
+    unload();
+}
+
+int main(int argc, char **argv)
+{
+    char name[64];
+    long i, j, k, *order;
+    static char aux[] = "\005(AFIB";
+
+    nann = argc > 1 ? atol(argv[1]) : 5000;
+    if (nann < 1) {
+        fprintf(stderr, "usage: %s [N]\n", argv[0]);
+        exit(1);
+    }
+    bench_init();
+
+    /* Make a set of annotations with distinct sort keys, and a random
+       permutation of them. */
+    SUALLOC(alist, nann, sizeof(WFDB_Annotation));
+    SUALLOC(order, nann, sizeof(long));
+    for (i = 0; i < nann; i++) {
+        alist[i].time = 75 * i;
+        alist[i].anntyp = (i % 10) ? NORMAL : RHYTHM;
+        alist[i].aux = (i % 10) ? NULL : (unsigned char *)aux;
+        order[i] = i;
+    }
+    srand(1);
+    for (i = nann - 1; i > 0; i--) {
+        j = rand() % (i + 1);
+        k = order[i]; order[i] = order[j]; order[j] = k;
+    }
+
+    sprintf(name, "insert_ann (%ld, ordered)", nann);
+    bench_run(name, bench_insert_ordered, NULL, 0);
+    sprintf(name, "insert_ann (%ld, random)", nann);
+    bench_run(name, bench_insert_random, order, 0);
+    sprintf(name, "insert_ann+delete_ann (%ld, random)", nann);
+    bench_run(name, bench_delete_random, order, 0);
+
+    SFREE(alist);
+    SFREE(order);
+    exit(0);
+}
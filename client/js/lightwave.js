@@ -54,7 +54,7 @@ var server,
     sdb = '',	// shortened name of the selected database
     record = '',// name of the selected record
     recinfo,    // metadata for the selected record, initialized by slist()
-    tickfreq,   // ticks per second (LCM of sampling frequencies of signals)
+    tickfreq,   // ticks per second (highest sampling frequency of signals)
     adt_ticks,  // length of longest annotation set, in ticks
     sdt_ticks,  // length of signals, in ticks
     rdt_ticks,	// record length, in ticks (max of adt_ticks and sdt_ticks)
@@ -78,7 +78,18 @@ var server,
     griddt,	// interval (in ticks) between vertical grid-lines on plot
     griddx,	// interval (in SVG x-units) between vertical grid-lines on plot
     tpool = [], // cache of 'trace' objects (10-second signal segments)
+    tindex = {},// traces in tpool by db|record|signal, sorted by t0
     tid = 0,	// next trace id (all traces have id < tid)
+    inflight = {}, // unanswered signal requests, by db|record|t0
+    ninflight = 0, // number of read-ahead requests in inflight
+    ra_max = 3, // maximum number of read-ahead requests in flight
+    fetch_timeout = 30000, // ms to wait for a signal request (see read_signals)
+    ra_max_lead = 16, // maximum number of windows to read ahead
+    ra_dir = 1, // direction of travel through the record (1 or -1)
+    ra_speed = 0, // recent speed of travel, in ticks per second
+    ra_t = -1,  // t0_ticks at the last go_here()
+    ra_ms = 0,  // time of the last go_here(), in ms
+    ra_latency = 500, // average time to answer a signal request, in ms
     target = '*',// search target, set in Find... dialog
     g_visible = 1, // visibility flag for grid (1: on, 0: off)
     m_visible = 1, // visibility flag for annotation marker bars (1: on, 0: off)
@@ -98,6 +109,7 @@ var server,
     pending = 0,  // count of pending AJAX requests
     rqlog = '',	// AJAX request log (hidden by default)
     autoscroll = null, // autoplay_fwd/rev timer
+    player = null, // controller of the stream read by play_stream()
     emode = 1, // edit mode (1: no edit, 2: edit with mouse, 3: edit with touch)
     editing = false,   // editing controls hidden if false
     mouse = false,     // true if user selected 'Edit using mouse'
@@ -108,6 +120,7 @@ var server,
     changes = [],	// edit log
     undo_count = 0,	// number of undos that are possible from current state
     ilast = -1,		// index in selarr of annot most recently found
+    max_url_length = 2000, // longest URL sent as GET (see get_jsonp())
 
 // SVG click targets
     $grid,	// grid click target
@@ -194,25 +207,107 @@ function init_tpool(ntrace) {
     }
 }
 
+// Return the key for the traces of a signal in tindex
+function trace_key(db, record, signame) {
+    return db + '|' + record + '|' + signame;
+}
+
+// Add trace s to tindex, or remove it if remove is true
+function index_trace(s, remove) {
+    var i, key = trace_key(s.db, s.record, s.name), list = tindex[key];
+
+    if (remove) {
+	if (list && (i = list.indexOf(s)) >= 0) { list.splice(i, 1); }
+	if (list && list.length === 0) { delete tindex[key]; }
+	return;
+    }
+    if (!list) {
+	list = tindex[key] = [];
+	list.maxdt = 0;	// duration of the longest trace in list
+    }
+    for (i = list.length; i > 0 && list[i-1].t0 > s.t0; i--) { }
+    list.splice(i, 0, s);
+    if (s.tf - s.t0 > list.maxdt) { list.maxdt = s.tf - s.t0; }
+}
+
 // Find a trace in the cache
 function find_trace(db, record, signame, t) {
-    var i;
+    var hi, i, list = tindex[trace_key(db, record, signame)], lo = 0;
 
-    for (i = 0; i < tpool.length; i++) {
-	if (tpool[i].name === signame &&
-	    tpool[i].t0 <= t && t < tpool[i].tf &&
-	    tpool[i].record === record && tpool[i].db === db) {
-	    return tpool[i];
-	}
+    if (!list) { return null; }
+
+    // find the last trace that begins at or before t, then check it and any
+    // earlier ones that might be long enough to include t
+    for (hi = list.length; lo < hi; ) {
+	i = (lo + hi) >> 1;
+	if (list[i].t0 <= t) { lo = i + 1; }
+	else { hi = i; }
+    }
+    for (i = lo - 1; i >= 0 && list[i].t0 + list.maxdt > t; i--) {
+	if (t < list[i].tf) { return list[i]; }
     }
     return null;
 }
 
+// Decode the samples sent by the server as an array of error-bounded codes
+// (if maxerr was requested;  see the description of the format in the
+// server's codec.c)
+function decode_samples(code) {
+    var bits, d, e, i, j, k, n, nb, order, p, pos, q, r1, r2, samp = [], step,
+	u, x;
+
+    // return the next n bits (no more than 32) of d
+    function get(n) {
+	var b, v = 0;
+	for ( ; n > 0; n--, pos++) {
+	    b = (pos >> 3) < nb ? (d.charCodeAt(pos >> 3) >> (7 - (pos & 7))) & 1
+		: 0;
+	    v = v*2 + b;
+	}
+	return v;
+    }
+
+    for (i = 0; i < code.length; i++) {
+	d = atob(code[i]);
+	nb = d.length;
+	pos = 0;
+	n = get(16);
+	e = get(16);
+	order = get(1) + 1;
+	step = 2*e + 1;
+	for (j = k = p = 0; j < n; j++) {
+	    if (j % 64 === 0) { k = get(4); }
+	    for (u = 0; u < 20 && get(1) === 1; u++)
+		;
+	    if (u === 20) {	// escape: the sample follows in 32 bits
+		x = get(32);
+		if (x >= 2147483648) { x -= 4294967296; }
+		samp.push(x);
+		if (x === -32768) { continue; }  // not used for prediction
+	    }
+	    else {
+		u = u*(1 << k) + get(k);
+		q = (u % 2) ? -(u + 1)/2 : u/2;
+		x = ((order === 1) ? r1 : 2*r1 - r2) + q*step;
+		samp.push(x);
+	    }
+	    r2 = r1;
+	    r1 = x;
+	}
+    }
+    return samp;
+}
+
 // Replace the least-recently-used trace with the contents of s
 function set_trace(db, record, s) {
-    var i, idmin, imin, j, len, ni, p, trace, v, vmean, vmid, vmax, vmin, w;
+    var coded, i, idmin, imin, j, len, ni, p, trace, v, vmean, vmid, vmax,
+	vmin, w;
 
     idmin = tid;
+    if ((coded = s.hasOwnProperty('code'))) {
+	s.samp = decode_samples(s.code);
+	delete s.code;
+    }
     len = s.samp.length;
 
     // do nothing if the trace is already in the pool
@@ -225,11 +320,12 @@ function set_trace(db, record, s) {
     s.record = record;
     s.tf = s.t0 + len*s.tps;
 
-    // restore amplitudes from first differences sent by server
+    // restore amplitudes from first differences sent by server (coded
+    // samples are decoded as amplitudes)
     v = s.samp;
     vmean = vmax = vmin = v[0];
     for (j = ni = p = 0; j < len; j++) {
-	p = v[j] += p;
+	p = coded ? v[j] : (v[j] += p);
 	// ignore invalid samples in baseline calculation
 	if (p === -32768) { ni++; }
 	else {
@@ -254,7 +350,9 @@ function set_trace(db, record, s) {
 	    idmin = tpool[i].id;
 	}
     }
+    if (tpool[imin].name) { index_trace(tpool[imin], true); }
     tpool[imin] = s; // replace it
+    index_trace(s, false);
 }
 
 // Convert argument (in samples) to a string in HH:MM:SS format
@@ -317,13 +415,33 @@ function html_escape(s) {
 }
 
 // Request JSONP data (equivalent to '$.getJSON' minus the
-// anti-caching and anti-cross-domain options)
-function get_jsonp(url, callback) {
-    $.ajax({ dataType: "json",
-             url: url,
-             success: callback,
-             cache: true,
-             crossDomain: true });
+// anti-caching and anti-cross-domain options).  Requests that would need a
+// very long URL (such as fetches of many signals) are sent using POST,
+// since servers and proxies may reject long URLs.  If failure is given, it
+// is called if the request fails or is not answered within fetch_timeout ms.
+function get_jsonp(url, callback, failure) {
+    var i = url.indexOf('?'), timeout = failure ? fetch_timeout : 0;
+
+    if (url.length > max_url_length && i > 0) {
+	$.ajax({ dataType: "json",
+		 type: 'POST',
+		 url: url.substring(0, i),
+		 contentType: 'application/x-www-form-urlencoded',
+		 data: url.substring(i + 1),
+		 success: callback,
+		 error: failure,
+		 timeout: timeout,
+		 crossDomain: true });
+    }
+    else {
+	$.ajax({ dataType: "json",
+		 url: url,
+		 success: callback,
+		 error: failure,
+		 timeout: timeout,
+		 cache: true,
+		 crossDomain: true });
+    }
 }
 
 // Update the summary on the Tables tab
@@ -571,7 +689,7 @@ function slist(t0_string) {
 		for (i = 0; i < nsig; i++) {
 		    s_visible[signals[i].name] = mag[signals[i].name] = 1;
 		}
-		init_tpool(nsig * 8);
+		init_tpool(nsig * (8 + ra_max_lead));
 	    }
 	    else {
 		signals = null;
@@ -732,8 +850,11 @@ function read_annotations(t0_string) {
 		    }
 		}
 		// if an edit log exists for this annotator, load and reapply it
+		// (except for edits that the server has merged from its journal)
 		selarr = ann[i].annotation;
-		load_editlog(db, record, ann[i].name, true);
+		load_editlog(db, record, ann[i].name, true,
+			     ann[i].journal
+			     ? journaled_count(db, record, ann[i].name) : 0);
 		summarize(ann[i]);
 	    }
 	    if (nann > 0) {
@@ -771,9 +892,13 @@ function read_annotations(t0_string) {
     }
 }
 
-// Retrieve one or more signal segments starting at t for the selected record
+// Retrieve one or more signal segments starting at t for the selected record.
+// If update is false (read-ahead), the segments are only cached.  If they have
+// already been requested, the request is not repeated.  Return true if a
+// request is pending.
 function read_signals(t0, update) {
-    var i, fetch, s, sigreq = '', t, tf, tr = t0 + dt_ticks, trace = '';
+    var i, fetch, key, rdb = db, rq, rrec = record, s, sigreq = '', t, tf,
+	tr = t0 + dt_ticks, trace = '';
 
     if (signals) {
 	for (i = 0; i < signals.length; i++) {
@@ -797,6 +922,15 @@ function read_signals(t0, update) {
 	}
     }
     if (sigreq) {
+	// if a read-ahead request for these segments is in flight, wait for it
+	key = db + '|' + record + '|' + tr;
+	if ((rq = inflight[key])) {
+	    if (update) { rq.update = true; }
+	    return true;
+	}
+	inflight[key] = rq = { update: update, readahead: !update,
+			       start: Date.now() };
+	if (rq.readahead) { ninflight++; }
 	url = server
 	    + '?action=fetch'
 	    + '&db=' + db
@@ -804,21 +938,86 @@ function read_signals(t0, update) {
 	    + sigreq
 	    + '&t0=' + tr/tickfreq
 	    + '&dt=' + dt_sec
+	    + maxerr_flag()
 	    + server_flags;
 	show_status(true);
 	get_jsonp(url, function(data) {
+	    delete inflight[key];
+	    ra_latency = 0.8*ra_latency + 0.2*(Date.now() - rq.start);
 	    fetch = data.fetch;
 	    if (fetch && fetch.hasOwnProperty('signal')) {
 		s = data.fetch.signal;
 		for (i = 0; i < s.length; i++) {
-		    set_trace(db, record, s[i]);
+		    set_trace(rdb, rrec, s[i]);
 		}
 	    }
-	    if (update) { update_output(); }
 	    show_status(false);
+	    if (rq.readahead) {
+		ninflight--;
+		// if the view was waiting for this, request anything else it
+		// needs, then continue reading ahead
+		if (rq.update) { read_signals(t0_ticks, true); }
+		readahead();
+	    }
+	    else { update_output(); }
+	}, function() {
+	    // forget a failed request, so that it can be made again, and show
+	    // whatever is available if the view was waiting for it
+	    delete inflight[key];
+	    show_status(false);
+	    if (rq.readahead) { ninflight--; }
+	    if (rq.update) { update_output(); }
 	});
+	return true;
     }
     else if (update) { update_output(); }
+    return false;
+}
+
+// Return the query parameter requesting error-bounded coding of samples, if
+// a maximum error was set on the Settings tab.
+function maxerr_flag() {
+    var e = parseFloat($('[name=maxerr]').val());
+
+    return (e > 0) ? '&maxerr=' + e : '';
+}
+
+// Update the direction and speed of travel through the record.  Jumps of more
+// than two windows (to a search result, for example) reset the speed.
+function track_motion(t) {
+    var ms = Date.now(), dt = Math.abs(t - ra_t);
+
+    if (ra_t >= 0 && dt > 0) {
+	ra_dir = (t > ra_t) ? 1 : -1;
+	if (dt <= 2*dt_ticks && ms > ra_ms && ms - ra_ms < 2000) {
+	    ra_speed = 0.7*ra_speed + 0.3*dt*1000/(ms - ra_ms);
+	}
+	else { ra_speed = 0; }
+    }
+    ra_t = t;
+    ra_ms = ms;
+}
+
+// Keep read-ahead requests in flight for the windows that the view is moving
+// toward.  The number of windows read ahead is the lead set on the Settings
+// tab, plus the number that will be passed in the time needed to read one, so
+// that autoplay does not have to wait for the server.
+function readahead() {
+    var i, lead, t, tw;
+
+    if (!signals || dt_ticks < 1 || t0_ticks < 0) { return; }
+    lead = parseInt($('[name=readahead]').val(), 10);
+    if (isNaN(lead) || lead < 0) { lead = 2; }
+    if (ra_speed > 0) {
+	lead += Math.ceil(ra_speed*ra_latency/1000/dt_ticks);
+    }
+    if (lead > ra_max_lead) { lead = ra_max_lead; }
+    tw = Math.floor(t0_ticks/dt_ticks) * dt_ticks;
+    for (i = 1; i <= lead && ninflight < ra_max; i++) {
+	t = tw + ra_dir*i*dt_ticks;
+	if (t < 0 || t >= rdt_ticks) { break; }
+	read_signals(t, false);
+    }
 }
 
 // Show the number of AJAX calls to the server, and the number not yet answered
@@ -874,9 +1073,59 @@ function test_sync() {
 	}});
 }
 
-// "Save pending edits" button handler
+// Return the local storage key for the number of entries of an edit log that
+// have been backed up by the scribe.
+function synced_key(db, record, annotator) {
+    return 'LightWAVE-synced|' + db + '|' + record + '|' + annotator;
+}
+
+// Return the number of entries of an edit log that have been backed up.
+function synced_count(db, record, annotator) {
+    try {
+	return parseInt(localStorage.getItem(synced_key(db, record, annotator)),
+			10) || 0;
+    }
+    catch (e) { return 0; }
+}
+
+// Return the local storage key for the number of entries of an edit log (from
+// its beginning) that the scribe has added to the server's shared journal.
+function journaled_key(db, record, annotator) {
+    return 'LightWAVE-journaled|' + db + '|' + record + '|' + annotator;
+}
+
+// Return the number of entries of an edit log that are in the journal, and so
+// are merged by the server with the annotations that it sends.
+function journaled_count(db, record, annotator) {
+    try {
+	return parseInt(localStorage.getItem(journaled_key(db, record,
+							   annotator)),
+			10) || 0;
+    }
+    catch (e) { return 0; }
+}
+
+// If an undo removes an edit that has already been backed up, forget the
+// scribe's checkpoint, so that the entire edit log is sent next time.
+function check_synced() {
+    var key = synced_key(db, record, annselected);
+
+    try {
+	if ((parseInt(localStorage.getItem(key), 10) || 0)
+	    > changes.length - undo_count) {
+	    localStorage.removeItem(key);
+	}
+    }
+    catch (e) { }
+}
+
+// "Save pending edits" button handler.  Only the edits made since the last
+// successful backup are sent, with 'offset' set to the number sent before;
+// if the scribe has lost track of them, it replies 409 (Conflict), and the
+// entire edit log is sent.
 function sync_edits() {
-    var body, boundary, cookie, etext = '', fname, i, timer;
+    var body, boundary, cookie, etext = '', fname, i, j, jkey, n, offset = 0,
+	skey, timer;
 
     if (changes.length - undo_count < 1) { alert("No pending edits!"); return; }
 
@@ -884,21 +1133,33 @@ function sync_edits() {
     save_editlog(db, record, annselected);
     load_editlog(db, record, annselected, false);
 
-    for (i = changes.length - 1; i >= undo_count; i--) {
-	etext += changes[i] + '\r\n';
-    }
-
     for (i = 0; i < nann; i++) {
 	if (ann[i].state === 2) break;
     }
     if (i >= nann) { alert("Select an annotation set to back up!");  return; }
 
+    skey = synced_key(db, record, ann[i].name);
+    jkey = journaled_key(db, record, ann[i].name);
+    n = changes.length - undo_count;
+    try { offset = parseInt(localStorage.getItem(skey), 10) || 0; }
+    catch (e) { }
+    if (offset > n) { offset = 0; }
+    if (offset === n) {
+	$('#syncnote').html('<p>All edits have been backed up already.');
+	return;
+    }
+    for (j = changes.length - 1 - offset; j >= undo_count; j--) {
+	etext += changes[j] + '\r\n';
+    }
+
     timer = setTimeout(alert_scribe_error, 2000);
     boundary = '-----------------------------' +
 	Math.floor(Math.random() * Math.pow(10, 8));
     fname = db.replace(/\//g, "+") + '+' + record.replace(/\//g, "+")
 	+ '.' + ann[i].name + '.log';
     body = '--' + boundary
+        + '\r\nContent-Disposition: form-data; name="offset"\r\n\r\n'
+	+ offset + '\r\n--' + boundary
         + '\r\nContent-Disposition: form-data; name="file";'
         + ' filename="' + fname + '"\r\nContent-type: text/plain\r\n\r\n'
 	+ '[LWEditLog-1.0] Record ' + db + '/' + record
@@ -916,6 +1177,11 @@ function sync_edits() {
 	url: scribe,
 	success:  function(data, result) {
 	    clearTimeout(timer);
+	    try {
+		localStorage.setItem(skey, (data && data.applied) || n);
+		localStorage.setItem(jkey, (data && data.journaled) || 0);
+	    }
+	    catch (e) { }
 	    // remove_editlog(db, record, annselected);
 	    etext = '<p>Edits for record <b>' + sdb + '/' + record
 				+ '</b>, annotator <b>' + annselected
@@ -934,6 +1200,12 @@ function sync_edits() {
 		clearTimeout(timer);
 		$('#syncnote').html("Edit backup failed.");
 		alert_scribe_error();
+	    },
+	    409: function() {
+		clearTimeout(timer);
+		try { localStorage.removeItem(skey); }
+		catch (e) { }
+		sync_edits();
 	    }
 	}
     });
@@ -1227,8 +1499,9 @@ function show_plot() {
 
 	    s = trace.samp;
 	    tps = trace.tps;
-	    imin = (t0_ticks - trace.t0)/tps;
-	    imax = Math.min(s.length, dt_ticks/tps + imin);
+	    // tps need not be an integer (see the resample parameter in lw-api)
+	    imin = Math.round((t0_ticks - trace.t0)/tps);
+	    imax = Math.min(s.length, Math.round(dt_ticks/tps) + imin);
 	    g = (-400*mag[sname]/(trace.scale*trace.gain));
 	    z = trace.zbase*g - y0;
 	    v = Math.round(g*s[imin] - z);
@@ -1262,8 +1535,8 @@ function show_plot() {
 			return;
 		    }
 		    s = trace.samp;
-		    imin = (tnext - trace.t0)/tps;
-		    imax = Math.min(s.length, (tf - tnext)/tps + imin);
+		    imin = Math.round((tnext - trace.t0)/tps);
+		    imax = Math.min(s.length, Math.round((tf - tnext)/tps) + imin);
 		}
 		for (i = imin; i < imax; i++) {
 		    if (s[i] !== -32768) {
@@ -1682,9 +1955,6 @@ function scrollrev() {
 	autoplay_off();
     }
     go_here(t0_ticks);
-    if (t0_ticks > 0) {
-	prefetch(Math.floor((t0_ticks - 1)/dt_ticks) * dt_ticks);
-    }
 }
 
 // Move forward (toward the end of the record) by the autoscroll increment
@@ -1692,13 +1962,14 @@ function scrollfwd() {
     t0_ticks += dt_sec;
     if (t0_ticks >= rdt_ticks - dt_ticks) { autoplay_off(); }
     go_here(t0_ticks);
-    if (t0_ticks < rdt_ticks - dt_ticks	&& (t0_ticks % dt_ticks === 0)) {
-	prefetch(t0_ticks + 2*dt_ticks);
-    }
 }
 
 // Stop autoplay in the View/edit window and reset the autoplay button labels
 function autoplay_off() {
+    if (player) {
+	player.abort();
+	player = null;
+    }
     if (autoscroll) {
 	clearInterval(autoscroll);
 	autoscroll= null;
@@ -1741,7 +2012,9 @@ function go_here(t_ticks) {
     t0_ticks = t_ticks;
     tf_ticks = t_ticks + dt_ticks;
 
+    track_motion(t0_ticks);
     read_signals(t0_ticks, true); // read signals not previously cached, if any
+    readahead();		  // and those that will be needed next
 
     if (tf_ticks >= rdt_ticks) {
 	$('.fwd').attr('disabled', 'disabled');
@@ -1838,7 +2111,6 @@ function gorev() {
     t0_string = $('.t0_str').val();
     t_ticks = strtim(t0_string) - dt_ticks;
     go_here(t_ticks);
-    prefetch(t_ticks - dt_ticks);
 }
 
 // Start autoplay in reverse and reset the scroll-reverse button label
@@ -1862,7 +2134,66 @@ function autoplay_fwd() {
 	dti = 50+dt_ticks*nsig/1000;
 	autoscroll = setInterval(scrollfwd, dti);
 	$('.scrollfwd').html('<div style="color: red">&#9632;</div>');
+	play_stream(dti);
+    }
+}
+
+// Receive the windows that forward autoplay (moving dt_sec ticks every dti
+// ms) will need as one stream from the server (see 'play' in lw-api.html),
+// and cache them, so that scrollfwd() does not need to request them one at a
+// time.  If the browser cannot read streams, or the stream fails, the
+// windows are read ahead as usual (see readahead()).
+function play_stream(dti) {
+    var buf = '', i, rdb = db, rrec = record, sigreq = '', text, url;
+
+    if (!window.fetch || !window.AbortController || !window.TextDecoder
+	|| !signals) {
+	return;
     }
+    for (i = 0; i < signals.length; i++) {
+	if (s_visible[signals[i].name] === 1) {
+	    sigreq += '&signal=' + encodeURIComponent(signals[i].name);
+	}
+    }
+    if (!sigreq) { return; }
+    url = server
+	+ '?action=play'
+	+ '&db=' + db
+	+ '&record=' + record
+	+ sigreq
+	+ '&t0=' + (t0_ticks + dt_ticks)/tickfreq
+	+ '&dt=' + dt_sec
+	+ '&speed=' + (dt_sec/tickfreq)/(dti/1000)
+	+ '&lead=2'
+	+ maxerr_flag()
+	+ server_flags;
+    player = new AbortController();
+    text = new TextDecoder();
+    fetch(url, { signal: player.signal }).then(function(response) {
+	var reader = response.body.getReader();
+
+	function next() {
+	    return reader.read().then(function(r) {
+		var data, j, lines, s;
+
+		if (r.done) { return; }
+		buf += text.decode(r.value, { stream: true });
+		lines = buf.split('\n');
+		buf = lines.pop();
+		for (i = 0; i < lines.length; i++) {
+		    data = JSON.parse(lines[i]);
+		    if (data.fetch && data.fetch.signal) {
+			s = data.fetch.signal;
+			for (j = 0; j < s.length; j++) {
+			    set_trace(rdb, rrec, s[j]);
+			}
+		    }
+		}
+		return next();
+	    });
+	}
+	return next();
+    }).catch(function() {});
 }
 
 // Move one screenful forward (toward the end of the record)
@@ -1872,7 +2203,6 @@ function gofwd() {
     t0_string = $('.t0_str').val();
     t_ticks = strtim(t0_string) + dt_ticks;
     go_here(t_ticks);
-    prefetch(t_ticks + Number(dt_ticks));
 }
 
 // Move to the end of the record
@@ -2455,6 +2785,7 @@ function jump_right() {
 function undo() {
     if (undo_count < changes.length) {
 	apply_edit(undo_count++, false);
+	check_synced();
 	$('#redo').removeAttr('disabled');
 	if (undo_count >= changes.length) {
 	    $('#undo').attr('disabled', 'disabled');
@@ -2593,8 +2924,9 @@ function show_localstorage() {
 }
 
 // If an edit log exists for the specified record and annotator, load its
-// contents into changes[].  If redo is true, reapply the changes.
-function load_editlog(db, record, annotator, redo) {
+// contents into changes[].  If redo is true, reapply the changes, except for
+// the oldest skip changes (those already merged by the server, if any).
+function load_editlog(db, record, annotator, redo, skip) {
     var i, key, n, s;
 
     key = 'LightWAVE-editlog|' + db + '|' + record + '|' + annotator;
@@ -2604,7 +2936,7 @@ function load_editlog(db, record, annotator, redo) {
 	changes = s.split("\n");
 	changes.pop();  // discard empty element after last '\n' in s
 	if (redo) {
-	    for (i = changes.length-1; i >= 0; i--) {
+	    for (i = changes.length-1 - (skip || 0); i >= 0; i--) {
 		if (changes[i]) { apply_edit(i, true); }
 	    }
 	}
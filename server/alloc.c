@@ -0,0 +1,287 @@
+/* file: alloc.c		18 October 2026
+
+Per-request allocation accounting for the LightWAVE server
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+_______________________________________________________________________________
+
+The server's own allocations (those made with SUALLOC, SALLOC, SREALLOC, and
+SSTRCPY in the sources that include alloc.h) are made by the functions below.
+Normally these simply call calloc(), realloc(), and free().  Once
+lw_alloc_start() has been called (for debug=alloc), they also count the
+allocations, the number of bytes requested, and the number of bytes in use
+(as reported by malloc_usable_size()), keep track of the largest number of
+bytes in use at once, and attribute the allocations to their sites (the
+source lines where they are made), so that the sites that requested the most
+bytes can be reported.  Since each request is handled by a process of its
+own, these are the totals for the request from that point on.  Allocations
+made within the WFDB library and the C library are not counted, but they are
+included in the peak resident set size of the process, which is reported
+with the totals.
+
+The blocks that have been counted are kept in a hash table, so that only
+their sizes are subtracted when they are freed (blocks allocated before
+counting began are ignored).  If an allocation fails (as it will when the
+address space limit set in sandbox.c is reached), a message giving its size
+and site is written to the standard error output (the web server's error log)
+before the WFDB library's MEMERR() reports the failure.
+
+The pipeline's encoder threads allocate memory too, so while allocations are
+being counted, the counts are kept under a lock.
+*/
+
+#include <malloc.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/resource.h>
+#include "alloc.h"
+
+static struct site {
+    const char *file;
+    int line;
+    long count;
+    double bytes;
+} site[LW_ALLOC_MAXSITES];
+static int counting, nsites;
+static long count;
+static double bytes, live, peak;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* The counted blocks (an open-addressed hash table with linear probing,
+   allocated directly with calloc() so that it is not counted itself). */
+static void **block;
+static size_t nblocks, blocksize;
+
+static size_t slot_of(void *p, size_t size)
+{
+    uint64_t h = (uint64_t)(uintptr_t)p * 0x9e3779b97f4a7c15ULL;
+
+    return ((size_t)(h >> 32) & (size - 1));
+}
+
+/* Add p to the table of counted blocks. */
+static void add_block(void *p)
+{
+    size_t i, j, newsize;
+    void **old = block;
+
+    if (2 * (nblocks + 1) > blocksize) {
+        newsize = blocksize ? 2 * blocksize : 1024;
+        if ((block = calloc(newsize, sizeof(void *))) == NULL) {
+            block = old;
+            return;	/* p will not be subtracted when it is freed */
+        }
+        for (j = 0; j < blocksize; j++)
+            if (old[j]) {
+                for (i = slot_of(old[j], newsize); block[i];
+                     i = (i + 1) & (newsize - 1))
+                    ;
+                block[i] = old[j];
+            }
+        free(old);
+        blocksize = newsize;
+    }
+    for (i = slot_of(p, blocksize); block[i]; i = (i + 1) & (blocksize - 1))
+        ;
+    block[i] = p;
+    nblocks++;
+}
+
+/* Remove p from the table of counted blocks.  Return 1 if it was there, or 0
+   otherwise. */
+static int remove_block(void *p)
+{
+    size_t i, j, k;
+
+    if (nblocks == 0)
+        return (0);
+    for (i = slot_of(p, blocksize); block[i] != p;
+         i = (i + 1) & (blocksize - 1))
+        if (block[i] == NULL)
+            return (0);
+    /* Move later entries of the cluster back into the gap, so that lookups
+       do not stop early. */
+    for (j = i; ; ) {
+        block[i] = NULL;
+        do {
+            j = (j + 1) & (blocksize - 1);
+            if (block[j] == NULL) {
+                nblocks--;
+                return (1);
+            }
+            k = slot_of(block[j], blocksize);
+        } while (i <= j ? (i < k && k <= j) : (i < k || k <= j));
+        block[i] = block[j];
+        i = j;
+    }
+}
+
+/* Record an allocation of n bytes at file:line, now using usable bytes (which
+   replace oldusable bytes, if the block was reallocated). */
+static void note(size_t n, size_t usable, size_t oldusable, const char *file,
+                 int line)
+{
+    int i;
+
+    count++;
+    bytes += n;
+    live += (double)usable - (double)oldusable;
+    if (live > peak)
+        peak = live;
+    for (i = 0; i < nsites; i++)
+        if (site[i].line == line && (site[i].file == file ||
+                                     strcmp(site[i].file, file) == 0))
+            break;
+    if (i == nsites && nsites < LW_ALLOC_MAXSITES) {
+        site[i].file = file;
+        site[i].line = line;
+        nsites++;
+    }
+    if (i < nsites) {
+        site[i].count++;
+        site[i].bytes += n;
+    }
+}
+
+static const char *basename_of(const char *file)
+{
+    const char *p = strrchr(file, '/');
+
+    return (p ? p + 1 : file);
+}
+
+static void failed(size_t n, const char *file, int line)
+{
+    fprintf(stderr, "lightwave: can't allocate %lu bytes at %s:%d\n",
+            (unsigned long)n, basename_of(file), line);
+}
+
+void *lw_calloc(size_t n, size_t size, const char *file, int line)
+{
+    void *p;
+
+    if (n == 0) n = 1;
+    if (size == 0) size = 1;
+    if ((p = calloc(n, size)) == NULL)
+        failed(n * size, file, line);
+    else if (counting) {
+        pthread_mutex_lock(&lock);
+        add_block(p);
+        note(n * size, malloc_usable_size(p), 0, file, line);
+        pthread_mutex_unlock(&lock);
+    }
+    return (p);
+}
+
+void *lw_realloc(void *p, size_t n, size_t size, const char *file, int line)
+{
+    size_t oldusable = 0;
+
+    if (counting && p) {
+        pthread_mutex_lock(&lock);
+        if (remove_block(p))
+            oldusable = malloc_usable_size(p);
+        pthread_mutex_unlock(&lock);
+    }
+    if ((p = p ? realloc(p, n * size) : malloc(n * size)) == NULL)
+        failed(n * size, file, line);
+    else if (counting) {
+        pthread_mutex_lock(&lock);
+        add_block(p);
+        note(n * size, malloc_usable_size(p), oldusable, file, line);
+        pthread_mutex_unlock(&lock);
+    }
+    return (p);
+}
+
+void lw_free(void *p)
+{
+    if (counting) {
+        pthread_mutex_lock(&lock);
+        if (remove_block(p))
+            live -= malloc_usable_size(p);
+        pthread_mutex_unlock(&lock);
+    }
+    free(p);
+}
+
+/* Start counting allocations.  This is called before any threads are
+   started. */
+void lw_alloc_start(void)
+{
+    counting = 1;
+}
+
+static int compare_sites(const void *a, const void *b)
+{
+    double x = ((const struct site *)a)->bytes;
+    double y = ((const struct site *)b)->bytes;
+
+    return ((x < y) - (x > y));
+}
+
+/* Return the peak resident set size of the process, in bytes. */
+static double maxrss(void)
+{
+    struct rusage ru;
+
+    return (getrusage(RUSAGE_SELF, &ru) == 0 ? ru.ru_maxrss * 1024. : 0.);
+}
+
+/* Sort the sites, and return the number to be reported. */
+static int top_sites(void)
+{
+    qsort(site, nsites, sizeof(struct site), compare_sites);
+    return (nsites < LW_ALLOC_TOPSITES ? nsites : LW_ALLOC_TOPSITES);
+}
+
+/* Write the totals, and the top sites (if any), as a JSON object. */
+void lw_alloc_json(FILE *ofile)
+{
+    int i, n;
+
+    pthread_mutex_lock(&lock);
+    fprintf(ofile, "{ \"count\": %ld, \"bytes\": %.0f, \"live\": %.0f,"
+            " \"peak\": %.0f, \"maxrss\": %.0f", count, bytes, live, peak,
+            maxrss());
+    if (counting) {
+        fprintf(ofile, ",\n    \"sites\": [");
+        for (i = 0, n = top_sites(); i < n; i++)
+            fprintf(ofile, "%s\n      { \"site\": \"%s:%d\", \"count\": %ld,"
+                    " \"bytes\": %.0f }", i ? "," : "",
+                    basename_of(site[i].file), site[i].line, site[i].count,
+                    site[i].bytes);
+        fprintf(ofile, " ]");
+    }
+    fprintf(ofile, " }");
+    pthread_mutex_unlock(&lock);
+}
+
+/* Write the totals, and the top sites (if any), as log keys. */
+void lw_alloc_log(FILE *ofile)
+{
+    int i, n;
+
+    pthread_mutex_lock(&lock);
+    fprintf(ofile, " allocs=%ld alloc_bytes=%.0f peak=%.0f maxrss=%.0f",
+            count, bytes, peak, maxrss());
+    if (counting && (n = top_sites()) > 0) {
+        fprintf(ofile, " sites=");
+        for (i = 0; i < n; i++)
+            fprintf(ofile, "%s%s:%d:%.0f", i ? "," : "",
+                    basename_of(site[i].file), site[i].line, site[i].bytes);
+    }
+    pthread_mutex_unlock(&lock);
+}
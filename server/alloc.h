@@ -0,0 +1,60 @@
+/* file: alloc.h		18 October 2026
+
+Per-request allocation accounting for the LightWAVE server
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LIGHTWAVE_ALLOC_H
+#define LIGHTWAVE_ALLOC_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <wfdb/wfdb.h>
+
+/* Largest number of allocation sites recorded, and number reported. */
+#define LW_ALLOC_MAXSITES 256
+#define LW_ALLOC_TOPSITES 5
+
+void *lw_calloc(size_t n, size_t size, const char *file, int line);
+void *lw_realloc(void *p, size_t n, size_t size, const char *file, int line);
+void lw_free(void *p);
+void lw_alloc_start(void);
+void lw_alloc_json(FILE *ofile);
+void lw_alloc_log(FILE *ofile);
+
+/* Replace the WFDB library's allocation macros, so that the allocations made
+   with them (and with SALLOC and SSTRCPY, which use them) in the sources that
+   include this file are counted, and attributed to the lines where they are
+   made (see alloc.c). */
+#undef SFREE
+#undef SUALLOC
+#undef SREALLOC
+
+#define SFREE(P) do { if (P) { lw_free((void *)(P)); P = 0; } } while (0)
+#define SUALLOC(P, N, S)                                                \
+    do {                                                                \
+        size_t WFDB_tmp1 = (N), WFDB_tmp2 = (S);                        \
+        if (!(P = lw_calloc(WFDB_tmp1, WFDB_tmp2, __FILE__, __LINE__))) \
+            MEMERR(P, WFDB_tmp1, WFDB_tmp2);                            \
+    } while (0)
+#define SREALLOC(P, N, S)                                               \
+    do {                                                                \
+        size_t WFDB_tmp1 = (N), WFDB_tmp2 = (S);                        \
+        if (!(P = lw_realloc((P), WFDB_tmp1, WFDB_tmp2, __FILE__,       \
+                             __LINE__)))                                \
+            MEMERR(P, WFDB_tmp1, WFDB_tmp2);                            \
+    } while (0)
+
+#endif
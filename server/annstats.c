@@ -0,0 +1,99 @@
+/* file: annstats.c		18 October 2026
+
+Annotation statistics indexes for LightWAVE databases
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+_______________________________________________________________________________
+
+An annotation statistics index summarizes the annotations of every record in
+a database, so that the LightWAVE server can answer questions such as "which
+records contain ventricular flutter, and how many episodes?" ('annquery'
+requests) without reading any annotation files.  It is built by 'lwannstats'
+and kept in a text file named ANNSTATS in the database directory, with one
+line for each type of annotation in each annotation file, and seven
+tab-separated fields:
+
+    record  annotator  freq  type  count  first  last
+
+'freq' is the record's frame frequency, and 'first' and 'last' are the times
+of the first and last annotations of the type, in frames.  The type of most
+annotations is their mnemonic (such as "N" or "V"), but the type of a rhythm
+change is the rhythm named in its aux string (such as "(VFL"), so that the
+count for a rhythm is the number of its episodes.  Lines beginning with '#'
+are comments.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <wfdb/ecgcodes.h>
+#include "annstats.h"
+
+/* Write the type of annot (no more than LW_ANNSTATS_TYPEMAX bytes, including
+   the null) to type, and return type. */
+char *lw_annstats_type(const WFDB_Annotation *annot, char *type)
+{
+    const unsigned char *aux = annot->aux;
+    char *p;
+    int i, n;
+
+    if (annot->anntyp == RHYTHM && aux && aux[0] > 1 && aux[1] == '(') {
+        n = (aux[0] < LW_ANNSTATS_TYPEMAX) ? aux[0] : LW_ANNSTATS_TYPEMAX - 1;
+        for (i = 0; i < n && aux[i+1] && aux[i+1] != ' '; i++)
+            type[i] = aux[i+1];
+        type[i] = '\0';
+    }
+    else {
+        strncpy(type, annstr(annot->anntyp), LW_ANNSTATS_TYPEMAX - 1);
+        type[LW_ANNSTATS_TYPEMAX - 1] = '\0';
+    }
+    for (p = type; *p; p++)
+        if (*p == '\t' || *p == '\n' || *p == '\r')
+            *p = ' ';
+    return (type);
+}
+
+/* Split an index line into its fields.  Return 1 if successful, or 0 if the
+   line is a comment or is malformed. */
+int lw_annstats_parse(char *line, struct lw_annstats_entry *e)
+{
+    char *field[7], *p = line;
+    int i;
+
+    if (*line == '#' || *line == '\0')
+        return (0);
+    for (i = 0; i < 7; i++) {
+        field[i] = p;
+        if ((p = strchr(p, '\t')) != NULL)
+            *p++ = '\0';
+        else if (i < 6)
+            return (0);
+        else
+            break;
+    }
+    e->record = field[0];
+    e->annotator = field[1];
+    e->freq = atof(field[2]);
+    e->type = field[3];
+    e->count = atol(field[4]);
+    e->first = atol(field[5]);
+    e->last = atol(field[6]);
+    return (1);
+}
+
+void lw_annstats_write(FILE *ofile, const struct lw_annstats_entry *e)
+{
+    fprintf(ofile, "%s\t%s\t%.12g\t%s\t%ld\t%ld\t%ld\n", e->record,
+            e->annotator, e->freq, e->type, e->count, (long)e->first,
+            (long)e->last);
+}
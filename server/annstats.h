@@ -0,0 +1,48 @@
+/* file: annstats.h		18 October 2026
+
+Annotation statistics indexes for LightWAVE databases
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LIGHTWAVE_ANNSTATS_H
+#define LIGHTWAVE_ANNSTATS_H
+
+#include <stdio.h>
+#include <wfdb/wfdb.h>
+
+/* Name of the index file, which is kept in the database directory alongside
+   RECORDS, ANNOTATORS, and CATALOG. */
+#define LW_ANNSTATS_FILE "ANNSTATS"
+
+/* Largest length of a type (see lw_annstats_type()), including the null. */
+#define LW_ANNSTATS_TYPEMAX 32
+
+/* One line of an index.  The string fields point into the line from which
+   the entry was parsed. */
+struct lw_annstats_entry {
+    char *record;	/* record name, as in RECORDS */
+    char *annotator;	/* annotator name, as in ANNOTATORS */
+    double freq;	/* frame frequency (frames per second) */
+    char *type;		/* annotation type (see lw_annstats_type()) */
+    long count;		/* number of annotations of this type */
+    WFDB_Time first;	/* time of the first of them, in frames */
+    WFDB_Time last;	/* time of the last of them, in frames */
+};
+
+char *lw_annstats_type(const WFDB_Annotation *annot, char *type);
+int lw_annstats_parse(char *line, struct lw_annstats_entry *e);
+void lw_annstats_write(FILE *ofile, const struct lw_annstats_entry *e);
+
+#endif
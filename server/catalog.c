@@ -0,0 +1,170 @@
+/* file: catalog.c		18 October 2026
+
+Record catalogs for LightWAVE databases
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+_______________________________________________________________________________
+
+A catalog is a compact index of the records in a database, built by
+'lwcatalog' and read by the LightWAVE server to answer 'rlist' requests
+without opening every record.  It is a text file named CATALOG in the
+database directory, with one line per record and seven tab-separated fields:
+
+    record  freq  nframes  nsig  basetime  signals  annotators
+
+The record names appear in the same order as in RECORDS.  'signals' and
+'annotators' are lists of names separated by '|'; tabs, newlines, and '|'
+characters within names are replaced by spaces when the catalog is written.
+Lines beginning with '#' are comments.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "catalog.h"
+
+/* Read a line of any length from ifile into *line (which is (re)allocated as
+   needed), and strip its line ending.  Return *line, or NULL at EOF. */
+char *lw_catalog_getline(WFDB_FILE *ifile, char **line, size_t *size)
+{
+    size_t len = 0;
+
+    if (*line == NULL || *size < 256) {
+        *size = 256;
+        SREALLOC(*line, *size, 1);
+    }
+    while (wfdb_fgets(*line + len, (int)(*size - len), ifile)) {
+        len += strlen(*line + len);
+        if (len > 0 && (*line)[len-1] == '\n')
+            break;
+        *size *= 2;
+        SREALLOC(*line, *size, 1);
+    }
+    if (len == 0)
+        return (NULL);
+    while (len > 0 && ((*line)[len-1] == '\n' || (*line)[len-1] == '\r'))
+        (*line)[--len] = '\0';
+    return (*line);
+}
+
+/* Split a catalog line into its fields.  Return 1 if successful, or 0 if the
+   line is a comment or is malformed. */
+int lw_catalog_parse(char *line, struct lw_catalog_entry *e)
+{
+    char *field[7], *p = line;
+    int i;
+
+    if (*line == '#' || *line == '\0')
+        return (0);
+    for (i = 0; i < 7; i++) {
+        field[i] = p;
+        if ((p = strchr(p, '\t')) != NULL)
+            *p++ = '\0';
+        else if (i < 6)
+            return (0);
+        else
+            break;
+    }
+    e->record = field[0];
+    e->freq = atof(field[1]);
+    e->nframes = atol(field[2]);
+    e->nsig = atoi(field[3]);
+    e->basetime = field[4];
+    e->signals = field[5];
+    e->annotators = field[6];
+    return (1);
+}
+
+/* Write a name to a signal or annotator list, preceded by a separator
+   unless it is the first in the list. */
+void lw_catalog_putname(FILE *ofile, const char *name, int first)
+{
+    if (!first)
+        putc(LW_CATALOG_SEP, ofile);
+    for ( ; *name; name++) {
+        if (*name == '\t' || *name == '\n' || *name == '\r'
+            || *name == LW_CATALOG_SEP)
+            putc(' ', ofile);
+        else
+            putc(*name, ofile);
+    }
+}
+
+void lw_catalog_write(FILE *ofile, const struct lw_catalog_entry *e)
+{
+    fprintf(ofile, "%s\t%.12g\t%ld\t%d\t%s\t%s\t%s\n", e->record, e->freq,
+            e->nframes, e->nsig, e->basetime ? e->basetime : "",
+            e->signals ? e->signals : "", e->annotators ? e->annotators : "");
+}
+
+/* Return a pointer to the first item of list, and set *len to its length.
+   To get the following item, call this function again with list set to the
+   returned pointer + *len.  Return NULL when there are no more items. */
+const char *lw_catalog_next(const char *list, size_t *len)
+{
+    const char *p;
+
+    if (*list == LW_CATALOG_SEP)
+        list++;
+    if (*list == '\0')
+        return (NULL);
+    if ((p = strchr(list, LW_CATALOG_SEP)) != NULL)
+        *len = p - list;
+    else
+        *len = strlen(list);
+    return (list);
+}
+
+/* Return 1 if name is an item of list, 0 otherwise. */
+int lw_catalog_has(const char *list, const char *name)
+{
+    const char *p;
+    size_t len, nlen = strlen(name);
+
+    for (p = list; (p = lw_catalog_next(p, &len)) != NULL; p += len)
+        if (len == nlen && strncmp(p, name, len) == 0)
+            return (1);
+    return (0);
+}
+
+/* Read the first (tab-delimited) column of db/fname (such as RECORDS or
+   ANNOTATORS) into a list of names.  Return the number of names, or -1 if the
+   file can't be read. */
+long lw_catalog_names(const char *db, const char *fname, char ***list)
+{
+    char *line = NULL, *path, *p;
+    long n = 0;
+    size_t size = 0;
+    WFDB_FILE *ifile;
+
+    SUALLOC(path, strlen(db) + strlen(fname) + 2, 1);
+    sprintf(path, "%s/%s", db, fname);
+    if ((ifile = wfdb_open(path, NULL, WFDB_READ)) == NULL) {
+        SFREE(path);
+        return (-1);
+    }
+    while (lw_catalog_getline(ifile, &line, &size)) {
+        if ((p = strchr(line, '\t')) != NULL)
+            *p = '\0';
+        if (*line == '\0' || *line == '#')
+            continue;
+        SREALLOC(*list, n + 1, sizeof(char *));
+        (*list)[n] = NULL;
+        SSTRCPY((*list)[n], line);
+        n++;
+    }
+    wfdb_fclose(ifile);
+    SFREE(line);
+    SFREE(path);
+    return (n);
+}
@@ -0,0 +1,52 @@
+/* file: catalog.h		18 October 2026
+
+Record catalogs for LightWAVE databases
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LIGHTWAVE_CATALOG_H
+#define LIGHTWAVE_CATALOG_H
+
+#include <stdio.h>
+#include <wfdb/wfdblib.h>
+
+/* Name of the catalog file, which is kept in the database directory alongside
+   RECORDS and ANNOTATORS. */
+#define LW_CATALOG_FILE "CATALOG"
+
+/* Separator for the items of the signal and annotator lists. */
+#define LW_CATALOG_SEP '|'
+
+/* One line of a catalog.  All of the string fields point into the line from
+   which the entry was parsed. */
+struct lw_catalog_entry {
+    char *record;	/* record name, as in RECORDS */
+    double freq;	/* frame frequency (frames per second) */
+    long nframes;	/* record length in frames (0 if unknown) */
+    int nsig;		/* number of signals (-1 if the header is unreadable) */
+    char *basetime;	/* base time and date, or "" if not defined */
+    char *signals;	/* signal names, separated by LW_CATALOG_SEP */
+    char *annotators;	/* annotator names, separated by LW_CATALOG_SEP */
+};
+
+char *lw_catalog_getline(WFDB_FILE *ifile, char **line, size_t *size);
+int lw_catalog_parse(char *line, struct lw_catalog_entry *e);
+void lw_catalog_write(FILE *ofile, const struct lw_catalog_entry *e);
+void lw_catalog_putname(FILE *ofile, const char *name, int first);
+int lw_catalog_has(const char *list, const char *name);
+const char *lw_catalog_next(const char *list, size_t *len);
+long lw_catalog_names(const char *db, const char *fname, char ***list);
+
+#endif
@@ -17,20 +17,50 @@ You should have received a copy of the GNU General Public License
 along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <sys/types.h>
+#include <unistd.h>
 #include "cgi.h"
 
-static struct {
+/* Parameters are kept in a hash table of names, each with a list of values
+   in the order in which they appeared in the request.  All names, values,
+   and table entries are allocated from an arena that is released in one step
+   by cgi_end(), so that parsing a request with many parameters needs only a
+   few calls to malloc. */
+
+struct cgi_value {
+    char *value;
+    struct cgi_value *next;
+};
+
+struct cgi_entry {
     char *name;
-    char **values;
-    size_t n_values;
-    size_t scan_index;
-} *query_params;
+    unsigned long hash;
+    struct cgi_value *first, *last;
+    struct cgi_value *scan;     /* next value for cgi_param_multiple() */
+    int scanning;               /* nonzero if a scan is in progress */
+    struct cgi_entry *next;     /* next entry in the same bucket */
+};
+
+struct arena_block {
+    struct arena_block *prev;
+    size_t size, used;
+    char data[1];
+};
+
+#define ARENA_BLOCK_SIZE 16384
+
+static struct arena_block *arena;
+static struct cgi_entry **table;
+static size_t n_buckets, n_entries;
 
-static size_t n_query_params;
+/* Request body (for POST requests), read by cgi_init(). */
+static char *body;
+static size_t body_len;
 
 #define XALLOC0(arr, n) do {                            \
         void *p_ = calloc((n), sizeof((arr)[0]));       \
@@ -38,22 +68,74 @@ static size_t n_query_params;
         (arr) = p_;                                     \
     } while (0)
 
-#define XREALLOC(arr, n) do {                              \
-        void *p_ = (arr);                                  \
-        size_t n_ = (n);                                   \
-        size_t m_ = sizeof((arr)[0]);                      \
-        assert(n_ <= ((size_t) -1 / m_));                  \
-        p_ = realloc(p_, n_ * m_);                         \
-        assert(p_ != NULL);                                \
-        (arr) = p_;                                        \
-    } while (0)
+/* Allocate len bytes from the arena. */
+static void *arena_alloc(size_t len)
+{
+    struct arena_block *b;
+    size_t size;
+    void *p;
+
+    len = (len + 7) & ~(size_t) 7;
+    if (!arena || arena->size - arena->used < len) {
+        size = (len > ARENA_BLOCK_SIZE / 2 ? len : ARENA_BLOCK_SIZE);
+        b = malloc(sizeof(struct arena_block) + size);
+        assert(b != NULL);
+        b->size = size;
+        b->used = 0;
+        /* A large block does not become the current block, so that the
+           space left in the current block can still be used. */
+        if (arena && size != ARENA_BLOCK_SIZE) {
+            b->prev = arena->prev;
+            arena->prev = b;
+        }
+        else {
+            b->prev = arena;
+            arena = b;
+        }
+        b->used = len;
+        return b->data;
+    }
+    p = arena->data + arena->used;
+    arena->used += len;
+    return p;
+}
 
+/* Read the body of a POST request.  This is done before the sandbox is
+   set up, since the sandbox may replace the standard input. */
 void cgi_init(void)
 {
+    const char *method, *clen;
+    size_t len;
+    ssize_t n;
+
+    body = NULL;
+    body_len = 0;
+    method = getenv("REQUEST_METHOD");
+    clen = getenv("CONTENT_LENGTH");
+    if (!method || strcmp(method, "POST") || !clen)
+        return;
+    len = strtoul(clen, NULL, 10);
+    if (len == 0 || len > CGI_MAX_BODY)
+        return;
+    XALLOC0(body, len + 1);
+    while (body_len < len
+           && (n = read(STDIN_FILENO, body + body_len, len - body_len)) > 0)
+        body_len += n;
 }
 
 void cgi_end(void)
 {
+    struct arena_block *b;
+
+    while ((b = arena)) {
+        arena = b->prev;
+        free(b);
+    }
+    free(table);
+    free(body);
+    table = NULL;
+    body = NULL;
+    n_buckets = n_entries = 0;
 }
 
 static int xdigitvalue(char c)
@@ -67,20 +149,15 @@ static int xdigitvalue(char c)
     return -1;
 }
 
+/* Decode a URL-encoded string into a new string in the arena.  The decoded
+   string is never longer than the encoded one, so no separate pass is needed
+   to find its length. */
 static char *url_decode(const char *str, size_t len)
 {
     char *s;
-    size_t i, j, dlen;
-
-    for (i = dlen = 0; i < len; i++) {
-        if (str[i] == '%' && i + 2 < len
-            && xdigitvalue(str[i + 1]) >= 0
-            && xdigitvalue(str[i + 2]) >= 0)
-            i += 2;
-        dlen++;
-    }
-    XALLOC0(s, dlen + 1);
+    size_t i, j;
 
+    s = arena_alloc(len + 1);
     for (i = j = 0; i < len; i++) {
         if (str[i] == '%' && i + 2 < len
             && xdigitvalue(str[i + 1]) >= 0
@@ -95,16 +172,84 @@ static char *url_decode(const char *str, size_t len)
             s[j] = str[i];
         j++;
     }
-    assert(j == dlen);
     s[j] = 0;
     return s;
 }
 
+/* FNV-1a hash */
+static unsigned long hash_name(const char *name)
+{
+    unsigned long h = 2166136261UL;
+
+    while (*name)
+        h = (h ^ (unsigned char) *name++) * 16777619UL;
+    return h;
+}
+
+static struct cgi_entry *find_entry(const char *name, unsigned long h)
+{
+    struct cgi_entry *e;
+
+    if (!table)
+        return NULL;
+    for (e = table[h & (n_buckets - 1)]; e; e = e->next)
+        if (e->hash == h && !strcmp(e->name, name))
+            return e;
+    return NULL;
+}
+
+/* Double the number of buckets in the hash table. */
+static void grow_table(void)
+{
+    struct cgi_entry **t, *e, *next;
+    size_t i, n = (n_buckets ? n_buckets * 2 : 64);
+
+    XALLOC0(t, n);
+    for (i = 0; i < n_buckets; i++) {
+        for (e = table[i]; e; e = next) {
+            next = e->next;
+            e->next = t[e->hash & (n - 1)];
+            t[e->hash & (n - 1)] = e;
+        }
+    }
+    free(table);
+    table = t;
+    n_buckets = n;
+}
+
+/* Append a value to the named parameter. */
+static void add_param(char *name, char *value)
+{
+    unsigned long h = hash_name(name);
+    struct cgi_entry *e = find_entry(name, h);
+    struct cgi_value *v;
+
+    if (!e) {
+        if (n_entries >= n_buckets)
+            grow_table();
+        e = arena_alloc(sizeof(struct cgi_entry));
+        e->name = name;
+        e->hash = h;
+        e->first = e->last = e->scan = NULL;
+        e->scanning = 0;
+        e->next = table[h & (n_buckets - 1)];
+        table[h & (n_buckets - 1)] = e;
+        n_entries++;
+    }
+    v = arena_alloc(sizeof(struct cgi_value));
+    v->value = value;
+    v->next = NULL;
+    if (e->last)
+        e->last->next = v;
+    else
+        e->first = v;
+    e->last = v;
+}
+
 static void parse_param(const char *str, size_t len)
 {
     const char *val;
-    size_t nlen, vlen, i, n;
-    char *nstr, *vstr;
+    size_t nlen, vlen;
 
     val = memchr(str, '=', len);
     if (val) {
@@ -119,83 +264,389 @@ static void parse_param(const char *str, size_t len)
         vlen = 0;
     }
 
-    nstr = url_decode(str, nlen);
-    vstr = url_decode(val, vlen);
+    add_param(url_decode(str, nlen), url_decode(val, vlen));
+}
 
-    for (i = 0; i < n_query_params; i++) {
-        if (!strcmp(query_params[i].name, nstr)) {
-            n = query_params[i].n_values;
-            XREALLOC(query_params[i].values, n + 1);
-            query_params[i].values[n] = vstr;
-            query_params[i].n_values++;
-            free(nstr);
-            return;
+/* Parse a string of URL-encoded parameters. */
+static void parse_urlencoded(const char *qstr, size_t qlen)
+{
+    const char *end = qstr + qlen;
+    size_t len;
+
+    while (qstr < end) {
+        for (len = 0; qstr + len < end && qstr[len] != '&'
+                 && qstr[len] != ';'; len++)
+            ;
+        if (len > 0)
+            parse_param(qstr, len);
+        qstr += len + 1;
+    }
+}
+
+/* A minimal JSON parser for POST bodies of the form
+       { "name": value, "name": [ value, value, ... ], ... }
+   where each value is a string, number, or boolean.  Each array element
+   becomes a separate value of the parameter, as if the parameter had been
+   repeated in a query string.  Nested objects and arrays, and nulls, are
+   skipped.  Parsing stops at the first syntax error. */
+
+static const char *json_p, *json_end;
+
+static void json_space(void)
+{
+    while (json_p < json_end && (*json_p == ' ' || *json_p == '\t'
+                                 || *json_p == '\n' || *json_p == '\r'))
+        json_p++;
+}
+
+/* Store a code point as UTF-8. */
+static char *put_utf8(char *s, unsigned long c)
+{
+    if (c < 0x80)
+        *s++ = c;
+    else if (c < 0x800) {
+        *s++ = 0xc0 | (c >> 6);
+        *s++ = 0x80 | (c & 0x3f);
+    }
+    else if (c < 0x10000) {
+        *s++ = 0xe0 | (c >> 12);
+        *s++ = 0x80 | ((c >> 6) & 0x3f);
+        *s++ = 0x80 | (c & 0x3f);
+    }
+    else {
+        *s++ = 0xf0 | (c >> 18);
+        *s++ = 0x80 | ((c >> 12) & 0x3f);
+        *s++ = 0x80 | ((c >> 6) & 0x3f);
+        *s++ = 0x80 | (c & 0x3f);
+    }
+    return s;
+}
+
+static int json_hex4(const char *p, unsigned long *c)
+{
+    int i, d;
+
+    if (json_end - p < 4)
+        return 0;
+    for (i = 0, *c = 0; i < 4; i++) {
+        if ((d = xdigitvalue(p[i])) < 0)
+            return 0;
+        *c = (*c << 4) | d;
+    }
+    return 1;
+}
+
+/* Parse a quoted string (json_p points to the opening quote). */
+static char *json_string(void)
+{
+    const char *q;
+    char *s, *t;
+    unsigned long c, c2;
+
+    for (q = json_p + 1; q < json_end && *q != '"'; q++)
+        if (*q == '\\')
+            q++;
+    if (q >= json_end)
+        return NULL;
+    /* no escape sequence expands to more bytes than it occupies */
+    s = t = arena_alloc(q - json_p);
+    for (json_p++; json_p < q; json_p++) {
+        if (*json_p != '\\') {
+            *t++ = *json_p;
+            continue;
+        }
+        switch (*++json_p) {
+        case 'b': *t++ = '\b'; break;
+        case 'f': *t++ = '\f'; break;
+        case 'n': *t++ = '\n'; break;
+        case 'r': *t++ = '\r'; break;
+        case 't': *t++ = '\t'; break;
+        case 'u':
+            if (!json_hex4(json_p + 1, &c))
+                return NULL;
+            json_p += 4;
+            if (c >= 0xd800 && c < 0xdc00 && json_p + 6 < q
+                && json_p[1] == '\\' && json_p[2] == 'u'
+                && json_hex4(json_p + 3, &c2)
+                && c2 >= 0xdc00 && c2 < 0xe000) {
+                c = 0x10000 + ((c - 0xd800) << 10) + (c2 - 0xdc00);
+                json_p += 6;
+            }
+            t = put_utf8(t, c);
+            break;
+        default: *t++ = *json_p; break;
+        }
+    }
+    *t = 0;
+    json_p = q + 1;
+    return s;
+}
+
+/* Parse a scalar value, returning it as a string, or skip a null, object,
+   or array (returning NULL). */
+static char *json_scalar(int *ok)
+{
+    const char *q = json_p;
+    char *s;
+    int depth = 0, quoted = 0;
+
+    *ok = 1;
+    if (json_p >= json_end) {
+        *ok = 0;
+        return NULL;
+    }
+    if (*json_p == '"') {
+        if (!(s = json_string()))
+            *ok = 0;
+        return s;
+    }
+    if (*json_p == '{' || *json_p == '[') {
+        for ( ; json_p < json_end; json_p++) {
+            if (quoted) {
+                if (*json_p == '\\')
+                    json_p++;
+                else if (*json_p == '"')
+                    quoted = 0;
+            }
+            else if (*json_p == '"')
+                quoted = 1;
+            else if (*json_p == '{' || *json_p == '[')
+                depth++;
+            else if ((*json_p == '}' || *json_p == ']') && --depth == 0) {
+                json_p++;
+                return NULL;
+            }
         }
+        *ok = 0;
+        return NULL;
     }
+    while (json_p < json_end && *json_p != ',' && *json_p != '}'
+           && *json_p != ']' && *json_p != ' ' && *json_p != '\t'
+           && *json_p != '\n' && *json_p != '\r')
+        json_p++;
+    if (json_p == q) {
+        *ok = 0;
+        return NULL;
+    }
+    if (json_p - q == 4 && !strncmp(q, "null", 4))
+        return NULL;
+    if (json_p - q == 4 && !strncmp(q, "true", 4))
+        q = "1";
+    else if (json_p - q == 5 && !strncmp(q, "false", 5))
+        q = "0";
+    else {
+        s = arena_alloc(json_p - q + 1);
+        memcpy(s, q, json_p - q);
+        s[json_p - q] = 0;
+        return s;
+    }
+    s = arena_alloc(2);
+    strcpy(s, q);
+    return s;
+}
 
-    i = n_query_params;
-    XREALLOC(query_params, i + 1);
-    query_params[i].name = nstr;
-    XALLOC0(query_params[i].values, 1);
-    query_params[i].values[0] = vstr;
-    query_params[i].n_values = 1;
-    query_params[i].scan_index = 0;
-    n_query_params++;
+static void parse_json(const char *str, size_t len)
+{
+    char *name, *value;
+    int ok;
+
+    json_p = str;
+    json_end = str + len;
+    json_space();
+    if (json_p >= json_end || *json_p++ != '{')
+        return;
+    for (;;) {
+        json_space();
+        if (json_p >= json_end || *json_p != '"' || !(name = json_string()))
+            return;
+        json_space();
+        if (json_p >= json_end || *json_p++ != ':')
+            return;
+        json_space();
+        if (json_p < json_end && *json_p == '[') {
+            json_p++;
+            json_space();
+            while (json_p < json_end && *json_p != ']') {
+                value = json_scalar(&ok);
+                if (!ok)
+                    return;
+                if (value)
+                    add_param(name, value);
+                json_space();
+                if (json_p < json_end && *json_p == ',') {
+                    json_p++;
+                    json_space();
+                }
+            }
+            json_p++;
+        }
+        else {
+            value = json_scalar(&ok);
+            if (!ok)
+                return;
+            if (value)
+                add_param(name, value);
+        }
+        json_space();
+        if (json_p >= json_end || *json_p++ != ',')
+            return;
+    }
 }
 
+/* Parse the query string and, for POST requests, the request body (which
+   may be either application/x-www-form-urlencoded or application/json). */
 void cgi_process_form(void)
 {
-    const char *qstr;
-    size_t len;
-
-    query_params = NULL;
-    n_query_params = 0;
+    const char *qstr, *ctype;
 
     qstr = getenv("QUERY_STRING");
-    if (!qstr)
-        return;
+    if (qstr)
+        parse_urlencoded(qstr, strlen(qstr));
 
-    while (*qstr) {
-        len = strcspn(qstr, ";&");
-        if (len > 0)
-            parse_param(qstr, len);
-        qstr += len;
-        if (*qstr)
-            qstr++;
-        else
-            break;
+    if (body) {
+        ctype = getenv("CONTENT_TYPE");
+        if (!ctype || !strncmp(ctype, "application/x-www-form-urlencoded",
+                               33))
+            parse_urlencoded(body, body_len);
+        else if (!strncmp(ctype, "application/json", 16))
+            parse_json(body, body_len);
     }
 }
 
 char *cgi_param(const char *name)
 {
-    size_t i;
-    for (i = 0; i < n_query_params; i++)
-        if (query_params && query_params[i].name
-            && !strcmp(name, query_params[i].name)
-            && query_params[i].values)
-            return query_params[i].values[0];
+    struct cgi_entry *e = find_entry(name, hash_name(name));
+
+    if (e && e->first)
+        return e->first->value;
     return NULL;
 }
 
+/* Return the next value of a multi-valued parameter, or NULL (after the
+   last value, in which case the next call starts again with the first). */
 char *cgi_param_multiple(const char *name)
 {
-    size_t i;
+    struct cgi_entry *e = find_entry(name, hash_name(name));
+    struct cgi_value *v;
 
-    for (i = 0; i < n_query_params; i++) {
-        if (query_params && query_params[i].name
-            && !strcmp(name, query_params[i].name)
-            && query_params[i].values) {
-            if (query_params[i].scan_index < query_params[i].n_values) {
-                query_params[i].scan_index++;
-                return query_params[i].values[query_params[i].scan_index - 1];
-            }
-            else {
-                query_params[i].scan_index = 0;
-                return NULL;
+    if (!e)
+        return NULL;
+    v = (e->scanning ? e->scan : e->first);
+    if (!v) {
+        e->scanning = 0;
+        return NULL;
+    }
+    e->scan = v->next;
+    e->scanning = 1;
+    return v->value;
+}
+
+/* Response output.  cgi_start_output() replaces stdout with a stream that
+   holds back the first CGI_HOLD_SIZE bytes of the response body, so that
+   headers whose values are not known until the response has been generated
+   (such as Server-Timing) can still be sent.  The headers are written when
+   the held output overflows, or by cgi_flush_output() or cgi_end_output(),
+   whichever comes first;  the headers() callback is called at that time to
+   add any extra header lines.  The hold buffer grows as needed, so that
+   small responses need only a small one. */
+
+static FILE *real_stdout;
+static const char *out_ctype;
+static void (*out_headers)(FILE *hfile);
+static char *hold;
+static size_t hold_len, hold_size, bytes_out;
+static int header_sent;
+
+static void send_header(void)
+{
+    fprintf(real_stdout, "Content-type: %s\r\n", out_ctype);
+    if (out_headers)
+        out_headers(real_stdout);
+    fprintf(real_stdout, "\r\n");
+    if (hold_len > 0)
+        fwrite(hold, 1, hold_len, real_stdout);
+    free(hold);
+    hold = NULL;
+    hold_len = hold_size = 0;
+    header_sent = 1;
+}
+
+static ssize_t response_write(void *cookie, const char *buf, size_t len)
+{
+    bytes_out += len;
+    if (!header_sent) {
+        if (hold_len + len <= CGI_HOLD_SIZE) {
+            if (hold_len + len > hold_size) {
+                size_t n = hold_size ? hold_size : 4096;
+                char *p;
+
+                while (n < hold_len + len)
+                    n *= 2;
+                if (n > CGI_HOLD_SIZE)
+                    n = CGI_HOLD_SIZE;
+                p = realloc(hold, n);
+                assert(p != NULL);
+                hold = p;
+                hold_size = n;
             }
+            memcpy(hold + hold_len, buf, len);
+            hold_len += len;
+            return len;
         }
+        send_header();
     }
+    /* Once the headers have been sent, whatever reaches this point (when
+       stdout's buffer fills or is flushed) goes to the client at once. */
+    if (fwrite(buf, 1, len, real_stdout) != len || fflush(real_stdout) != 0)
+        return -1;
+    return len;
+}
 
-    return NULL;
+void cgi_start_output(const char *content_type, void (*headers)(FILE *hfile))
+{
+    static cookie_io_functions_t io = { NULL, response_write, NULL, NULL };
+    FILE *f;
+
+    out_ctype = content_type;
+    out_headers = headers;
+    real_stdout = stdout;
+    if ((f = fopencookie(NULL, "w", io)) == NULL) {
+        send_header();	/* send the headers now and write stdout directly */
+        return;
+    }
+    stdout = f;
+}
+
+/* Send any output still held back (and the headers, if they have not been
+   sent), and restore the original stdout. */
+void cgi_end_output(void)
+{
+    if (!real_stdout)
+        return;
+    if (stdout != real_stdout) {
+        fclose(stdout);
+        stdout = real_stdout;
+    }
+    if (!header_sent)
+        send_header();
+    fflush(stdout);
+    real_stdout = NULL;
+}
+
+/* Send the headers (if they have not been sent) and all of the output so
+   far, without waiting for more.  This is used for streaming responses. */
+void cgi_flush_output(void)
+{
+    fflush(stdout);
+    if (!real_stdout)
+        return;
+    if (!header_sent)
+        send_header();
+    fflush(real_stdout);
+}
+
+/* Return the number of bytes of the response body written so far. */
+size_t cgi_bytes_out(void)
+{
+    return bytes_out;
 }
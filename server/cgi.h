@@ -20,10 +20,27 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #ifndef LIGHTWAVE_CGI_H
 #define LIGHTWAVE_CGI_H
 
+#include <stdio.h>
+
+/* Maximum size of a POST request body (larger bodies are ignored). */
+#ifndef CGI_MAX_BODY
+#define CGI_MAX_BODY (4 * 1024 * 1024)
+#endif
+
+/* Largest amount of output held back until the response headers are sent
+   (see cgi_start_output()). */
+#ifndef CGI_HOLD_SIZE
+#define CGI_HOLD_SIZE (64 * 1024)
+#endif
+
 void cgi_init(void);
 void cgi_end(void);
 void cgi_process_form(void);
 char *cgi_param(const char *name);
 char *cgi_param_multiple(const char *name);
+void cgi_start_output(const char *content_type, void (*headers)(FILE *hfile));
+void cgi_end_output(void);
+void cgi_flush_output(void);
+size_t cgi_bytes_out(void);
 
 #endif
@@ -0,0 +1,310 @@
+/* file: codec.c		18 October 2026
+
+Error-bounded compression of signals for the LightWAVE server
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+_______________________________________________________________________________
+
+When a fetch request includes maxerr=E, each signal is sent as a series of
+independently coded blocks of up to LW_CODE_MAXN samples, from which the
+client can reconstruct every sample to within E ADC units.  (E = 0 gives
+lossless compression.)  Each block is a bit string, most significant bit
+first, sent as a base64-encoded JSON string:
+
+    n       16 bits   number of samples in the block
+    e       16 bits   error bound (ADC units)
+    order    1 bit    0 for first-order prediction, 1 for second-order
+
+followed by groups of up to CODE_GROUP samples, each beginning with
+
+    k        4 bits   Rice parameter for the group
+
+followed by a code for each sample.  A sample is predicted from the
+reconstructed values of the previous one or two samples (as r1, or as
+2*r1 - r2), and the difference d between the sample and its prediction is
+quantized to q = sign(d) * floor((|d| + e) / (2e + 1)), so that the sample is
+reconstructed as the prediction plus q * (2e + 1), with an error of no more
+than e.  The quantized difference is mapped to u = 2q (if q >= 0) or -2q - 1
+(if q < 0), and sent as a Rice code:  u >> k one-bits, a zero-bit, and the
+low k bits of u.
+
+A code that begins with CODE_ESC one-bits is an escape, followed by the
+sample itself in 32 bits (two's complement).  Escapes are used for the first
+samples of a block (until enough have been seen to make a prediction), for
+samples that differ too much from their predictions, and for invalid samples
+(WFDB_INVALID_SAMPLE), which are not used in predictions.
+
+The encoder chooses the order of prediction for each block from the sums of
+the absolute first and second differences of its samples, and the Rice
+parameter for each group by trying each possible value.
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "codec.h"
+
+#ifndef WFDB_INVALID_SAMPLE	/* defined by WFDB 10.5.0 and later */
+#define WFDB_INVALID_SAMPLE (-32768)
+#endif
+
+#define CODE_GROUP	64	/* samples per Rice parameter */
+#define CODE_ESC	20	/* length of the unary prefix of an escape */
+#define CODE_MAXU	65535	/* larger values of u are escaped */
+#define CODE_MAXK	15	/* largest Rice parameter */
+
+struct bitwriter {
+    unsigned char *p;	/* next byte to be written */
+    uint64_t acc;	/* bits not yet written */
+    int nacc;		/* number of bits in acc */
+};
+
+/* Append the low nbits (no more than 32) bits of v. */
+static void put_bits(struct bitwriter *w, uint32_t v, int nbits)
+{
+    if (nbits < 32)
+        v &= (1UL << nbits) - 1;
+    w->acc = (w->acc << nbits) | v;
+    w->nacc += nbits;
+    while (w->nacc >= 8) {
+        w->nacc -= 8;
+        *w->p++ = (unsigned char)(w->acc >> w->nacc);
+    }
+}
+
+/* Append n one-bits. */
+static void put_ones(struct bitwriter *w, int n)
+{
+    for ( ; n > 16; n -= 16)
+        put_bits(w, 0xffff, 16);
+    put_bits(w, (1UL << n) - 1, n);
+}
+
+static void flush_bits(struct bitwriter *w)
+{
+    if (w->nacc > 0)
+        put_bits(w, 0, 8 - w->nacc);
+}
+
+/* Return the maximum length, in bytes, of a coded block of n samples. */
+size_t lw_code_size(long n)
+{
+    return (((size_t)n * (CODE_ESC + 32) + (n / CODE_GROUP + 1) * 4 + 33 + 7)
+            / 8);
+}
+
+/* Return the maximum length of the output of lw_code() for n samples. */
+size_t lw_code_bound(long n)
+{
+    return ((lw_code_size(n) + 2) / 3 * 4 + 2);
+}
+
+static const char b64[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/* Write nbytes bytes from in as a quoted base64 string, and return its
+   length. */
+static size_t put_base64(const unsigned char *in, size_t nbytes, char *out)
+{
+    char *q = out;
+    uint32_t v;
+
+    *q++ = '"';
+    for ( ; nbytes >= 3; nbytes -= 3, in += 3) {
+        v = ((uint32_t)in[0] << 16) | ((uint32_t)in[1] << 8) | in[2];
+        *q++ = b64[v >> 18];
+        *q++ = b64[(v >> 12) & 63];
+        *q++ = b64[(v >> 6) & 63];
+        *q++ = b64[v & 63];
+    }
+    if (nbytes > 0) {
+        v = (uint32_t)in[0] << 16;
+        if (nbytes > 1) v |= (uint32_t)in[1] << 8;
+        *q++ = b64[v >> 18];
+        *q++ = b64[(v >> 12) & 63];
+        *q++ = (nbytes > 1) ? b64[(v >> 6) & 63] : '=';
+        *q++ = '=';
+    }
+    *q++ = '"';
+    return (q - out);
+}
+
+/* Code n (no more than LW_CODE_MAXN) samples with an error bound of maxerr (no
+   more than LW_CODE_MAXERR), writing no more than lw_code_size(n) bytes to
+   out.  Set *err to the largest error in the reconstructed samples, and
+   return the number of bytes written. */
+size_t lw_code_block(const WFDB_Sample *samp, long n, int maxerr,
+                     unsigned char *out, int *err)
+{
+    struct bitwriter w;
+    long d, i, j, jmax, k, kbest, pred, q, r1 = 0, r2 = 0, step = 2L*maxerr + 1;
+    long long cost, best, sum1 = 0, sum2 = 0;
+    int esc[CODE_GROUP], nh = 0, order;
+    uint32_t u[CODE_GROUP], umax;
+
+    /* Choose the order of prediction. */
+    for (i = 2; i < n; i++)
+        if (samp[i] != WFDB_INVALID_SAMPLE &&
+            samp[i-1] != WFDB_INVALID_SAMPLE &&
+            samp[i-2] != WFDB_INVALID_SAMPLE) {
+            sum1 += labs((long)samp[i] - samp[i-1]);
+            sum2 += labs((long)samp[i] - 2L*samp[i-1] + samp[i-2]);
+        }
+    order = (sum2 < sum1) ? 2 : 1;
+
+    w.p = out;
+    w.acc = 0;
+    w.nacc = 0;
+    put_bits(&w, n, 16);
+    put_bits(&w, maxerr, 16);
+    put_bits(&w, order - 1, 1);
+    *err = 0;
+
+    for (i = 0; i < n; i += CODE_GROUP) {
+        jmax = (n - i < CODE_GROUP) ? n - i : CODE_GROUP;
+
+        /* Quantize the prediction errors of the group, and find the
+           reconstructed samples. */
+        for (j = 0, umax = 0; j < jmax; j++) {
+            long x = samp[i+j];
+
+            esc[j] = 1;
+            if (x == WFDB_INVALID_SAMPLE)
+                continue;	/* sent as is, and not used for prediction */
+            if (nh >= order) {
+                pred = (order == 1) ? r1 : 2*r1 - r2;
+                d = x - pred;
+                q = (d >= 0) ? (d + maxerr) / step : -((maxerr - d) / step);
+                if (q <= CODE_MAXU/2 && -q <= CODE_MAXU/2 + 1) {
+                    esc[j] = 0;
+                    u[j] = (q >= 0) ? 2*q : -2*q - 1;
+                    if (u[j] > umax) umax = u[j];
+                    x = pred + q * step;
+                    if (labs(samp[i+j] - x) > *err)
+                        *err = labs(samp[i+j] - x);
+                }
+            }
+            r2 = r1;
+            r1 = x;
+            if (nh < 2) nh++;
+        }
+
+        /* Choose the Rice parameter that gives the shortest codes. */
+        for (k = 0; k < CODE_MAXK && (umax >> k) >= CODE_ESC; k++)
+            ;
+        for (kbest = k, best = -1; k <= CODE_MAXK; k++) {
+            for (j = 0, cost = 0; j < jmax; j++)
+                if (!esc[j]) cost += (u[j] >> k) + 1 + k;
+            if (best < 0 || cost < best) {
+                best = cost;
+                kbest = k;
+            }
+        }
+
+        put_bits(&w, kbest, 4);
+        for (j = 0; j < jmax; j++) {
+            if (esc[j]) {
+                put_ones(&w, CODE_ESC);
+                put_bits(&w, (uint32_t)samp[i+j], 32);
+            }
+            else {
+                put_ones(&w, u[j] >> kbest);
+                put_bits(&w, 0, 1);
+                if (kbest > 0) put_bits(&w, u[j], kbest);
+            }
+        }
+    }
+    flush_bits(&w);
+    return (w.p - out);
+}
+
+/* As for lw_code_block(), but write a quoted base64 string of no more than
+   lw_code_bound(n) characters to out, and return its length. */
+size_t lw_code(const WFDB_Sample *samp, long n, int maxerr, char *out,
+               int *err)
+{
+    unsigned char *buf;
+    size_t len;
+
+    SUALLOC(buf, lw_code_size(n), 1);
+    len = put_base64(buf, lw_code_block(samp, n, maxerr, buf, err), out);
+    SFREE(buf);
+    return (len);
+}
+
+struct bitreader {
+    const unsigned char *p, *end;	/* next byte, and end of input */
+    uint64_t acc;	/* bits not yet consumed */
+    int nacc;		/* number of bits in acc */
+};
+
+/* Return the next nbits (no more than 32) bits, or -1 at the end of the
+   input. */
+static int64_t get_bits(struct bitreader *r, int nbits)
+{
+    while (r->nacc < nbits) {
+        if (r->p >= r->end)
+            return (-1);
+        r->acc = (r->acc << 8) | *r->p++;
+        r->nacc += 8;
+    }
+    r->nacc -= nbits;
+    return ((r->acc >> r->nacc) & ((1ULL << nbits) - 1));
+}
+
+/* Decode a block of len bytes produced by lw_code_block(), writing no more
+   than nmax samples to out.  Return the number of samples in the block, or -1
+   if the block is malformed or has more than nmax samples. */
+long lw_decode_block(const unsigned char *in, size_t len, WFDB_Sample *out,
+                     long nmax)
+{
+    struct bitreader r;
+    int64_t b, k = 0, n, order, step, u, x, r1 = 0, r2 = 0;
+    long i, nh = 0;
+
+    r.p = in;
+    r.end = in + len;
+    r.acc = 0;
+    r.nacc = 0;
+    if ((n = get_bits(&r, 16)) < 0 || n > nmax ||
+        (step = get_bits(&r, 16)) < 0 || (order = get_bits(&r, 1)) < 0)
+        return (-1);
+    step = 2*step + 1;
+    order++;
+    for (i = 0; i < n; i++) {
+        if (i % CODE_GROUP == 0 && (k = get_bits(&r, 4)) < 0)
+            return (-1);
+        for (u = 0; u < CODE_ESC && (b = get_bits(&r, 1)) == 1; u++)
+            ;
+        if (u == CODE_ESC) {
+            if ((x = get_bits(&r, 32)) < 0)
+                return (-1);
+            out[i] = (int32_t)(uint32_t)x;
+            if (out[i] == WFDB_INVALID_SAMPLE)
+                continue;
+            x = out[i];
+        }
+        else {
+            if (b < 0 || (b = get_bits(&r, k)) < 0 || nh < order)
+                return (-1);
+            u = (u << k) | b;
+            x = ((order == 1) ? r1 : 2*r1 - r2)
+                + ((u & 1) ? -(u + 1) / 2 : u / 2) * step;
+            out[i] = x;
+        }
+        r2 = r1;
+        r1 = x;
+        nh++;
+    }
+    return (n);
+}
@@ -0,0 +1,40 @@
+/* file: codec.h		18 October 2026
+
+Error-bounded compression of signals for the LightWAVE server
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LIGHTWAVE_CODEC_H
+#define LIGHTWAVE_CODEC_H
+
+#include <stddef.h>
+#include <wfdb/wfdb.h>
+
+/* Largest number of samples in a coded block (see codec.c). */
+#define LW_CODE_MAXN	65535
+
+/* Largest error bound, in ADC units. */
+#define LW_CODE_MAXERR	32767
+
+size_t lw_code_size(long n);
+size_t lw_code_bound(long n);
+size_t lw_code_block(const WFDB_Sample *samp, long n, int maxerr,
+                     unsigned char *out, int *err);
+long lw_decode_block(const unsigned char *in, size_t len, WFDB_Sample *out,
+                     long nmax);
+size_t lw_code(const WFDB_Sample *samp, long n, int maxerr, char *out,
+               int *err);
+
+#endif
@@ -0,0 +1,430 @@
+/* file: editlog.c		18 October 2026
+
+LightWAVE edit logs and journals
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+_______________________________________________________________________________
+
+An edit log (see client/doc/edit-log.html) records the annotations inserted
+and deleted by a LightWAVE user, one entry per line.  patchann applies edit
+logs to annotation files.  The LightWAVE scribe can also append the entries
+it receives to a shared journal for each record and annotator, which the
+LightWAVE server merges with the annotation file when annotations are fetched,
+so that the edits are visible to everyone without rewriting the annotation
+file.  'patchann -m' folds a journal into its annotation file.
+
+The functions in this file read and parse edit log entries, and merge them
+with the annotations read from an annotation file in a single pass.  To apply
+the same edits in the same way as patchann's in-memory annotation array, the
+merge collects all of the annotations that have the same sort key (time, chan,
+and num) in a group.  Annotations read from the file precede those read
+earlier within the group, and insertions are placed at the beginning of the
+group;  a deletion removes the last exact match in the group.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <wfdb/ecgcodes.h>
+#include "editlog.h"
+
+/* Return the sort key of an annotation, which is the concatenation of its
+   time, chan, and num fields. */
+long long lw_edit_key(const WFDB_Annotation *annot)
+{
+    return (((long long)annot->time << 16) |
+            ((annot->chan & 255) << 8) | ((annot->num + 128) & 255));
+}
+
+/* Return the value of a string of decimal digits, or -1 if it is empty or
+   too large. */
+static WFDB_Time digits(char *q)
+{
+    WFDB_Time t = 0;
+
+    if (*q == '\0')
+        return (-1);
+    for ( ; *q; q++) {
+        if (t > (LONG_MAX - 9) / 10)
+            return (-1);
+        t = 10 * t + (*q - '0');
+    }
+    return (t);
+}
+
+/* Parse an edit log entry (text, including its line ending), and set the
+   fields of annot from it.  Return LW_EDIT_INSERT or LW_EDIT_DELETE, or -1 if
+   the entry can't be parsed.  If the annotation has an aux string, it is
+   allocated, and the caller must free it. */
+int lw_edit_parse(const char *text, WFDB_Annotation *annot)
+{
+    char p[LW_EDIT_MAXLEN], *q;
+    int edittype, i, j, len;
+    WFDB_Time ti, tf;
+
+    /* Fill in the default fields of annot. */
+    annot->anntyp = NORMAL;
+    annot->subtyp = annot->chan = annot->num = 0;
+    annot->aux = NULL;
+
+    /* Copy the entry to p and replace the line ending with a null (text will
+       not be modified below). */
+    len = strlen(text);
+    if (len == 0 || len >= sizeof(p))
+        return (-1);
+    memcpy(p, text, len + 1);
+    if (p[len - 1] == '\n') {
+        if (len > 1 && p[len - 2] == '\r') p[len - 2] = '\0';
+        else p[len - 1] = '\0';
+    }
+
+    /* Identify the action associated with this log entry. */
+    if (text[0] == '-') { edittype = LW_EDIT_DELETE; i = 1; }
+    else { edittype = LW_EDIT_INSERT; i = 0; }
+
+    /* Parse the rest of the entry to fill in the time and any non-default
+       fields of annot. */
+
+    /* find and isolate digits */
+    q = p + i;
+    for ( ; p[i]; i++)
+        if (p[i] < '0' || p[i] > '9') break;
+    p[i] = '\0';
+    if ((ti = digits(q)) < 0) return (-1);
+    annot->time = ti;
+
+    /* is there anything else on this line? */
+    if (text[i] == '\r' || text[i] == '\n')
+        return (edittype);	/* nothing more to parse */
+
+    else if (text[i] != ',' && text[i] != '-') return (-1);
+        /* something else is there but it can't be parsed */
+
+    else if (text[i] == '-') {
+        /* it looks like tf is there */
+        q = p + i + 1;
+        for (++i; p[i]; i++)
+            if (p[i] < '0' || p[i] > '9') break;
+        p[i] = '\0';
+        if ((tf = digits(q)) < ti) return (-1);
+
+        /* no support for tf in the WFDB library yet; warn, but continue
+           parsing the rest of this log entry */
+        fprintf(stderr, "(warning): no support for tf at %ld",
+                (long)annot->time);
+
+        if (text[i] == '\r' || text[i] == '\n')
+            return (edittype);	/* nothing more to parse */
+    }
+
+    /* next should be anntype */
+    q = p + i + 1;
+    /* look for end of anntype, but skip the first character since it
+       might be '{' or ',' if a non-standard type was defined */
+    for (i += 2; p[i] && p[i] != ',' && p[i] != '{'; i++)
+        ;
+    p[i] = '\0';
+    annot->anntyp = strann(q);
+    if (annot->anntyp == NOTQRS) {
+        /* unrecognized type string: set anntyp to NOTE, copy string to aux */
+        annot->anntyp = NOTE;
+        *(q-1) = strlen(q);	/* aux strings have byte count prefix */
+        SALLOC(annot->aux, strlen(q-1) + 1, 1);
+        strcpy((char *)annot->aux, q-1);
+    }
+
+    /* is (subtype/chan/num) present? */
+    if (text[i] == '{') {
+        for (j = ++i; p[j] && p[j] != '/'; j++)
+            ;
+        if (p[j] != '/') goto bad;
+        if (j > i) { p[j] = '\0'; annot->subtyp = atoi(p+i); }
+        i = j + 1;
+
+        for (j = i; p[j] && p[j] != '/'; j++)
+            ;
+        if (p[j] != '/') goto bad;
+        if (j > i) { p[j] = '\0'; annot->chan = atoi(p+i); }
+        i = j + 1;
+
+        for (j = i; p[j] && p[j] != '}'; j++)
+            ;
+        if (p[j] != '}') goto bad;
+        if (j > i) { p[j] = '\0'; annot->num = atoi(p+i); }
+        i = j + 1;
+    }
+
+    /* is aux present? */
+    if (text[i] == ',') {
+        if (annot->aux) {  /* true if type was unrecognized, see above */
+            unsigned char *s = annot->aux + strlen((char *)annot->aux) - 1;
+            p[i--] = ':';   /* prefix user-specified aux with type and colon */
+            while (s > annot->aux)
+                p[i--] = *s--; /* safe (annot->aux is a substring of p[0..i]) */
+        }
+        len = strlen(p+i+1);
+        if (len > 255) {  /* check length and truncate if necessary */
+            fprintf(stderr, "(warning): aux will be truncated at %ld",
+                    (long)annot->time);
+            len = 255;
+            p[i+len+1] = '\0';
+        }
+        p[i] = len;	/* aux strings have byte count prefix */
+        SALLOC(annot->aux, strlen(p+i) + 1, 1);
+        strcpy((char *)annot->aux, p+i);
+    }
+
+    return (edittype);
+
+  bad:
+    SFREE(annot->aux);
+    return (-1);
+}
+
+/* Set the fields of e (except seq) from annot. */
+static void set_edit(struct lw_edit *e, const WFDB_Annotation *annot, int type)
+{
+    e->key = lw_edit_key(annot);
+    e->type = type;
+    e->anntyp = annot->anntyp;
+    e->subtyp = annot->subtyp;
+    e->aux = NULL;
+    if (annot->aux && *(annot->aux))
+        SSTRCPY(e->aux, (char *)annot->aux);
+}
+
+/* Make room for at least one more entry in ed. */
+static void grow(struct lw_edits *ed)
+{
+    if (ed->n >= ed->size) {
+        ed->size = ed->size ? 2 * ed->size : 1024;
+        SREALLOC(ed->e, ed->size, sizeof(struct lw_edit));
+    }
+}
+
+/* Read the rest of an edit log in one block, and append its insertions and
+   deletions (after the first nskip entries) to ed.  Return the total number
+   of entries in ed. */
+long lw_edits_read(struct lw_edits *ed, FILE *ifile, long nskip)
+{
+    char *buf = NULL, *line, *end, *q, text[LW_EDIT_MAXLEN];
+    int type;
+    size_t len = 0, n, size = 0;
+    WFDB_Annotation annot;
+
+    for (;;) {
+        if (size - len < 65536) {
+            size = size ? 2 * size : 262144;
+            SREALLOC(buf, size, 1);
+        }
+        if ((n = fread(buf + len, 1, size - len, ifile)) == 0)
+            break;
+        len += n;
+    }
+
+    /* Split the log into lines exactly as fgets(text, sizeof(text), ...)
+       would, so that a line too long for text counts as more than one
+       entry, skip the entries that have been applied already, and parse the
+       rest. */
+    for (line = buf, end = buf + len; line < end; line += n) {
+        if ((q = memchr(line, '\n', end - line)) != NULL)
+            n = q - line + 1;
+        else
+            n = end - line;
+        if (n > sizeof(text) - 1)
+            n = sizeof(text) - 1;
+        if (nskip > 0) {
+            nskip--;
+            continue;
+        }
+        memcpy(text, line, n);
+        text[n] = '\0';
+        if ((type = lw_edit_parse(text, &annot)) > 0) {
+            grow(ed);
+            set_edit(&ed->e[ed->n], &annot, type);
+            ed->e[ed->n].seq = ed->n;
+            ed->n++;
+        }
+        SFREE(annot.aux);
+    }
+    SFREE(buf);
+    return (ed->n);
+}
+
+/* Comparison function for sorting edits by key, and then by their order in
+   the log. */
+static int compare_edits(const void *a, const void *b)
+{
+    const struct lw_edit *x = a, *y = b;
+
+    if (x->key != y->key)
+        return ((x->key < y->key) ? -1 : 1);
+    return ((x->seq > y->seq) - (x->seq < y->seq));
+}
+
+void lw_edits_sort(struct lw_edits *ed)
+{
+    if (ed->n > 1)
+        qsort(ed->e, ed->n, sizeof(struct lw_edit), compare_edits);
+}
+
+void lw_edits_free(struct lw_edits *ed)
+{
+    long i;
+
+    for (i = 0; i < ed->n; i++)
+        SFREE(ed->e[i].aux);
+    SFREE(ed->e);
+    ed->n = ed->size = 0;
+}
+
+/* Set the fields of annot from e.  annot->aux points to e->aux. */
+void lw_edit_annot(const struct lw_edit *e, WFDB_Annotation *annot)
+{
+    annot->time = e->key >> 16;
+    annot->chan = (e->key >> 8) & 255;
+    annot->num = (e->key & 255) - 128;
+    annot->anntyp = e->anntyp;
+    annot->subtyp = e->subtyp;
+    annot->aux = (unsigned char *)e->aux;
+}
+
+/* Return nonzero if e is an exact match for a (apart from its type). */
+static int match_edit(const struct lw_edit *e, const struct lw_edit *a)
+{
+    return (e->key == a->key && e->anntyp == a->anntyp &&
+            e->subtyp == a->subtyp &&
+            ((!e->aux && !a->aux) ||
+             (e->aux && a->aux && strcmp(e->aux, a->aux) == 0)));
+}
+
+/* Read the next input annotation into m->nextann. */
+static void read_input(struct lw_merge *m)
+{
+    WFDB_Annotation annot;
+
+    if (m->more && (m->more = (getann(m->an, &annot) == 0)))
+        set_edit(&m->nextann, &annot, LW_EDIT_INSERT);
+}
+
+/* Prepare to merge the edits in ed (sorted by lw_edits_sort()) with the
+   annotations read from input annotator an (if have_input is nonzero).  Edits
+   and annotations with sort keys less than kmin are skipped. */
+void lw_merge_start(struct lw_merge *m, struct lw_edits *ed, int have_input,
+                    WFDB_Annotator an, long long kmin)
+{
+    long lo = 0, hi = ed->n, mid;
+
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (ed->e[mid].key < kmin) lo = mid + 1;
+        else hi = mid;
+    }
+    m->ed = ed;
+    m->next = lo;
+    m->an = an;
+    m->more = have_input;
+    memset(&m->group, 0, sizeof(m->group));
+    m->gpos = 0;
+    read_input(m);
+    while (m->more && m->nextann.key < kmin) {
+        SFREE(m->nextann.aux);
+        read_input(m);
+    }
+}
+
+/* Collect the input annotations with sort key k in m->group, and apply the
+   edits for k to them.  Return 0, or -2 if the input is out of order. */
+static int merge_group(struct lw_merge *m, long long k)
+{
+    struct lw_edits *g = &m->group;
+    struct lw_edit *e, tmp;
+    long i;
+
+    while (m->more && m->nextann.key == k) {
+        grow(g);
+        g->e[g->n++] = m->nextann;
+        read_input(m);
+        if (m->more && m->nextann.key < k) {
+            SFREE(m->nextann.aux);
+            m->more = 0;
+            return (-2);
+        }
+    }
+    for (i = 0; i < g->n / 2; i++) {
+        tmp = g->e[i];
+        g->e[i] = g->e[g->n - 1 - i];
+        g->e[g->n - 1 - i] = tmp;
+    }
+
+    for ( ; m->next < m->ed->n && (e = &m->ed->e[m->next])->key == k;
+          m->next++) {
+        if (e->type == LW_EDIT_INSERT) {
+            grow(g);
+            memmove(g->e + 1, g->e, g->n * sizeof(struct lw_edit));
+            g->n++;
+            g->e[0] = *e;
+            g->e[0].aux = NULL;
+            if (e->aux)
+                SSTRCPY(g->e[0].aux, e->aux);
+        }
+        else {
+            for (i = g->n - 1; i >= 0; i--)
+                if (match_edit(e, &g->e[i])) break;
+            if (i >= 0) {
+                SFREE(g->e[i].aux);
+                memmove(g->e + i, g->e + i + 1,
+                        (g->n - i - 1) * sizeof(struct lw_edit));
+                g->n--;
+            }
+        }
+    }
+    return (0);
+}
+
+/* Set annot to the next annotation that results from the merge, in canonical
+   order.  annot->aux remains valid until the next call.  Return 0 if
+   successful, -1 if there are no more annotations, or -2 if the input
+   annotations are not in canonical order. */
+int lw_merge_next(struct lw_merge *m, WFDB_Annotation *annot)
+{
+    struct lw_edits *g = &m->group;
+    long long k;
+    long i;
+
+    while (m->gpos >= g->n) {
+        for (i = 0; i < g->n; i++)
+            SFREE(g->e[i].aux);
+        g->n = m->gpos = 0;
+        if (!m->more && m->next >= m->ed->n)
+            return (-1);
+        if (m->more && (m->next >= m->ed->n ||
+                        m->nextann.key <= m->ed->e[m->next].key))
+            k = m->nextann.key;
+        else
+            k = m->ed->e[m->next].key;
+        if (merge_group(m, k) < 0)
+            return (-2);
+    }
+    lw_edit_annot(&g->e[m->gpos++], annot);
+    return (0);
+}
+
+void lw_merge_end(struct lw_merge *m)
+{
+    if (m->more)
+        SFREE(m->nextann.aux);
+    m->more = 0;
+    lw_edits_free(&m->group);
+}
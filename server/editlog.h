@@ -0,0 +1,72 @@
+/* file: editlog.h		18 October 2026
+
+LightWAVE edit logs and journals
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LIGHTWAVE_EDITLOG_H
+#define LIGHTWAVE_EDITLOG_H
+
+#include <stdio.h>
+#include <wfdb/wfdb.h>
+
+/* The journal for annotator ANN of record REC is REC.ANN.jnl, in the same
+   directory as the record's header file. */
+#define LW_JOURNAL_SUFFIX ".jnl"
+
+/* Maximum length of an edit log entry, including its line ending. */
+#define LW_EDIT_MAXLEN 500
+
+/* Edit types, as returned by lw_edit_parse(). */
+#define LW_EDIT_INSERT 1
+#define LW_EDIT_DELETE 2
+
+struct lw_edit {
+    long long key;	/* sort key (see lw_edit_key()) */
+    long seq;		/* position of the entry in the log */
+    int type;		/* LW_EDIT_INSERT or LW_EDIT_DELETE */
+    int anntyp;		/* annotation type, as in WFDB_Annotation */
+    char subtyp;	/* annotation subtype, as in WFDB_Annotation */
+    char *aux;		/* aux string (with byte count prefix), or NULL */
+};
+
+struct lw_edits {
+    struct lw_edit *e;	/* entries */
+    long n, size;	/* number of entries, number allocated */
+};
+
+/* State of a merge of edits with an annotation file (see lw_merge_next()). */
+struct lw_merge {
+    struct lw_edits *ed;	/* edits, sorted by lw_edits_sort() */
+    long next;			/* index of the next edit to be merged */
+    WFDB_Annotator an;		/* input annotator */
+    int more;			/* nonzero if input annotations remain */
+    struct lw_edit nextann;	/* next input annotation */
+    struct lw_edits group;	/* annotations with the current sort key */
+    long gpos;			/* index of the next annotation in group */
+};
+
+long long lw_edit_key(const WFDB_Annotation *annot);
+int lw_edit_parse(const char *text, WFDB_Annotation *annot);
+long lw_edits_read(struct lw_edits *ed, FILE *ifile, long nskip);
+void lw_edits_sort(struct lw_edits *ed);
+void lw_edits_free(struct lw_edits *ed);
+void lw_edit_annot(const struct lw_edit *e, WFDB_Annotation *annot);
+void lw_merge_start(struct lw_merge *m, struct lw_edits *ed, int have_input,
+                    WFDB_Annotator an, long long kmin);
+int lw_merge_next(struct lw_merge *m, WFDB_Annotation *annot);
+void lw_merge_end(struct lw_merge *m);
+
+#endif
@@ -0,0 +1,163 @@
+/* file: emit.c			18 October 2026
+
+Buffered output for the LightWAVE server
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+_______________________________________________________________________________
+
+The functions in this file write to a private buffer that is copied to stdout
+in large blocks, avoiding the per-call overhead of printf for output that
+consists of many small pieces (such as annotations and samples).  Integers
+are formatted two digits at a time, and strings are escaped for JSON as they
+are copied, without allocating memory.
+*/
+
+#include <stdio.h>
+#include "emit.h"
+
+char out_buf[OUT_BUFSIZE];
+size_t out_len;
+
+void out_flush(void)
+{
+    if (out_len > 0) {
+        fwrite(out_buf, 1, out_len, stdout);
+        out_len = 0;
+    }
+}
+
+void out_write(const char *s, size_t n)
+{
+    size_t m;
+
+    while (n > OUT_BUFSIZE - out_len) {
+        m = OUT_BUFSIZE - out_len;
+        memcpy(out_buf + out_len, s, m);
+        out_len += m;
+        s += m;
+        n -= m;
+        out_flush();
+    }
+    memcpy(out_buf + out_len, s, n);
+    out_len += n;
+}
+
+static const char digit_pairs[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+/* Write a decimal integer (equivalent to printf("%ld", v)). */
+void out_long(long v)
+{
+    if (OUT_BUFSIZE - out_len < OUT_LONGMAX)
+        out_flush();
+    out_len += lw_fmt_long(out_buf + out_len, v);
+}
+
+/* Format a decimal integer at dst, which must have room for OUT_LONGMAX
+   characters, and return its length.  Unlike the out_* functions, this can
+   be used by any thread. */
+size_t lw_fmt_long(char *dst, long v)
+{
+    char tmp[OUT_LONGMAX], *p = tmp + sizeof(tmp);
+    unsigned long u = (v < 0 ? -(unsigned long)v : (unsigned long)v);
+
+    while (u >= 100) {
+        p -= 2;
+        memcpy(p, digit_pairs + 2 * (u % 100), 2);
+        u /= 100;
+    }
+    if (u >= 10) {
+        p -= 2;
+        memcpy(p, digit_pairs + 2 * u, 2);
+    }
+    else
+        *--p = '0' + u;
+    if (v < 0)
+        *--p = '-';
+    memcpy(dst, p, tmp + sizeof(tmp) - p);
+    return (tmp + sizeof(tmp) - p);
+}
+
+/* Return the length of a UTF-8 character in bytes, or 0 if the input
+   is not valid UTF-8. */
+int lw_utf8_char_len(const char *s)
+{
+    unsigned int c = (unsigned char) s[0], n = 0, i;
+    static const unsigned int min[] = { 0x80, 0x800, 0x10000 };
+
+    if (c < 0x80)
+        return 1;
+    while (c & (0x80 >> n))
+        n++;
+    if (n < 2 || n > 4)
+        return 0;
+    c &= (0x7f >> n);
+    for (i = 1; i < n; i++) {
+        if (((unsigned char) s[i] & 0xc0) != 0x80)
+            return 0;
+        c = (c << 6) | ((unsigned char) s[i] & 0x3f);
+    }
+    if (c < min[n - 2] || c > 0x10ffff || (c & ~0x7ff) == 0xd800)
+        return 0;
+    return n;
+}
+
+/* Write a string as a JSON quoted string, with the same conversions as
+   strjson() (control characters become spaces, and bytes that are not part
+   of valid UTF-8 characters become question marks). */
+void out_json(const char *s)
+{
+    const char *run;
+    int n;
+
+    out_char('"');
+    for (run = s; *s; ) {
+        unsigned char c = *s;
+
+        if (c >= 0x20 && c < 0x80 && c != '"' && c != '\\') {
+            s++;
+            continue;
+        }
+        out_write(run, s - run);
+        if (c == '"' || c == '\\') {
+            out_char('\\');
+            out_char(c);
+            s++;
+        }
+        else if (c < 0x20) {
+            out_char(' ');
+            s++;
+        }
+        else if ((n = lw_utf8_char_len(s)) == 0) {
+            out_char('?');
+            s++;
+        }
+        else {
+            out_write(s, n);
+            s += n;
+        }
+        run = s;
+    }
+    out_write(run, s - run);
+    out_char('"');
+}
@@ -0,0 +1,54 @@
+/* file: emit.h			18 October 2026
+
+Buffered output for the LightWAVE server
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LIGHTWAVE_EMIT_H
+#define LIGHTWAVE_EMIT_H
+
+#include <stddef.h>
+#include <string.h>
+
+/* Size of the output buffer.  out_flush() must be called before anything
+   else is written to stdout (using printf, for example). */
+#define OUT_BUFSIZE 65536
+
+/* Longest output of a single out_long() call, including a sign. */
+#define OUT_LONGMAX 21
+
+extern char out_buf[OUT_BUFSIZE];
+extern size_t out_len;
+
+void out_flush(void);
+void out_write(const char *s, size_t n);
+void out_long(long v);
+size_t lw_fmt_long(char *dst, long v);
+void out_json(const char *s);
+int lw_utf8_char_len(const char *s);
+
+static inline void out_char(char c)
+{
+    if (out_len >= OUT_BUFSIZE)
+        out_flush();
+    out_buf[out_len++] = c;
+}
+
+static inline void out_str(const char *s)
+{
+    out_write(s, strlen(s));
+}
+
+#endif
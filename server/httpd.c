@@ -0,0 +1,1030 @@
+/* file: httpd.c		18 October 2026
+
+Standalone HTTP server mode for the LightWAVE server
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+_______________________________________________________________________________
+
+The LightWAVE server normally runs as a CGI application of a web server such
+as Apache (see lw-apache.conf), which also serves the client.  For small
+installations, and for benchmarking without a web server, it can instead
+serve both itself:
+
+    lightwave -s [ADDRESS:]PORT [NWORKERS]
+
+listens for HTTP connections on PORT of ADDRESS (by default, 127.0.0.1; use
+0.0.0.0 or [::] to accept connections from other hosts).  Requests for
+LW_HTTPD_SERVER are handled as the CGI application would handle them, and
+requests for files under LW_HTTPD_CLIENT are answered from the installed
+client (LWDIR, or $LIGHTWAVE_CLIENT if it is set, for example to the 'client'
+directory of the sources).  A line in Common Log Format is written to the
+standard output for each request.
+
+A single process handles all connections with an epoll event loop.  It
+supports HTTP/1.1 persistent connections and pipelining (the requests on a
+connection are answered in order), and sends files with sendfile().  Since
+the WFDB library is not reentrant, and the request handlers in lightwave.c
+keep their state in global variables, each LW_HTTPD_SERVER request is
+handled in a child process forked for it, just as a web server would run
+the CGI application.  lightwave_httpd() returns in the child, with the CGI
+environment set up, the request body as its standard input, and a pipe to
+the event loop as its standard output;  main() then handles the request as
+usual.  No more than NWORKERS (by default, LW_HTTPD_NWORKERS) children run
+at once, and other requests wait in order of arrival until one of them
+exits.  The event loop relays each child's output to its client, replacing
+the CGI response headers with HTTP headers and chunked transfer encoding.
+
+In sandboxed-lightwave, the event loop runs with the effective user ID of
+the user who started it, and each child sets up the sandbox as a CGI process
+does (see sandbox.c).  Responses are not compressed, and the scribe
+(lw-scribe) is not served.
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/sendfile.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "cgi.h"
+#include "httpd.h"
+
+#ifndef LWDIR
+#define LWDIR "/home/physionet/html/lightwave"
+#endif
+
+#ifndef LWVER
+#define LWVER "unknown"
+#endif
+
+/* Largest request header, in bytes. */
+#define LW_HTTPD_MAXHEAD 16384
+
+/* Largest CGI response header, in bytes. */
+#define LW_HTTPD_MAXCGIHEAD 8192
+
+/* Bytes read from a child's output at a time. */
+#define LW_HTTPD_BUFSIZE 65536
+
+/* Seconds that an idle connection is kept open. */
+#define LW_HTTPD_TIMEOUT 30
+
+/* Connection states. */
+#define C_READ	0	/* waiting for a complete request */
+#define C_WAIT	1	/* waiting for a child to handle the request */
+#define C_CHILD	2	/* relaying the output of a child */
+#define C_SEND	3	/* sending the rest of the response */
+
+struct conn {
+    int fd;		/* client socket */
+    int state;		/* one of the above */
+    int keepalive;	/* nonzero if the connection is to be kept open */
+    char addr[INET6_ADDRSTRLEN];
+    time_t last;	/* time of the last activity */
+
+    /* The current request, and any pipelined requests after it. */
+    char *in;
+    size_t inlen, insize;
+    size_t hlen;	/* length of its header, once it has been parsed */
+    size_t reqlen;	/* length of the request, once it is complete */
+    char *method, *path, *query, *ctype, *body, *reqline;
+    size_t clen;	/* length of the request body */
+    int minor;		/* HTTP/1.minor */
+    int continued;	/* nonzero if "100 Continue" has been sent */
+
+    /* The response. */
+    char *out;
+    size_t outlen, outpos, outsize;
+    int file;		/* file being sent, or -1 */
+    off_t foff, fend;
+    int pipe;		/* output of the child handling the request, or -1 */
+    int chunked;	/* nonzero if the body is sent in chunks */
+    int head;		/* nonzero for a HEAD request (no body is sent) */
+    char *cgihead;	/* CGI response header, until it is complete */
+    size_t cgilen;
+    int status;
+    long long sent;	/* bytes of the body sent */
+    unsigned events, pevents;	/* events watched on fd and pipe */
+
+    struct conn *next;	/* next connection waiting for a child */
+};
+
+static char *clientdir;
+static int epfd, lsock, sigfd, nbusy, nworkers;
+static long nfd;
+static struct conn **table;	/* connections, indexed by socket and pipe */
+static struct conn *waithead, *waittail;
+static sigset_t oldmask;
+
+static void fail(const char *msg)
+{
+    perror(msg);
+    exit(1);
+}
+
+static void *xrealloc(void *p, size_t n)
+{
+    if ((p = realloc(p, n)) == NULL)
+        fail("lightwave");
+    return (p);
+}
+
+static void watch(int fd, int op, unsigned events)
+{
+    struct epoll_event ev;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = events;
+    ev.data.fd = fd;
+    epoll_ctl(epfd, op, fd, &ev);
+}
+
+/* Watch for the events that c is waiting for in its current state. */
+static void update(struct conn *c)
+{
+    int pending = (c->outpos < c->outlen || c->file >= 0);
+    unsigned events = 0, pevents = 0;
+
+    if (pending || c->state == C_SEND)
+        events = EPOLLOUT;
+    else if (c->state == C_READ)
+        events = EPOLLIN;
+    if (events != c->events)
+        watch(c->fd, EPOLL_CTL_MOD, c->events = events);
+
+    /* The output of a child is not read while the client is not keeping up
+       with it.  The pipe is removed from the epoll set meanwhile, since its
+       EPOLLHUP (when the child exits) cannot be masked. */
+    if (c->pipe >= 0 && (pevents = pending ? 0 : EPOLLIN) != c->pevents)
+        watch(c->pipe, (c->pevents = pevents) ? EPOLL_CTL_ADD : EPOLL_CTL_DEL,
+              pevents);
+}
+
+static const char *reason(int status)
+{
+    switch (status) {
+      case 100: return ("Continue");
+      case 200: return ("OK");
+      case 302: return ("Found");
+      case 400: return ("Bad Request");
+      case 403: return ("Forbidden");
+      case 404: return ("Not Found");
+      case 405: return ("Method Not Allowed");
+      case 413: return ("Payload Too Large");
+      case 431: return ("Request Header Fields Too Large");
+      case 501: return ("Not Implemented");
+      case 502: return ("Bad Gateway");
+      case 503: return ("Service Unavailable");
+      default:  return ("Unknown");
+    }
+}
+
+static const char *mime_type(const char *path)
+{
+    static const struct { const char *ext, *type; } types[] = {
+        { "html", "text/html; charset=utf-8" },
+        { "htm",  "text/html; charset=utf-8" },
+        { "css",  "text/css" },
+        { "js",   "application/javascript; charset=utf-8" },
+        { "json", "application/json" },
+        { "txt",  "text/plain; charset=utf-8" },
+        { "svg",  "image/svg+xml" },
+        { "png",  "image/png" },
+        { "gif",  "image/gif" },
+        { "jpg",  "image/jpeg" },
+        { "ico",  "image/x-icon" },
+        { "ttf",  "application/x-font-ttf" },
+        { "woff", "font/woff" },
+        { "pdf",  "application/pdf" },
+        { NULL, NULL }
+    };
+    const char *p = strrchr(path, '.');
+    int i;
+
+    if (p && strchr(p, '/') == NULL)
+        for (i = 0; types[i].ext; i++)
+            if (strcasecmp(p + 1, types[i].ext) == 0)
+                return (types[i].type);
+    return ("application/octet-stream");
+}
+
+/* Append to the output buffer of c. */
+static void put(struct conn *c, const void *data, size_t len)
+{
+    if (c->outlen + len > c->outsize) {
+        c->outsize = c->outlen + len + 4096;
+        c->out = xrealloc(c->out, c->outsize);
+    }
+    memcpy(c->out + c->outlen, data, len);
+    c->outlen += len;
+}
+
+static void putf(struct conn *c, const char *fmt, ...)
+{
+    char buf[1024];
+    int n;
+    va_list ap;
+
+    va_start(ap, fmt);
+    n = vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    if (n > 0)
+        put(c, buf, n < (int)sizeof(buf) ? n : sizeof(buf) - 1);
+}
+
+/* Append the status line and the headers common to all responses. */
+static void put_status(struct conn *c, int status)
+{
+    c->status = status;
+    putf(c, "HTTP/1.%d %d %s\r\nServer: LightWAVE/%s\r\n", c->minor, status,
+         reason(status), LWVER);
+    if (!c->keepalive)
+        putf(c, "Connection: close\r\n");
+    else if (c->minor == 0)
+        putf(c, "Connection: keep-alive\r\n");
+}
+
+/* Append a response with a short plain-text body. */
+static void put_error(struct conn *c, int status, const char *location)
+{
+    char body[256];
+    int n;
+
+    n = snprintf(body, sizeof(body), "%d %s\n", status, reason(status));
+    put_status(c, status);
+    if (location)
+        putf(c, "Location: %s\r\n", location);
+    putf(c, "Content-Type: text/plain; charset=utf-8\r\n"
+         "Content-Length: %d\r\n\r\n", n);
+    if (!c->head) {
+        put(c, body, n);
+        c->sent = n;
+    }
+    c->state = C_SEND;
+}
+
+/* Append a chunk of the body of a child's response. */
+static void put_body(struct conn *c, const char *data, size_t len)
+{
+    if (c->head || len == 0)
+        return;
+    if (c->chunked)
+        putf(c, "%zx\r\n", len);
+    put(c, data, len);
+    if (c->chunked)
+        put(c, "\r\n", 2);
+    c->sent += len;
+}
+
+static void log_request(struct conn *c)
+{
+    char date[64];
+    time_t t = time(NULL);
+
+    strftime(date, sizeof(date), "%d/%b/%Y:%H:%M:%S %z", localtime(&t));
+    printf("%s - - [%s] \"%s\" %d %lld\n", c->addr, date,
+           c->reqline ? c->reqline : "-", c->status, c->sent);
+    fflush(stdout);
+}
+
+static void close_conn(struct conn *c)
+{
+    struct conn **pp;
+
+    if (c->state == C_WAIT) {
+        for (pp = &waithead; *pp != c; pp = &(*pp)->next)
+            ;
+        *pp = c->next;
+        for (waittail = waithead; waittail && waittail->next; )
+            waittail = waittail->next;
+    }
+    if (c->pipe >= 0) {	/* the child exits (SIGPIPE) if it writes more */
+        table[c->pipe] = NULL;
+        close(c->pipe);
+    }
+    if (c->file >= 0)
+        close(c->file);
+    table[c->fd] = NULL;
+    close(c->fd);
+    free(c->in);
+    free(c->out);
+    free(c->cgihead);
+    free(c->reqline);
+    free(c);
+}
+
+/* Parse the request at the beginning of the input buffer of c.  Return 1
+   if it is complete, 0 if more input is needed, or -1 if an error response
+   has been prepared.  The header is parsed (in place) only once, although
+   the body may arrive later. */
+static int parse_request(struct conn *c)
+{
+    char *end, *line, *next, *p, *v;
+    size_t n;
+
+    if (c->hlen == 0) {
+        /* Leading empty lines are ignored (RFC 7230, section 3.5). */
+        for (n = 0; n < c->inlen && (c->in[n] == '\r' || c->in[n] == '\n');
+             n++)
+            ;
+        if (n > 0) {
+            memmove(c->in, c->in + n, c->inlen - n);
+            c->inlen -= n;
+        }
+        if ((end = memmem(c->in, c->inlen, "\n\r\n", 3)) == NULL)
+            end = memmem(c->in, c->inlen, "\n\n", 2);
+        c->method = c->path = c->query = c->ctype = NULL;
+        c->clen = 0;
+        c->minor = 0;
+        c->head = c->keepalive = c->continued = 0;
+        if (end == NULL) {
+            if (c->inlen < LW_HTTPD_MAXHEAD)
+                return (0);
+            put_error(c, 431, NULL);
+            return (-1);
+        }
+        c->hlen = end - c->in + (end[1] == '\r' ? 3 : 2);
+        *end = '\0';
+
+        /* The request line. */
+        line = c->in;
+        if ((next = strchr(line, '\n')) != NULL)
+            *next++ = '\0';
+        if ((p = strchr(line, '\r')) != NULL)
+            *p = '\0';
+        free(c->reqline);
+        c->reqline = strdup(line);
+        c->method = line;
+        if ((p = strchr(line, ' ')) == NULL)
+            goto bad;
+        *p++ = '\0';
+        c->path = p;
+        if ((p = strchr(p, ' ')) == NULL)
+            goto bad;
+        *p++ = '\0';
+        if (strncmp(p, "HTTP/1.", 7) != 0)
+            goto bad;
+        c->minor = (p[7] == '0') ? 0 : 1;
+        c->keepalive = (c->minor > 0);
+        c->head = (strcmp(c->method, "HEAD") == 0);
+
+        /* The header fields. */
+        for (line = next; line && *line; line = next) {
+            if ((next = strchr(line, '\n')) != NULL)
+                *next++ = '\0';
+            if ((p = strchr(line, '\r')) != NULL)
+                *p = '\0';
+            if ((v = strchr(line, ':')) == NULL)
+                continue;
+            *v++ = '\0';
+            v += strspn(v, " \t");
+            if (strcasecmp(line, "Content-Length") == 0)
+                c->clen = strtoul(v, NULL, 10);
+            else if (strcasecmp(line, "Content-Type") == 0)
+                c->ctype = v;
+            else if (strcasecmp(line, "Connection") == 0) {
+                if (strcasestr(v, "close"))
+                    c->keepalive = 0;
+                else if (strcasestr(v, "keep-alive"))
+                    c->keepalive = 1;
+            }
+            else if (strcasecmp(line, "Expect") == 0) {
+                if (strcasecmp(v, "100-continue") == 0 && c->minor > 0)
+                    c->continued = -1;	/* "100 Continue" to be sent */
+            }
+            else if (strcasecmp(line, "Transfer-Encoding") == 0) {
+                c->keepalive = 0;	/* chunked request bodies */
+                put_error(c, 501, NULL);
+                return (-1);
+            }
+        }
+        if ((p = strchr(c->path, '?')) != NULL) {
+            *p++ = '\0';
+            c->query = p;
+        }
+        if (c->clen > CGI_MAX_BODY) {
+            c->keepalive = 0;
+            put_error(c, 413, NULL);
+            return (-1);
+        }
+    }
+
+    if (c->inlen < c->hlen + c->clen) {
+        if (c->continued < 0) {
+            putf(c, "HTTP/1.1 100 Continue\r\n\r\n");
+            c->continued = 1;
+        }
+        return (0);
+    }
+    c->body = c->in + c->hlen;
+    c->reqlen = c->hlen + c->clen;
+    return (1);
+
+  bad:
+    c->keepalive = 0;
+    put_error(c, 400, NULL);
+    return (-1);
+}
+
+/* Decode %XX escapes in s (in place).  Return -1 if the result contains a
+   null character, 0 otherwise. */
+static int url_decode(char *s)
+{
+    char *d = s, h[3];
+
+    for (h[2] = '\0'; *s; s++) {
+        if (*s == '%' && s[1] && s[2]) {
+            h[0] = s[1];
+            h[1] = s[2];
+            if ((*d++ = strtol(h, NULL, 16)) == '\0')
+                return (-1);
+            s += 2;
+        }
+        else
+            *d++ = *s;
+    }
+    *d = '\0';
+    return (0);
+}
+
+/* Prepare the response to a request for a file of the client. */
+static void serve_file(struct conn *c)
+{
+    char *fname, *p, *rel;
+    int fd;
+    size_t len;
+    struct stat st;
+
+    if (strcmp(c->method, "GET") && !c->head) {
+        put_error(c, 405, NULL);
+        return;
+    }
+    if (strcmp(c->path, "/") == 0
+        || (strlen(c->path) < strlen(LW_HTTPD_CLIENT)
+            && strncmp(c->path, LW_HTTPD_CLIENT, strlen(c->path)) == 0)) {
+        put_error(c, 302, LW_HTTPD_CLIENT);
+        return;
+    }
+    if (strncmp(c->path, LW_HTTPD_CLIENT, strlen(LW_HTTPD_CLIENT))) {
+        put_error(c, 404, NULL);
+        return;
+    }
+    rel = c->path + strlen(LW_HTTPD_CLIENT);
+    if (url_decode(rel) < 0) {
+        put_error(c, 400, NULL);
+        return;
+    }
+    for (p = rel; p; p = (p = strchr(p, '/')) ? p + 1 : NULL)
+        if (strncmp(p, "..", 2) == 0 && (p[2] == '/' || p[2] == '\0')) {
+            put_error(c, 403, NULL);
+            return;
+        }
+
+    len = strlen(clientdir) + strlen(rel) + 32;
+    fname = malloc(len);
+    snprintf(fname, len, "%s/%s", clientdir, rel);
+    if (*rel == '\0' || rel[strlen(rel) - 1] == '/') {
+        /* The installed client's main page is index.html (see the Makefile),
+           but in the sources it is lightwave.html. */
+        p = fname + strlen(fname);
+        strcpy(p, "index.html");
+        if ((fd = open(fname, O_RDONLY | O_CLOEXEC)) < 0) {
+            strcpy(p, "lightwave.html");
+            fd = open(fname, O_RDONLY | O_CLOEXEC);
+        }
+    }
+    else
+        fd = open(fname, O_RDONLY | O_CLOEXEC);
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        put_error(c, errno == EACCES ? 403 : 404, NULL);
+        if (fd >= 0) close(fd);
+        free(fname);
+        return;
+    }
+    if (S_ISDIR(st.st_mode)) {
+        close(fd);
+        free(fname);
+        len = strlen(c->path) + 2;
+        fname = malloc(len);
+        snprintf(fname, len, "%s/", c->path);
+        put_error(c, 302, fname);
+        free(fname);
+        return;
+    }
+    if (!S_ISREG(st.st_mode)) {
+        close(fd);
+        free(fname);
+        put_error(c, 403, NULL);
+        return;
+    }
+
+    put_status(c, 200);
+    putf(c, "Content-Type: %s\r\nContent-Length: %lld\r\n\r\n",
+         mime_type(fname), (long long)st.st_size);
+    free(fname);
+    if (c->head)
+        close(fd);
+    else {
+        c->file = fd;
+        c->foff = 0;
+        c->fend = st.st_size;
+        c->sent = st.st_size;
+    }
+    c->state = C_SEND;
+}
+
+/* Prepare the response to the request at the beginning of the input buffer
+   of c, if it is complete. */
+static void start_request(struct conn *c)
+{
+    int r;
+
+    c->status = 0;
+    c->sent = 0;
+    if ((r = parse_request(c)) == 0)
+        return;
+    if (r < 0)
+        c->reqlen = c->inlen;	/* the connection is closed (see finish()) */
+    else if (strcmp(c->path, LW_HTTPD_SERVER))
+        serve_file(c);
+    else if (strcmp(c->method, "GET") && strcmp(c->method, "POST") && !c->head)
+        put_error(c, 405, NULL);
+    else {	/* wait for a child (see lightwave_httpd()) */
+        c->state = C_WAIT;
+        c->next = NULL;
+        if (waittail)
+            waittail->next = c;
+        else
+            waithead = c;
+        waittail = c;
+    }
+}
+
+/* Finish the current response of c, and start the next request. */
+static void finish(struct conn *c)
+{
+    log_request(c);
+    if (!c->keepalive) {
+        close_conn(c);
+        return;
+    }
+    memmove(c->in, c->in + c->reqlen, c->inlen - c->reqlen);
+    c->inlen -= c->reqlen;
+    free(c->reqline);
+    c->reqline = NULL;
+    c->last = time(NULL);
+    c->hlen = c->reqlen = 0;
+    c->outlen = c->outpos = 0;
+    c->state = C_READ;
+    start_request(c);	/* a pipelined request may be waiting */
+    update(c);
+}
+
+/* Send as much of the response of c as possible without blocking. */
+static void send_response(struct conn *c)
+{
+    ssize_t n;
+
+    while (c->outpos < c->outlen) {
+        if ((n = write(c->fd, c->out + c->outpos, c->outlen - c->outpos)) < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                close_conn(c);
+            else
+                update(c);
+            return;
+        }
+        c->outpos += n;
+    }
+    c->outlen = c->outpos = 0;
+
+    while (c->file >= 0 && c->foff < c->fend) {
+        if ((n = sendfile(c->fd, c->file, &c->foff, c->fend - c->foff)) <= 0) {
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                update(c);
+            else	/* an error, or the file was truncated */
+                close_conn(c);
+            return;
+        }
+    }
+    if (c->file >= 0) {
+        close(c->file);
+        c->file = -1;
+    }
+
+    if (c->state == C_SEND)
+        finish(c);
+    else
+        update(c);
+}
+
+/* Replace the complete CGI response header at the beginning of c->cgihead
+   with an HTTP response header, and send the rest as the first part of the
+   body. */
+static void put_cgi_header(struct conn *c, char *end)
+{
+    char *body, *line, *next, *p, *status = "200 OK";
+
+    body = end + (end[1] == '\r' ? 3 : 2);
+    *end = '\0';
+    for (line = c->cgihead; line && *line; line = next) {
+        if ((next = strchr(line, '\n')) != NULL)
+            *next++ = '\0';
+        if ((p = strchr(line, '\r')) != NULL)
+            *p = '\0';
+        if (strncasecmp(line, "Status:", 7) == 0)
+            status = line + 7 + strspn(line + 7, " \t");
+    }
+    c->status = atoi(status);
+    if (c->minor == 0)	/* the end of the body is marked by closing */
+        c->keepalive = 0;
+    else
+        c->chunked = !c->head;
+    putf(c, "HTTP/1.%d %s\r\nServer: LightWAVE/%s\r\n", c->minor, status,
+         LWVER);
+    if (!c->keepalive)
+        putf(c, "Connection: close\r\n");
+    if (c->chunked)
+        putf(c, "Transfer-Encoding: chunked\r\n");
+    for (line = c->cgihead; line < end; line += strlen(line) + 1)
+        if (*line && strncasecmp(line, "Status:", 7))
+            putf(c, "%s\r\n", line);
+    put(c, "\r\n", 2);
+    put_body(c, body, c->cgihead + c->cgilen - body);
+    free(c->cgihead);
+    c->cgihead = NULL;
+}
+
+/* Close the pipe from the child handling the request of c. */
+static void end_child(struct conn *c)
+{
+    table[c->pipe] = NULL;
+    close(c->pipe);
+    c->pipe = -1;
+    c->state = C_SEND;
+    if (c->cgihead) {	/* no valid CGI header was received */
+        free(c->cgihead);
+        c->cgihead = NULL;
+        c->keepalive = 0;
+        c->chunked = 0;
+        put_error(c, 502, NULL);
+    }
+    else if (c->chunked)
+        put(c, "0\r\n\r\n", 5);
+}
+
+/* Read the output of the child handling the request of c. */
+static void relay(struct conn *c)
+{
+    static char buf[LW_HTTPD_BUFSIZE];
+    char *end;
+    ssize_t n;
+
+    if ((n = read(c->pipe, buf, sizeof(buf))) < 0 && (errno == EINTR ||
+                                                       errno == EAGAIN))
+        return;
+    if (n <= 0)	/* the child has finished */
+        end_child(c);
+    else if (c->cgihead) {
+        c->cgihead = xrealloc(c->cgihead, c->cgilen + n + 1);
+        memcpy(c->cgihead + c->cgilen, buf, n);
+        c->cgilen += n;
+        c->cgihead[c->cgilen] = '\0';
+        if ((end = strstr(c->cgihead, "\n\r\n")) != NULL
+            || (end = strstr(c->cgihead, "\n\n")) != NULL)
+            put_cgi_header(c, end);
+        else if (c->cgilen > LW_HTTPD_MAXCGIHEAD)
+            end_child(c);
+    }
+    else
+        put_body(c, buf, n);
+    send_response(c);
+}
+
+/* Start a child to handle the first waiting request.  Return 0 in the
+   child, or the child's process ID (or -1 if it could not be started). */
+static pid_t start_child(void)
+{
+    char len[32];
+    int body, fd, p[2];
+    pid_t pid;
+    struct conn *c = waithead;
+
+    if ((waithead = c->next) == NULL)
+        waittail = NULL;
+    c->next = NULL;
+
+    /* The request body (if any) becomes the child's standard input. */
+    if (c->clen > 0) {
+        if ((body = memfd_create("lightwave-body", MFD_CLOEXEC)) >= 0
+            && (write(body, c->body, c->clen) != (ssize_t)c->clen
+                || lseek(body, 0, SEEK_SET) != 0)) {
+            close(body);
+            body = -1;
+        }
+    }
+    else
+        body = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    if (body < 0 || pipe2(p, O_CLOEXEC) != 0) {
+        if (body >= 0) close(body);
+        put_error(c, 503, NULL);
+        update(c);
+        return (-1);
+    }
+
+    if ((pid = fork()) == 0) {
+        sigprocmask(SIG_SETMASK, &oldmask, NULL);
+        signal(SIGPIPE, SIG_DFL);
+        if (dup2(body, STDIN_FILENO) < 0 || dup2(p[1], STDOUT_FILENO) < 0)
+            _exit(1);
+        for (fd = 0; fd < nfd; fd++)
+            if (table[fd] && table[fd]->fd == fd) {
+                close(fd);
+                if (table[fd]->file >= 0) close(table[fd]->file);
+                if (table[fd]->pipe >= 0) close(table[fd]->pipe);
+            }
+        close(body);
+        close(p[0]);
+        close(p[1]);
+        close(lsock);
+        close(sigfd);
+        close(epfd);
+
+        setenv("GATEWAY_INTERFACE", "CGI/1.1", 1);
+        setenv("SERVER_SOFTWARE", "LightWAVE/" LWVER, 1);
+        setenv("SERVER_PROTOCOL", c->minor ? "HTTP/1.1" : "HTTP/1.0", 1);
+        setenv("SCRIPT_NAME", LW_HTTPD_SERVER, 1);
+        setenv("REMOTE_ADDR", c->addr, 1);
+        setenv("REQUEST_METHOD", c->method, 1);
+        setenv("QUERY_STRING", c->query ? c->query : "", 1);
+        snprintf(len, sizeof(len), "%lu", (unsigned long)c->clen);
+        setenv("CONTENT_LENGTH", len, 1);
+        if (c->ctype)
+            setenv("CONTENT_TYPE", c->ctype, 1);
+        else
+            unsetenv("CONTENT_TYPE");
+        return (0);
+    }
+
+    close(body);
+    close(p[1]);
+    if (pid < 0) {
+        close(p[0]);
+        put_error(c, 503, NULL);
+        update(c);
+        return (-1);
+    }
+    nbusy++;
+    c->pipe = p[0];
+    fcntl(c->pipe, F_SETFL, O_NONBLOCK);
+    table[c->pipe] = c;
+    watch(c->pipe, EPOLL_CTL_ADD, c->pevents = EPOLLIN);
+    c->cgihead = xrealloc(NULL, 1);
+    c->cgilen = 0;
+    c->chunked = 0;
+    c->state = C_CHILD;
+    c->last = time(NULL);
+    update(c);
+    return (pid);
+}
+
+static void accept_conns(void)
+{
+    int fd, one = 1;
+    socklen_t len;
+    struct conn *c;
+    struct sockaddr_storage sa;
+
+    for (;;) {
+        len = sizeof(sa);
+        if ((fd = accept4(lsock, (struct sockaddr *)&sa, &len,
+                          SOCK_NONBLOCK | SOCK_CLOEXEC)) < 0) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            return;
+        }
+        if (fd >= nfd) {	/* too many connections */
+            close(fd);
+            continue;
+        }
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        if ((c = calloc(1, sizeof(struct conn))) == NULL) {
+            close(fd);
+            continue;
+        }
+        c->fd = fd;
+        c->file = c->pipe = -1;
+        c->state = C_READ;
+        c->last = time(NULL);
+        if (sa.ss_family == AF_INET6)
+            inet_ntop(AF_INET6, &((struct sockaddr_in6 *)&sa)->sin6_addr,
+                      c->addr, sizeof(c->addr));
+        else if (sa.ss_family == AF_INET)
+            inet_ntop(AF_INET, &((struct sockaddr_in *)&sa)->sin_addr,
+                      c->addr, sizeof(c->addr));
+        else
+            strcpy(c->addr, "-");
+        table[fd] = c;
+        watch(fd, EPOLL_CTL_ADD, c->events = EPOLLIN);
+    }
+}
+
+static void read_conn(struct conn *c)
+{
+    size_t method = 0, path = 0, query = 0, ctype = 0;
+    ssize_t n;
+
+    if (c->insize - c->inlen < 4096) {
+        /* If the header has been parsed, the pointers to its parts are
+           rebuilt from their offsets in the (possibly moved) buffer. */
+        if (c->hlen > 0) {
+            method = c->method - c->in;
+            path = c->path - c->in;
+            if (c->query) query = c->query - c->in;
+            if (c->ctype) ctype = c->ctype - c->in;
+        }
+        c->insize = c->insize ? 2 * c->insize : 8192;
+        c->in = xrealloc(c->in, c->insize);
+        if (c->hlen > 0) {
+            c->method = c->in + method;
+            c->path = c->in + path;
+            if (query) c->query = c->in + query;
+            if (ctype) c->ctype = c->in + ctype;
+        }
+    }
+    if ((n = read(c->fd, c->in + c->inlen, c->insize - c->inlen)) <= 0) {
+        if (n < 0 && (errno == EINTR || errno == EAGAIN))
+            return;
+        close_conn(c);
+        return;
+    }
+    c->inlen += n;
+    c->last = time(NULL);
+    start_request(c);
+    send_response(c);
+}
+
+static int listen_on(char *spec)
+{
+    char *host = "127.0.0.1", *port = spec, *p;
+    int fd = -1, one = 1;
+    struct addrinfo hints, *ai, *res;
+
+    if ((p = strrchr(spec, ':')) != NULL) {
+        *p = '\0';
+        host = spec;
+        port = p + 1;
+        if (*host == '[' && (p = strchr(host, ']')) != NULL) {
+            *p = '\0';
+            host++;
+        }
+        if (*host == '\0')
+            host = NULL;
+    }
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    if (getaddrinfo(host, port, &hints, &res) != 0)
+        return (-1);
+    for (ai = res; ai; ai = ai->ai_next) {
+        if ((fd = socket(ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK |
+                         SOCK_CLOEXEC, ai->ai_protocol)) < 0)
+            continue;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (bind(fd, ai->ai_addr, ai->ai_addrlen) == 0
+            && listen(fd, SOMAXCONN) == 0)
+            break;
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+    return (fd);
+}
+
+/* Run the server.  This function returns only in a child that is to handle
+   a request, with its environment and standard I/O set up. */
+void lightwave_httpd(int argc, char **argv)
+{
+    int fd, i, n, status;
+    time_t now, then = 0;
+    sigset_t mask;
+    struct conn *c;
+    struct epoll_event ev[64];
+    struct rlimit rl;
+    struct signalfd_siginfo si;
+
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s -s [ADDRESS:]PORT [NWORKERS]\n", argv[0]);
+        exit(1);
+    }
+    nworkers = (argc > 3) ? atoi(argv[3]) : LW_HTTPD_NWORKERS;
+    if (nworkers < 1)
+        nworkers = 1;
+    if ((clientdir = getenv("LIGHTWAVE_CLIENT")) == NULL)
+        clientdir = LWDIR;
+
+#ifdef SANDBOX
+    /* The socket is opened as the real user, so that the server cannot bind
+       a port that the real user could not.  The children need the saved
+       set-user-ID to set up the sandbox. */
+    if (seteuid(getuid()) != 0)
+        fail("cannot set effective user ID");
+#else
+    if (geteuid() == 0 || getegid() == 0) {
+        fprintf(stderr, "lightwave: refusing to run as superuser\n");
+        exit(1);
+    }
+#endif
+    if ((lsock = listen_on(argv[2])) < 0)
+        fail(argv[2]);
+
+    if (getrlimit(RLIMIT_NOFILE, &rl) != 0 || rl.rlim_cur == RLIM_INFINITY
+        || rl.rlim_cur > 65536)
+        rl.rlim_cur = 65536;
+    nfd = rl.rlim_cur;
+    if ((table = calloc(nfd, sizeof(struct conn *))) == NULL)
+        fail("lightwave");
+
+    /* Child exits are reported by sigfd. */
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &mask, &oldmask);
+    if ((sigfd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC)) < 0
+        || (epfd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+        fail("lightwave");
+    signal(SIGPIPE, SIG_IGN);
+    watch(lsock, EPOLL_CTL_ADD, EPOLLIN);
+    watch(sigfd, EPOLL_CTL_ADD, EPOLLIN);
+
+    for (;;) {
+        n = epoll_wait(epfd, ev, sizeof(ev) / sizeof(ev[0]), 1000);
+        for (i = 0; i < n; i++) {
+            fd = ev[i].data.fd;
+            if (fd == lsock)
+                accept_conns();
+            else if (fd == sigfd) {
+                while (read(sigfd, &si, sizeof(si)) > 0)
+                    ;
+                while (waitpid(-1, &status, WNOHANG) > 0)
+                    nbusy--;
+            }
+            else if ((c = table[fd]) == NULL)
+                continue;	/* closed while handling an earlier event */
+            else if (fd == c->pipe)
+                relay(c);
+            else if (c->state == C_READ && (ev[i].events & EPOLLIN))
+                read_conn(c);
+            else if (ev[i].events & (EPOLLERR | EPOLLHUP))
+                close_conn(c);
+            else if (ev[i].events & EPOLLOUT) {
+                c->last = time(NULL);
+                send_response(c);
+            }
+        }
+
+        /* Start children for waiting requests. */
+        while (waithead && nbusy < nworkers)
+            if (start_child() == 0)
+                return;
+
+        /* Close idle connections. */
+        if ((now = time(NULL)) != then) {
+            then = now;
+            for (fd = 0; fd < nfd; fd++)
+                if ((c = table[fd]) && c->fd == fd && c->state != C_CHILD
+                    && c->state != C_WAIT && now - c->last > LW_HTTPD_TIMEOUT)
+                    close_conn(c);
+        }
+    }
+}
@@ -0,0 +1,34 @@
+/* file: httpd.h		18 October 2026
+
+Standalone HTTP server mode for the LightWAVE server
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LIGHTWAVE_HTTPD_H
+#define LIGHTWAVE_HTTPD_H
+
+/* URL path of requests handled by the server (as in the default client
+   configuration; see lightwave.js). */
+#define LW_HTTPD_SERVER "/cgi-bin/lightwave"
+
+/* URL path prefix of the client. */
+#define LW_HTTPD_CLIENT "/lightwave/"
+
+/* Default number of requests handled at once. */
+#define LW_HTTPD_NWORKERS 4
+
+void lightwave_httpd(int argc, char **argv);
+
+#endif
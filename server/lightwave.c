@@ -40,10 +40,30 @@ _______________________________________________________________________________
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
 #include <wfdb/wfdblib.h>
 #include <wfdb/ecgcodes.h>
+#include "alloc.h"
+#include "annstats.h"
+#include "catalog.h"
 #include "cgi.h"
+#include "codec.h"
+#include "editlog.h"
+#include "emit.h"
+#include "httpd.h"
+#include "pipeline.h"
+#include "readahead.h"
+#include "resample.h"
 #include "sandbox.h"
+#include "stats.h"
+#include "store.h"
+#include "timing.h"
 #include "setrepos.c"
 
 #ifndef LWDIR
@@ -57,49 +77,124 @@ _______________________________________________________________________________
 /* MFNLEN is the max length of a WFDB filename, defined in wfdb/lib/wfdbio.c. */
 #define MFNLEN	1024
 
+/* MAXDBLEN is the longest database name accepted from a client.  It leaves
+   room within MFNLEN for a directory from the WFDB path and a file name. */
+#define MAXDBLEN	256
+
 /* NAMAX is the maximum number of annotators that fetchannotations() will
 attempt to read at one time.  The value is arbitrary and can be increased
 if necessary.  Ideally, if NAMAX annotators are displayed simultaneously
 in LightWAVE's signal window, the user should be able to read all of them. */
 #define NAMAX	16
 
-/* TOL is the tolerance for error in approx_LCM, which is used to find the
-(approximate) least common multiple of sampling frequencies that may not
-be integers.  The default value of 0.001 means that the maximum error is
-one part in a thousand (0.1%). */
-#define TOL	0.001
+/* DECODE_BLOCK is the number of frames read by decode_signals() between
+updates of the pipeline (see pipeline.c). */
+#define DECODE_BLOCK 256
+
+/* RS_MAXDEN is the largest denominator used to express the ratio of a
+resampling rate to the frame rate as a fraction (see prep_resample()). */
+#define RS_MAXDEN 1000L
+
+/* PLAY_MAXLEAD is the largest lead (in seconds) of the windows sent by play()
+over the client's playback. */
+#define PLAY_MAXLEAD 10.
+
+/* FOLLOW_MAXDUR is the longest time (in seconds) for which follow() streams
+new data, and FOLLOW_MAXIDLE is the longest time it waits for new data before
+ending the stream;  the client can then make another request.  Once the record
+has been written, follow() waits FOLLOW_INTERVAL seconds before reading it, so
+that writes made together (such as to the signal and annotation files) are
+sent together. */
+#define FOLLOW_MAXDUR 600.
+#define FOLLOW_MAXIDLE 60.
+#define FOLLOW_INTERVAL 0.1
+
+/* AS_DEFBINS and AS_MAXBINS are the default and largest numbers of bins in the
+histograms returned by annsummary(), and AS_MAXTYPES is the largest number of
+annotation types in each annotation file for which a histogram is kept
+(annotations of other types are counted, and included in the histogram of
+all annotations, but have no histogram of their own). */
+#define AS_DEFBINS 100
+#define AS_MAXBINS 1000
+#define AS_MAXTYPES 256
 
 static char *action, *annotator[NAMAX], buf[BUFSIZE], *db, *record, *recpath,
     **sname, wfdb_filename[MFNLEN];
-static int interactive, nann, nsig, nosig, *sigmap;
+static int db_read, debug_alloc, debug_timing, failed, following, interactive,
+    nann, nsig, nosig, playing, *sigmap;
+static long nsamples, tpf, *rs_up, *rs_down;
 WFDB_FILE *ifile;
 WFDB_Frequency ffreq, tfreq;
 WFDB_Sample *v;
 WFDB_Siginfo *s;
 WFDB_Time t0, tf, dt;
 
-char *get_param(char *name), *get_param_multiple(char *name), *strjson(char *s);
-double approx_LCM(double x, double y);
+char *get_param(char *name), *get_param_multiple(char *name), *strjson(char *s),
+    *prep_resample(void);
 int  fetchannotations(void), fetchsignals(void), ufindsig(char *name);
-void dblist(void), rlist(void), alist(void), info(void), fetch(void),
+long read_next_frames(WFDB_Sample *v, int *m, int imin, int imax,
+		      WFDB_Sample **sp, long n);
+void read_frames(WFDB_Sample *v, int *m, int imin, int imax, WFDB_Sample **sp),
+    print_samples(WFDB_Sample *sb, WFDB_Sample *se);
+void dblist(void), rlist(void), alist(void), annquery(void), info(void),
+    annsummary(void), fetch(void), play(void), follow(void), stats(void),
     force_unique_signames(void), print_file(char *filename),
     jsonp_end(void), lwpass(void), lwfail(char *error_message), pnwcheck(void),
     prep_signals(void), map_signals(void), prep_annotations(void),
-    prep_times(void), cleanup(void);
+    prep_times(void), cleanup(void), end_request(void),
+    print_timing(char *prefix, char *suffix),
+    print_alloc(char *prefix, char *suffix);
 
 int main(int argc, char **argv)
 {
     static char *callback = NULL, *user;
+    char *ctype = "application/javascript; charset=utf-8", *p;
     int i;
     extern int headers_initialized;
 
+    /* In zygote mode (see zygote.c) and in standalone HTTP server mode (see
+       httpd.c), lightwave_zygote() and lightwave_httpd() return only in a
+       child process that has received a request to be handled below.
+       Otherwise, if a zygote is running, pass the request to it. */
+    if (argc > 1 && strcmp(argv[1], "-z") == 0) {
+	lightwave_zygote(argc, argv);
+	argc = 1;
+    }
+    else if (argc > 1 && strcmp(argv[1], "-s") == 0) {
+	lightwave_httpd(argc, argv);
+	argc = 1;
+    }
+    else if (argc < 2 && lightwave_forward())
+	exit(0);
+
+    lw_timing_start();
+    lw_phase_begin("init");
+
+    /* Read the body of a POST request before the sandbox is set up, since
+       the sandbox may replace the standard input (see sandbox.c). */
+    if (argc < 2)
+	cgi_init();
+
     lightwave_sandbox();
 
     if (argc < 2) {  /* normal operation as a CGI application */
-	cgi_init();
 	atexit(cgi_end);
        	cgi_process_form();
-	printf("Content-type: application/javascript; charset=utf-8\r\n\r\n");
+	/* The headers are sent with the first part of the output, so that
+	   they can include a Server-Timing header (see cgi.c). */
+	if ((p = cgi_param("action")) && strcmp(p, "stats") == 0)
+	    ctype = "text/plain; version=0.0.4; charset=utf-8";
+	else if (p && (strcmp(p, "play") == 0 || strcmp(p, "follow") == 0))
+	    ctype = "application/x-ndjson; charset=utf-8";
+	cgi_start_output(ctype, lw_timing_header);
+	atexit(end_request);
+	while (p = cgi_param_multiple("debug")) {
+	    if (strcmp(p, "timing") == 0) debug_timing = 1;
+	    else if (strcmp(p, "alloc") == 0) {
+		debug_alloc = 1;
+		lw_alloc_start();
+	    }
+	}
     }
     else
         interactive = 1;  /* interactive mode for debugging */
@@ -108,12 +203,19 @@ int main(int argc, char **argv)
 
     /* Define data sources to be accessed via this server. */
     setrepos();		/* function defined in "setrepos.c" */
+    lw_phase_end("init");
 
     if (!(action = get_param("action"))) {
 	print_file(LWDIR "/doc/about.txt");
 	exit(0);
     }
 
+    /* Statistics are plain text for monitoring systems, not JSON. */
+    if (strcmp(action, "stats") == 0) {
+	stats();
+	exit(0);
+    }
+
     if (!interactive && (callback = get_param("callback"))) {
 	printf("%s(", callback);	/* JSONP:  "wrap" output in callback */
 	atexit(jsonp_end);	/* close the output with ")" before exiting */
@@ -128,6 +230,9 @@ int main(int argc, char **argv)
 
     else if ((db = get_param("db")) == NULL)
 	lwfail("Your request did not specify a database");
+
+    else if (strlen(db) > MAXDBLEN)
+	lwfail("The database name is too long");
   
     else if (strcmp(action, "rlist") == 0)
 	rlist();
@@ -135,15 +240,27 @@ int main(int argc, char **argv)
     else if (strcmp(action, "alist") == 0)
 	alist();
 
+    else if (strcmp(action, "annquery") == 0)
+	annquery();
+
     else if ((record = get_param("record")) == NULL)
 	lwfail("Your request did not specify a record");
 
     else if (strcmp(action, "info") == 0)
 	info();
 
+    else if (strcmp(action, "annsummary") == 0)
+	annsummary();
+
     else if (strcmp(action, "fetch") == 0)
 	fetch();
 
+    else if (strcmp(action, "play") == 0)
+	play();
+
+    else if (strcmp(action, "follow") == 0)
+	follow();
+
     else
 	lwfail("Your request did not specify a valid action");
 
@@ -159,12 +276,17 @@ void prep_signals()
 
     /* Discover the number of signals defined in the header, allocate
        memory for their signal information structures, open the signals. */
-    if ((nsig = isigopen(recpath, NULL, 0)) > 0) {
+    lw_phase_begin("sigopen");
+    if ((nsig = isigopen(recpath, NULL, 0)) >= 0)
+	db_read = 1;
+    if (nsig > 0) {
 	SUALLOC(s, nsig, sizeof(WFDB_Siginfo));
 	nsig = isigopen(recpath, s, nsig);
+	lw_phase_end("sigopen");
     } 
     else {
 	tfreq = ffreq = sampfreq(NULL);
+	lw_phase_end("sigopen");
 	return;
     }
 
@@ -177,19 +299,68 @@ void prep_signals()
     /* Make reasonably sure that signal names are distinct (see below). */
     force_unique_signames();
 
-    /* Find the least common multiple of the sampling frequencies (which may not
-       be exactly expressible as floating-point numbers).  In WFDB-compatible
-       records, all signals are sampled at the same frequency or at a multiple
-       of the frame frequency, but (especially in EDF records) there may be many
-       samples of each signal in each frame.  The for loop below sets the "tick"
-       frequency, tfreq, to the number of instants in each second when at least
-       one sample is acquired. */
+    /* Find the "tick" frequency, tfreq, the number of instants in each second
+       when at least one sample is acquired.  In WFDB-compatible records, all
+       signals are sampled at the same frequency or at a multiple of the frame
+       frequency, but (especially in EDF records) there may be many samples of
+       each signal in each frame.  The number of ticks per frame, tpf, is the
+       largest number of samples per frame, so that ticks are the units of
+       annotation times read and written in WFDB_HIGHRES mode, and times in
+       frames and sample intervals are exact multiples of ticks, even if the
+       frequencies themselves are not exactly expressible as floating-point
+       numbers.  The rare signals whose numbers of samples per frame don't
+       divide tpf are resampled onto the tick grid (rs_up/rs_down is the ratio
+       of the output and input sampling frequencies, or 1/1 if the signal is
+       not resampled). */
     setgvmode(WFDB_LOWRES);
     ffreq = sampfreq(NULL);
     if (ffreq <= 0.) ffreq = WFDB_DEFFREQ;
-    for (n = 0, tfreq = ffreq; n < nsig; n++)
-	tfreq = approx_LCM(ffreq * s[n].spf, tfreq);
-}   
+    for (n = 0, tpf = 1; n < nsig; n++)
+	if (s[n].spf > tpf) tpf = s[n].spf;
+    SUALLOC(rs_up, nsig, sizeof(long));
+    SUALLOC(rs_down, nsig, sizeof(long));
+    for (n = 0; n < nsig; n++) {
+	if (tpf % s[n].spf) {
+	    long g = lw_gcd(tpf, s[n].spf);
+
+	    rs_up[n] = tpf / g;
+	    rs_down[n] = s[n].spf / g;
+	}
+	else
+	    rs_up[n] = rs_down[n] = 1;
+    }
+    tfreq = ffreq * tpf;
+}
+
+/* If resample=F was requested, set up resampling of the selected signals onto
+   a common grid of F samples per second (expressed as a fraction of the frame
+   frequency).  Return NULL if successful, or an error message. */
+char *prep_resample(void)
+{
+    char *p;
+    double f;
+    long den, g, num, spfmax;
+    int n;
+
+    if ((p = get_param("resample")) == NULL || nsig < 1)
+	return (NULL);
+    for (n = 0, spfmax = 1; n < nsig; n++)
+	if (s[n].spf > spfmax) spfmax = s[n].spf;
+    if ((f = atof(p)) <= 0. || f > ffreq * spfmax ||
+	lw_rational(f / ffreq, RS_MAXDEN, &num, &den) < 0)
+	return ("The resampling frequency must be positive, and no greater"
+		" than the highest sampling frequency of the record");
+    for (n = 0; n < nsig; n++) {
+	g = lw_gcd(num, den * s[n].spf);
+	rs_up[n] = num / g;
+	rs_down[n] = den * s[n].spf / g;
+	if (sigmap[n] >= 0 &&
+	    (rs_up[n] > LW_RESAMPLE_MAX || rs_down[n] > LW_RESAMPLE_MAX))
+	    return ("The requested resampling frequency is not supported for"
+		    " this record");
+    }
+    return (NULL);
+}
 
 void lwpass()
 {
@@ -200,6 +371,7 @@ void lwfail(char *error_message)
 {
     char *p = strjson(error_message);
 
+    failed = 1;
     printf("{\n  \"success\": false,\n  \"error\": %s\n}\n", p);
     SFREE(p);
 }
@@ -262,21 +434,6 @@ void prep_times()
     tf = t0 + dt;
 }
 
-/* Find the (approximate) least common multiple of two positive numbers
-   (which are not necessarily integers). */
-double approx_LCM(double x, double y)
-{
-    double x0 = x, y0 = y, z;
-
-    if (x <= 0. || y <= 0.) return (0.);	/* this shouldn't happen! */
-    while (-TOL > (z = x/y - 1) || z > TOL) {
-	if (x < y) x+= x0;
-	else y += y0;
-	/* when x and y are nearly equal, z is close to zero */
-    }
-    return (x);
-}
-
 /* Prompt for input, read a line from stdin, save it, return a pointer to it. */
 char *prompt(char *prompt_string)
 {
@@ -307,30 +464,6 @@ char *get_param_multiple(char *name)
     else return cgi_param_multiple(name);
 }
 
-/* Return the length of a UTF-8 character in bytes, or 0 if the input
-   is not valid UTF-8. */
-static int utf8_char_len(const char *s)
-{
-    unsigned int c = (unsigned char) s[0], n = 0, i;
-    static const unsigned int min[] = { 0x80, 0x800, 0x10000 };
-
-    if (c < 0x80)
-	return 1;
-    while (c & (0x80 >> n))
-	n++;
-    if (n < 2 || n > 4)
-	return 0;
-    c &= (0x7f >> n);
-    for (i = 1; i < n; i++) {
-	if (((unsigned char) s[i] & 0xc0) != 0x80)
-	    return 0;
-	c = (c << 6) | ((unsigned char) s[i] & 0x3f);
-    }
-    if (c < min[n - 2] || c > 0x10ffff || (c & ~0x7ff) == 0xd800)
-	return 0;
-    return n;
-}
-
 /* Convert a string to a JSON quoted string.  Note that newlines and other
 control characters that cannot appear in JSON strings are converted to
 spaces.  Non-UTF-8 characters are converted to question marks.
@@ -348,7 +481,7 @@ char *strjson(char *s)
 	if (s[i] == '"' || s[i] == '\\') q++;
 	else if ((unsigned char) s[i] < 0x20) s[i] = ' ';
 	else if ((unsigned char) s[i] >= 0x80) {
-	    j = utf8_char_len(&s[i]);
+	    j = lw_utf8_char_len(&s[i]);
 	    if (j == 0)
 		s[i] = '?';
 	    else
@@ -391,6 +524,16 @@ void jsonp_end(void)
     return;
 }
 
+/* Print the server's request statistics (see stats.c). */
+void stats(void)
+{
+    if (getenv("LIGHTWAVE_DISABLE_STATS") || !lw_stats_enabled()) {
+	printf("# This server does not collect statistics\n");
+	return;
+    }
+    lw_stats_print(stdout);
+}
+
 void dblist(void)
 {
     char *next, *wfdb = getwfdb(), *list;
@@ -466,27 +609,181 @@ void dblist(void)
     }
 }
 
+/* Selection criteria for rlist requests (see rlist_match()). */
+static char *rl_prefix, *rl_signal[NAMAX], *rl_annotator[NAMAX];
+static int rl_nsignal, rl_nannotator;
+static double rl_mindur, rl_maxdur, rl_minfreq, rl_maxfreq;
+
+/* Read the optional rlist parameters that can only be evaluated using a
+   catalog. */
+void prep_rlist_filters(void)
+{
+    char *p;
+
+    while (rl_nsignal < NAMAX && (p = get_param_multiple("signal")))
+	rl_signal[rl_nsignal++] = p;
+    while (rl_nannotator < NAMAX && (p = get_param_multiple("annotator")))
+	rl_annotator[rl_nannotator++] = p;
+    rl_mindur = (p = get_param("mindur")) ? atof(p) : -1.;
+    rl_maxdur = (p = get_param("maxdur")) ? atof(p) : -1.;
+    rl_minfreq = (p = get_param("minfreq")) ? atof(p) : -1.;
+    rl_maxfreq = (p = get_param("maxfreq")) ? atof(p) : -1.;
+}
+
+/* Return 1 if the record described by catalog entry e satisfies all of the
+   rlist selection criteria, 0 otherwise. */
+int rlist_match(struct lw_catalog_entry *e)
+{
+    double dur = e->freq > 0. ? e->nframes / e->freq : 0.;
+    int i;
+
+    if (rl_prefix && strncmp(e->record, rl_prefix, strlen(rl_prefix)))
+	return (0);
+    if ((rl_mindur >= 0. && dur < rl_mindur) ||
+	(rl_maxdur >= 0. && dur > rl_maxdur) ||
+	(rl_minfreq >= 0. && e->freq < rl_minfreq) ||
+	(rl_maxfreq >= 0. && e->freq > rl_maxfreq))
+	return (0);
+    for (i = 0; i < rl_nsignal; i++)
+	if (!lw_catalog_has(e->signals, rl_signal[i]))
+	    return (0);
+    for (i = 0; i < rl_nannotator; i++)
+	if (!lw_catalog_has(e->annotators, rl_annotator[i]))
+	    return (0);
+    return (1);
+}
+
+/* Print a list from a catalog entry as a JSON array. */
+void print_catalog_list(const char *list)
+{
+    char *name, *p;
+    const char *q;
+    size_t len;
+    int first = 1;
+
+    printf("[");
+    for (q = list; (q = lw_catalog_next(q, &len)) != NULL; q += len) {
+	SUALLOC(name, len + 1, 1);
+	memcpy(name, q, len);
+	printf("%s %s", first ? "" : ",", p = strjson(name));
+	SFREE(p);
+	SFREE(name);
+	first = 0;
+    }
+    printf(" ]");
+}
+
+/* Print the catalog entry for a record. */
+void print_catalog_entry(struct lw_catalog_entry *e)
+{
+    char *p;
+
+    printf("    { \"name\": %s,\n", p = strjson(e->record)); SFREE(p);
+    printf("      \"freq\": %g,\n", e->freq);
+    if (e->freq > 0. && e->nframes > 0L)
+	printf("      \"duration\": %.12g,\n", e->nframes / e->freq);
+    else
+	printf("      \"duration\": null,\n");
+    if (*e->basetime) {
+	printf("      \"start\": %s,\n", p = strjson(e->basetime));
+	SFREE(p);
+    }
+    else
+	printf("      \"start\": null,\n");
+    printf("      \"nsig\": %d,\n", e->nsig);
+    printf("      \"signal\": ");
+    print_catalog_list(e->signals);
+    printf(",\n      \"annotator\": ");
+    print_catalog_list(e->annotators);
+    printf("\n    }");
+}
+
+/* List the records of a database.  Records are read from the database's
+   catalog if it has one (see catalog.c), or from RECORDS otherwise.  The
+   optional 'prefix', 'offset' and 'limit' parameters select a page of
+   records whose names begin with a given prefix;  with a catalog, records
+   can also be selected by signal names, annotators, duration, and sampling
+   frequency, and their properties are listed if 'detail' is nonzero. */
 void rlist(void)
 {
-    sprintf(buf, "%s/RECORDS", db);
+    char *line = NULL, *p, **rec = NULL;
+    int catalog = 0, detail = 0;
+    long i, limit = -1L, n = 0L, nmatch = 0L, offset = 0L;
+    size_t size = 0;
+    struct lw_catalog_entry e;
+
+    if ((rl_prefix = get_param("prefix")) && *rl_prefix == '\0')
+	rl_prefix = NULL;
+    if ((p = get_param("offset")) && (offset = atol(p)) < 0L) offset = 0L;
+    if ((p = get_param("limit")) && *p) limit = atol(p);
+
+    if (snprintf(buf, sizeof(buf), "%s/" LW_CATALOG_FILE, db) >= sizeof(buf)) {
+	lwfail("The database name is too long");
+	return;
+    }
     if (ifile = wfdb_open(buf, NULL, WFDB_READ)) {
-	char *p;
-        int first = 1;
-
-        printf("{ \"record\": [\n");
-	while (wfdb_fgets(buf, sizeof(buf), ifile)) {
-	    buf[strlen(buf)-1] = '\0';
-	    if (!first) printf(",\n");
-	    else first = 0;
-	    printf("    %s", p = strjson(buf));
-	    SFREE(p);
+	catalog = 1;
+	prep_rlist_filters();
+	detail = (p = get_param("detail")) && atoi(p);
+    }
+    else {
+	snprintf(buf, sizeof(buf), "%s/RECORDS", db);
+	ifile = wfdb_open(buf, NULL, WFDB_READ);
+    }
+    if (ifile == NULL) {
+	lwfail("The list of records could not be read");
+	return;
+    }
+    db_read = 1;
+
+    /* Select the records on the requested page.  Matching records outside of
+       the page are counted but not saved. */
+    while (lw_catalog_getline(ifile, &line, &size)) {
+	if (catalog) {
+	    if (!lw_catalog_parse(line, &e) || !rlist_match(&e))
+		continue;
+	}
+	else if (rl_prefix && strncmp(line, rl_prefix, strlen(rl_prefix)))
+	    continue;
+	if (nmatch++ < offset || (limit >= 0L && n >= limit))
+	    continue;
+	if (catalog) {	/* restore the tabs replaced by lw_catalog_parse() */
+	    for (p = line; p < e.annotators; p++)
+		if (*p == '\0') *p = '\t';
+	}
+	SREALLOC(rec, n + 1, sizeof(char *));
+	rec[n] = NULL;
+	SSTRCPY(rec[n], line);
+	n++;
+    }
+    wfdb_fclose(ifile);
+    SFREE(line);
+
+    printf("{ \"record\": [\n");
+    for (i = 0; i < n; i++) {
+	if (catalog)	/* isolate the record name */
+	    if (p = strchr(rec[i], '\t')) *p = '\0';
+	printf("    %s%s", p = strjson(rec[i]), i < n-1 ? ",\n" : "");
+	SFREE(p);
+	if (catalog)
+	    rec[i][strlen(rec[i])] = '\t';
+    }
+    printf("\n  ],\n");
+    if (detail) {
+	printf("  \"detail\": [\n");
+	for (i = 0; i < n; i++) {
+	    lw_catalog_parse(rec[i], &e);
+	    print_catalog_entry(&e);
+	    printf("%s", i < n-1 ? ",\n" : "");
 	}
 	printf("\n  ],\n");
-	lwpass();
-	wfdb_fclose(ifile);
     }
-    else
-	lwfail("The list of records could not be read");
+    printf("  \"total\": %ld,\n", nmatch);
+    printf("  \"offset\": %ld,\n", offset);
+    lwpass();
+    for (i = 0; i < n; i++)
+	SFREE(rec[i]);
+    SFREE(rec);
 }
 
 void alist(void)
@@ -499,8 +796,9 @@ void alist(void)
 	for (next = wfdb; *next && next - wfdb < mfnlen; next++)
 	    if (*next == ' ') { *next++ = '\0'; break; }
 	/* Look for an "ANNOTATORS" file in the next possible location. */
-	sprintf(wfdb_filename, "%s/%s/ANNOTATORS", wfdb, db);
-	if (ifile = wfdb_fopen(wfdb_filename, "rb")) {
+	if (snprintf(wfdb_filename, sizeof(wfdb_filename), "%s/%s/ANNOTATORS",
+		     wfdb, db) < sizeof(wfdb_filename) &&
+	    (ifile = wfdb_fopen(wfdb_filename, "rb"))) {
 	    if (first) printf("{ \"annotator\": [\n");
 	    while (wfdb_fgets(buf, sizeof(buf), ifile)) {
 		char *p, *name, *desc;
@@ -530,11 +828,131 @@ void alist(void)
     if (!first) {
 	printf("\n  ],\n");
 	lwpass();
+	db_read = 1;
     }
     else
 	lwfail("The list of annotators could not be read");
 }
 
+/* An annquery request is answered from the database's annotation statistics
+   index (see annstats.c).  If a type is given, the response lists the
+   annotation files that contain annotations of that type, in order of
+   decreasing number of them;  otherwise, it lists the types found in the
+   database, with the number of annotations of each and the number of records
+   that contain them.  In either case, only the first 'top' items are listed
+   if top is given, and only the annotations of 'annotator' are counted if it
+   is given. */
+struct aq_item {
+    char *name;		/* record (if a type was given) or type */
+    char *annotator;	/* annotator (if a type was given) */
+    char *record;	/* last record counted (if no type was given) */
+    long n;		/* order of the item in the index */
+    long count;		/* number of annotations */
+    long nrec;		/* number of records (if no type was given) */
+    double first, last;	/* times of the first and last annotations (s) */
+};
+
+static int aq_compare(const void *a, const void *b)
+{
+    const struct aq_item *x = a, *y = b;
+
+    if (x->count != y->count)
+	return (x->count > y->count ? -1 : 1);
+    return (x->n < y->n ? -1 : x->n > y->n);
+}
+
+void annquery(void)
+{
+    char *annot, *line = NULL, *p, *type;
+    long i, n = 0L, nline = 0L, top = -1L;
+    size_t size = 0;
+    struct aq_item *item = NULL;
+    struct lw_annstats_entry e;
+
+    type = get_param("type");
+    if ((annot = get_param("annotator")) && *annot == '\0') annot = NULL;
+    if ((p = get_param("top")) && *p) top = atol(p);
+
+    if (snprintf(buf, sizeof(buf), "%s/" LW_ANNSTATS_FILE, db) >= sizeof(buf)) {
+	lwfail("The database name is too long");
+	return;
+    }
+    if ((ifile = wfdb_open(buf, NULL, WFDB_READ)) == NULL) {
+	lwfail("This database has no annotation statistics index");
+	return;
+    }
+    db_read = 1;
+    while (lw_catalog_getline(ifile, &line, &size)) {
+	if (!lw_annstats_parse(line, &e) || e.freq <= 0. ||
+	    (annot && strcmp(e.annotator, annot)))
+	    continue;
+	nline++;
+	if (type) {
+	    if (strcmp(e.type, type))
+		continue;
+	    SREALLOC(item, n + 1, sizeof(struct aq_item));
+	    memset(&item[n], 0, sizeof(struct aq_item));
+	    SSTRCPY(item[n].name, e.record);
+	    SSTRCPY(item[n].annotator, e.annotator);
+	    item[n].n = nline;
+	    item[n].count = e.count;
+	    item[n].first = e.first / e.freq;
+	    item[n].last = e.last / e.freq;
+	    n++;
+	}
+	else {
+	    for (i = 0; i < n && strcmp(item[i].name, e.type); i++)
+		;
+	    if (i == n) {
+		SREALLOC(item, n + 1, sizeof(struct aq_item));
+		memset(&item[n], 0, sizeof(struct aq_item));
+		SSTRCPY(item[n].name, e.type);
+		item[n].n = nline;
+		n++;
+	    }
+	    /* Count each record once, although it may have several annotators
+	       (the lines of each record are adjacent). */
+	    if (item[i].record == NULL || strcmp(item[i].record, e.record)) {
+		SSTRCPY(item[i].record, e.record);
+		item[i].nrec++;
+	    }
+	    item[i].count += e.count;
+	}
+    }
+    wfdb_fclose(ifile);
+    SFREE(line);
+
+    qsort(item, n, sizeof(struct aq_item), aq_compare);
+    if (top < 0L || top > n) top = n;
+    printf("{ \"%s\": [\n", type ? "record" : "anntype");
+    for (i = 0; i < top; i++) {
+	printf("    { \"%s\": %s,\n", type ? "name" : "type",
+	       p = strjson(item[i].name));
+	SFREE(p);
+	if (type) {
+	    printf("      \"annotator\": %s,\n", p = strjson(item[i].annotator));
+	    SFREE(p);
+	    printf("      \"count\": %ld,\n", item[i].count);
+	    printf("      \"first\": %.3f,\n", item[i].first);
+	    printf("      \"last\": %.3f\n    }", item[i].last);
+	}
+	else {
+	    printf("      \"count\": %ld,\n", item[i].count);
+	    printf("      \"records\": %ld\n    }", item[i].nrec);
+	}
+	printf("%s", i < top-1 ? ",\n" : "");
+    }
+    printf("\n  ],\n");
+    printf("  \"total\": %ld,\n", n);
+    lwpass();
+    for (i = 0; i < n; i++) {
+	SFREE(item[i].name);
+	SFREE(item[i].annotator);
+	SFREE(item[i].record);
+    }
+    SFREE(item);
+}
+
 void info(void)
 {
     char *info, *p;
@@ -546,10 +964,11 @@ void info(void)
 	lwfail("The '.hea' file could not be read");
 	return;
     }
+    lw_phase_begin("output");
     printf("{ \"info\":\n");
     printf("  { \"db\": %s,\n", p = strjson(db)); SFREE(p);
     printf("    \"record\": %s,\n", p = strjson(record)); SFREE(p);
-    printf("    \"tfreq\": %g,\n", tfreq);
+    printf("    \"tfreq\": %.15g,\n", tfreq);
     p = timstr(0);
     if (*p == '[') {
         printf("    \"start\": \"%s\",\n", mstimstr(0L));
@@ -572,7 +991,8 @@ void info(void)
 	printf("    \"signal\": [\n");
 	for (i = 0; i < nsig; i++) {
 	    printf("      { \"name\": %s,\n", p = strjson(sname[i])); SFREE(p);
-	    printf("        \"tps\": %g,\n", tfreq/(ffreq*s[i].spf));
+	    printf("        \"tps\": %.10g,\n",
+		   (double)tpf * rs_down[i] / (s[i].spf * rs_up[i]));
 	    if (s[i].units) {
 		printf("        \"units\": %s,\n", p = strjson(s[i].units));
 		SFREE(p);
@@ -602,143 +1022,900 @@ void info(void)
 	printf("    \"note\": null\n");
 
     printf("  },\n");
+    lw_phase_end("output");
+    print_timing("  \"timing\": ", ",\n");
+    print_alloc("  \"alloc\": ", ",\n");
     lwpass();
 }
 
+/* The annotation code table holds the mnemonic and description of each
+   annotation code, escaped for JSON, so that fetchannotations() does not need
+   to convert them for each annotation.  Since an annotation file can redefine
+   the mnemonics and descriptions, ann_table_update() checks the table after
+   each annotator is opened, and rebuilds any entries that have changed. */
+static struct {
+    char *mnemonic, *desc;	  /* as returned by annstr() and anndesc() */
+    char *jmnemonic, *jdesc;	  /* JSON quoted strings */
+    int ambiguous;		  /* nonzero if mnemonic is not unique */
+} ann_table[ACMAX + 1];
+
+void ann_table_update(void)
+{
+    char *p;
+    int changed = 0, j, k;
+
+    for (j = 0; j <= ACMAX; j++) {
+	p = annstr(j);
+	if (ann_table[j].jmnemonic == NULL || strcmp(p, ann_table[j].mnemonic)) {
+	    SSTRCPY(ann_table[j].mnemonic, p);
+	    SFREE(ann_table[j].jmnemonic);
+	    ann_table[j].jmnemonic = strjson(p);
+	    changed = 1;
+	}
+	if ((p = anndesc(j)) == NULL) p = "";
+	if (ann_table[j].jdesc == NULL || strcmp(p, ann_table[j].desc)) {
+	    SSTRCPY(ann_table[j].desc, p);
+	    SFREE(ann_table[j].jdesc);
+	    ann_table[j].jdesc = strjson(p);
+	}
+    }
+
+    /* Descriptions are not shown for ambiguous mnemonics. */
+    if (changed) {
+	for (j = 0; j <= ACMAX; j++)
+	    ann_table[j].ambiguous = 0;
+	for (j = 1; j < ACMAX; j++) {
+	    k = strann(ann_table[j].mnemonic);
+	    if (j != k && k > 0 && k < ACMAX)
+		ann_table[j].ambiguous = ann_table[k].ambiguous = 1;
+	}
+    }
+}
+
+void ann_table_free(void)
+{
+    int j;
+
+    for (j = 0; j <= ACMAX; j++) {
+	SFREE(ann_table[j].mnemonic);
+	SFREE(ann_table[j].desc);
+	SFREE(ann_table[j].jmnemonic);
+	SFREE(ann_table[j].jdesc);
+    }
+}
+
+/* Write an annotation (see fetchannotations()). */
+static void out_annotation(WFDB_Annotation *annot)
+{
+    char *p;
+
+    out_str("\n          { \"t\": ");
+    out_long((long)annot->time);
+    out_str(",\n            \"a\": ");
+    if (annot->anntyp >= 0 && annot->anntyp <= ACMAX)
+	out_str(ann_table[annot->anntyp].jmnemonic);
+    else {
+	out_str(p = strjson(annstr(annot->anntyp)));
+	SFREE(p);
+    }
+    out_str(",\n            \"s\": ");
+    out_long(annot->subtyp);
+    out_str(",\n            \"c\": ");
+    out_long(annot->chan);
+    out_str(",\n            \"n\": ");
+    out_long(annot->num);
+    if (annot->aux && *(annot->aux)) {
+	out_str(",\n            \"x\": ");
+	out_json((char *)annot->aux + 1);
+	out_str("\n          }");
+    }
+    else
+	out_str(",\n            \"x\": null\n          }");
+}
+
+/* Return the pathname of the header file of the current record, if the record
+   is local (not read from a web server), or NULL otherwise.  The result points
+   to a static buffer in the WFDB library. */
+static char *local_header(void)
+{
+    char *hea;
+    size_t n;
+
+    if ((hea = wfdbfile("hea", recpath)) == NULL || strstr(hea, "://") ||
+	(n = strlen(hea)) < 4 || strcmp(hea + n - 4, ".hea"))
+	return (NULL);
+    return (hea);
+}
+
+/* Open the columnar store for the record (see store.c), if it has one that is
+   no older than its header and matches it.  Return the open store, or
+   NULL. */
+static struct lw_store *open_store(void)
+{
+    char *hea, *path;
+    int n;
+    size_t len;
+    struct lw_store *st;
+    struct stat hs, ss;
+    FILE *hfile;
+
+    /* Stores are kept only for local records. */
+    if ((hea = local_header()) == NULL || (hfile = fopen(hea, "r")) == NULL)
+	return (NULL);
+    n = fstat(fileno(hfile), &hs);
+    fclose(hfile);
+    if (n != 0)
+	return (NULL);
+    len = strlen(hea);
+    SUALLOC(path, len + strlen(LW_STORE_SUFFIX), 1);
+    sprintf(path, "%.*s%s", (int)(len - 4), hea, LW_STORE_SUFFIX);
+    st = lw_store_open(path);
+    SFREE(path);
+    if (st == NULL)
+	return (NULL);
+    if (fstat(fileno(st->file), &ss) != 0 || ss.st_mtime < hs.st_mtime ||
+	st->nsig != nsig || st->freq != ffreq) {
+	lw_store_close(st);
+	return (NULL);
+    }
+    for (n = 0; n < nsig; n++)
+	if (st->sig[n].spf != s[n].spf || st->sig[n].nsamp != s[n].nsamp ||
+	    st->sig[n].cksum != s[n].cksum ||
+	    st->sig[n].adczero != s[n].adczero ||
+	    st->sig[n].baseline != s[n].baseline) {
+	    lw_store_close(st);
+	    return (NULL);
+	}
+    return (st);
+}
+
+/* Open the edit journal for annotator name, if there is one (see editlog.h),
+   and read its entries into ed, sorted for lw_merge_next().  The journal is
+   locked until it is closed, so that it cannot be compacted while the
+   annotation file is being opened.  Return the open journal, or NULL. */
+static FILE *open_journal(char *name, struct lw_edits *ed)
+{
+    char *hea, *path;
+    size_t n;
+    FILE *jfile;
+
+    /* Journals are kept only for local records. */
+    if ((hea = local_header()) == NULL)
+	return (NULL);
+    n = strlen(hea);
+    SUALLOC(path, n + strlen(name) + strlen(LW_JOURNAL_SUFFIX) + 2, 1);
+    sprintf(path, "%.*s.%s%s", (int)(n - 4), hea, name, LW_JOURNAL_SUFFIX);
+    if ((jfile = fopen(path, "r")) != NULL) {
+	flock(fileno(jfile), LOCK_SH);
+	lw_edits_read(ed, jfile, 0);
+	lw_edits_sort(ed);
+    }
+    SFREE(path);
+    return (jfile);
+}
+
+/* Read the next annotation, merging the journal if mp is not NULL. */
+static int next_annotation(struct lw_merge *mp, WFDB_Annotation *annot)
+{
+    return (mp ? lw_merge_next(mp, annot) : getann(0, annot));
+}
+
+/* While follow() is running, the position in each annotation file after the
+   last annotation sent (the time of that annotation, and the number of
+   annotations sent at that time), the file's size when it was last read, and
+   whether it has grown since then. */
+static struct {
+    WFDB_Time time;
+    long count;
+    off_t size;
+    int fd, grown;
+} afollow[NAMAX];
+
 int fetchannotations(void)
 {
-    int afirst = 1, i;
+    int afirst = 1, have_input, have_journal, i;
+    FILE *jfile;
     WFDB_Anninfo ai;
     WFDB_Time ta0, taf;
+    struct lw_edits ed = { NULL, 0, 0 };
+    struct lw_merge m, *mp;
 
     if (nann < 1) return (0);
-    if (tfreq != ffreq) {
-	ta0 = (WFDB_Time)(t0*tfreq/ffreq + 0.5);
-	taf = (WFDB_Time)(tf*tfreq/ffreq + 0.5);
-    }
-    else {
-	ta0 = t0;
-	taf = tf;
-    }
+    ta0 = t0 * tpf;
+    taf = following ? 0 : tf * tpf;
 
-    printf("  %c \"annotator\":\n    [", nosig > 0 ? ' ' : '{');  
+    printf("  %c \"annotator\":\n    [", (nosig > 0 && t0 < tf) ? ' ' : '{');
     setgvmode(WFDB_HIGHRES);
     for (i = 0; i < nann; i++) {
+	/* follow() sends only the annotations that have been appended to each
+	   annotation file, and does not merge the edit journal. */
+	if (following && !afollow[i].grown)
+	    continue;
+	if (following)
+	    ta0 = afollow[i].time;
 	ai.name = annotator[i];
 	ai.stat = WFDB_READ;
-	if (annopen(recpath, &ai, 1) >= 0) {
-	    char *p;
+	lw_phase_begin("annopen");
+	jfile = following ? NULL : open_journal(annotator[i], &ed);
+	have_input = (annopen(recpath, &ai, 1) >= 0);
+	if (have_journal = (jfile != NULL))
+	    fclose(jfile);	/* this also releases the lock */
+	if (have_input || have_journal) {
 	    int first = 1;
 	    WFDB_Annotation annot;
 	    unsigned char used[ACMAX + 1] = { 0 };
-	    int j, k;
+	    int j;
 
-	    if (ta0 > 0L) iannsettime(ta0);
+	    ann_table_update();
+	    if (have_input && ta0 > 0L) iannsettime(ta0);
+	    if (following)
+		for (j = afollow[i].count; j > 0 && getann(0, &annot) == 0; j--)
+		    ;
+	    lw_phase_end("annopen");
+	    lw_phase_begin("annread");
 	    if (!afirst) printf(",");
 	    else afirst = 0;
 	    printf("\n      { \"name\": \"%s\",\n", annotator[i]);
+	    if (have_journal)
+		printf("        \"journal\": true,\n");
 	    printf("        \"annotation\":\n");
 	    printf("        [");
-	    while ((getann(0, &annot) == 0) && (taf <= 0 || annot.time < taf)) {
-		if (!first) printf(",");
+
+	    /* Merge the journal (if any) with the annotation file.  The merge
+	       stops early if the annotation file is not in canonical order. */
+	    if (mp = have_journal ? &m : NULL)
+		lw_merge_start(mp, &ed, have_input, 0, (long long)ta0 << 16);
+	    while ((next_annotation(mp, &annot) == 0) &&
+		   (taf <= 0 || annot.time < taf)) {
+		if (!first) out_char(',');
 		else first = 0;
 		if (annot.anntyp > 0 && annot.anntyp <= ACMAX)
 		    used[annot.anntyp] = 1;
-		printf("\n          { \"t\": %ld,\n", (long)(annot.time));
-		printf("            \"a\": %s,\n",
-		       p = strjson(annstr(annot.anntyp)));
-		SFREE(p);
-		printf("            \"s\": %d,\n", annot.subtyp);
-		printf("            \"c\": %d,\n", annot.chan);
-		printf("            \"n\": %d,\n", annot.num);
-		if (annot.aux && *(annot.aux)) {
-		    printf("            \"x\": %s\n", p = strjson(annot.aux+1));
-		    SFREE(p);
+		out_annotation(&annot);
+		if (following && annot.time == afollow[i].time)
+		    afollow[i].count++;
+		else if (following) {
+		    afollow[i].time = annot.time;
+		    afollow[i].count = 1;
 		}
-		else
-		    printf("            \"x\": null\n");
-		printf("          }");
 	    }
+	    if (mp)
+		lw_merge_end(mp);
+	    out_flush();
 	    printf("\n        ],\n        \"description\":\n        {");
 
 	    /* Do not show descriptions for ambiguous mnemonics. */
-	    for (j = 1; j < ACMAX; j++) {
-		k = strann(annstr(j));
-		if (j != k && k > 0 && k < ACMAX)
-		    used[j] = used[k] = 0;
-	    }
 	    first = 1;
 	    for (j = 1; j <= ACMAX; j++) {
-		if (used[j] && (p = anndesc(j)) && p[0]) {
+		if (used[j] && !ann_table[j].ambiguous && ann_table[j].desc[0]) {
 		    if (!first) printf(",");
 		    else first = 0;
-		    printf("\n          %s: ", p = strjson(annstr(j)));;
-		    SFREE(p);
-		    printf("%s", p = strjson(anndesc(j)));
-		    SFREE(p);
+		    printf("\n          %s: %s", ann_table[j].jmnemonic,
+			   ann_table[j].jdesc);
 		}
 	    }
 	    printf("\n        }\n      }");
+	    lw_phase_end("annread");
 	}
+	else
+	    lw_phase_end("annopen");
+	lw_edits_free(&ed);
     }
     printf("\n    ]\n  }\n");
     return (1);
 }
 
-int fetchsignals(void)
+/* An annsummary request reads each of the requested annotation files once
+   (merging its edit journal, as for fetch), and returns the number of
+   annotations of each type, the times of the first and last of them, and
+   histograms of their times, so that the client can show an annotator's
+   palette and a timeline of its events without fetching the annotations.
+   The types are those of the client's palette (see askey() in lightwave.js):
+   the mnemonic, or the mnemonic and aux string, or (for a rhythm change) the
+   rhythm named in the aux string.  The histograms have 'bins' bins of equal
+   width, beginning at t0 and covering dt seconds, or the rest of the record if
+   dt is not given.  If the length of the record is unknown, the bins are
+   initially one second wide, and whenever an annotation falls beyond the last
+   bin, the width of the bins is doubled by merging adjacent pairs of them. */
+struct as_type {
+    char *name;		/* type (as above) */
+    long count;		/* number of annotations */
+    WFDB_Time first, last; /* times of the first and last of them (ticks) */
+    long *bin;		/* histogram, or NULL (see AS_MAXTYPES) */
+};
+
+static struct as_ann {
+    struct as_type *type;
+    int ntype;		/* number of types */
+    int hit;		/* index of the type last found by as_find() */
+    int code[ACMAX + 1];/* index of the type of each code without aux */
+    int journal;	/* nonzero if the edit journal was merged */
+    long count;		/* number of annotations */
+    long *bin;		/* histogram of all annotations */
+} as_ann[NAMAX];
+
+static int as_compare(const void *a, const void *b)
 {
-    int first = 1, framelen, i, imax, imin, j, *m, *mp, n;
-    WFDB_Calinfo cal;
-    WFDB_Sample **sb, **sp, *sbo, *spo, *v;
-    WFDB_Time t, ts0, tsf;
+    const struct as_type *x = a, *y = b;
 
-    /* Do nothing if no samples were requested. */ 
-    if (nosig < 1 || t0 >= tf) return (0);
+    if (x->count != y->count)
+	return (x->count > y->count ? -1 : 1);
+    return (strcmp(x->name, y->name));
+}
 
-    /* Open the signal calibration database. */
-    (void)calopen(NULL);
+/* Return the index of the type of annot in ap->type, adding the type if it
+   is new. */
+static int as_find(struct as_ann *ap, WFDB_Annotation *annot, int nbins)
+{
+    char *aux = NULL, *m, name[BUFSIZE];
+    int i, code = annot->anntyp;
+
+    if (annot->aux && *(annot->aux))
+	aux = (char *)annot->aux + 1;
+    else if (code >= 0 && code <= ACMAX && ap->code[code] >= 0)
+	return (ap->code[code]);
+    m = (code >= 0 && code <= ACMAX) ? ann_table[code].mnemonic : annstr(code);
+    if (aux == NULL)
+	snprintf(name, sizeof(name), "%s", m);
+    else if (strcmp(m, "+") == 0 && aux[0] == '(')
+	snprintf(name, sizeof(name), "%s", aux);
+    else
+	snprintf(name, sizeof(name), "%s:%s", m, aux);
+    if (ap->hit < ap->ntype && strcmp(ap->type[ap->hit].name, name) == 0)
+	return (ap->hit);
+    for (i = 0; i < ap->ntype && strcmp(ap->type[i].name, name); i++)
+	;
+    if (i == ap->ntype) {
+	SREALLOC(ap->type, i + 1, sizeof(struct as_type));
+	memset(&ap->type[i], 0, sizeof(struct as_type));
+	SSTRCPY(ap->type[i].name, name);
+	if (i < AS_MAXTYPES)
+	    SUALLOC(ap->type[i].bin, nbins, sizeof(long));
+	ap->ntype++;
+    }
+    if (aux == NULL && code >= 0 && code <= ACMAX)
+	ap->code[code] = i;
+    return (ap->hit = i);
+}
+
+/* Double the width of the n bins of histogram h by merging adjacent pairs of
+   them. */
+static void as_merge(long *h, int n)
+{
+    int i;
+
+    if (h == NULL) return;
+    for (i = 0; 2*i < n; i++)
+	h[i] = h[2*i] + (2*i + 1 < n ? h[2*i + 1] : 0L);
+    for ( ; i < n; i++)
+	h[i] = 0L;
+}
+
+static void as_print(long *h, int n)
+{
+    int i;
 
-    if (tfreq != ffreq) {
-	ts0 = (WFDB_Time)(t0*tfreq/ffreq + 0.5);
-	tsf = (WFDB_Time)(tf*tfreq/ffreq + 0.5);
+    if (h == NULL) {
+	out_str("null");
+	return;
+    }
+    out_char('[');
+    for (i = 0; i < n; i++) {
+	if (i) out_char(',');
+	out_long(h[i]);
+    }
+    out_char(']');
+}
+
+void annsummary(void)
+{
+    char *p;
+    int afirst = 1, have_input, i, j, k, nbins;
+    long b, tps;
+    FILE *jfile;
+    WFDB_Anninfo ai;
+    WFDB_Annotation annot;
+    WFDB_Time ta0, taf, width;
+    struct as_ann *ap;
+    struct lw_edits ed = { NULL, 0, 0 };
+    struct lw_merge m, *mp;
+
+    prep_signals();
+    prep_annotators();
+    if (nann < 1) {
+	lwfail("Your request did not specify an annotator");
+	return;
+    }
+    if ((p = get_param("bins")) == NULL || (nbins = atoi(p)) < 1)
+	nbins = AS_DEFBINS;
+    else if (nbins > AS_MAXBINS)
+	nbins = AS_MAXBINS;
+
+    /* Find the interval covered by the histograms, in ticks (the units of
+       annotation times in high-resolution mode). */
+    tps = (tpf > 0) ? tpf : 1;
+    if ((p = get_param("t0")) == NULL) p = "0";
+    if ((t0 = strtim(p)) < 0L) t0 = -t0;
+    ta0 = t0 * tps;
+    if ((p = get_param("dt")) && atof(p) > 0.)
+	taf = ta0 + (WFDB_Time)(atof(p) * tfreq + 0.5);
+    else if ((tf = strtim("e")) > t0)
+	taf = tf * tps;
+    else
+	taf = 0;	/* unknown */
+    if (taf > ta0)
+	width = (taf - ta0 + nbins - 1) / nbins;
+    else if ((width = (WFDB_Time)(tfreq + 0.5)) < 1)
+	width = 1;
+
+    setgvmode(WFDB_HIGHRES);
+    for (i = 0, ap = as_ann; i < nann; i++, ap++) {
+	ai.name = annotator[i];
+	ai.stat = WFDB_READ;
+	lw_phase_begin("annopen");
+	jfile = open_journal(annotator[i], &ed);
+	have_input = (annopen(recpath, &ai, 1) >= 0);
+	if (ap->journal = (jfile != NULL))
+	    fclose(jfile);	/* this also releases the lock */
+	lw_phase_end("annopen");
+	if (!have_input && !ap->journal) {
+	    ap->count = -1L;	/* not found, and omitted from the output */
+	    continue;
+	}
+	lw_phase_begin("annread");
+	ann_table_update();
+	for (j = 0; j <= ACMAX; j++)
+	    ap->code[j] = -1;
+	SUALLOC(ap->bin, nbins, sizeof(long));
+	if (have_input && ta0 > 0L) iannsettime(ta0);
+	if (mp = ap->journal ? &m : NULL)
+	    lw_merge_start(mp, &ed, have_input, 0, (long long)ta0 << 16);
+	while (next_annotation(mp, &annot) == 0 &&
+	       (taf <= 0 || annot.time < taf)) {
+	    struct as_type *tp;
+
+	    if (annot.time < ta0)
+		continue;
+	    while ((b = (annot.time - ta0) / width) >= nbins) {
+		for (k = 0; k <= i; k++) {
+		    as_merge(as_ann[k].bin, nbins);
+		    for (j = 0; j < as_ann[k].ntype; j++)
+			as_merge(as_ann[k].type[j].bin, nbins);
+		}
+		width *= 2;
+	    }
+	    j = as_find(ap, &annot, nbins);  /* this may move ap->type */
+	    tp = &ap->type[j];
+	    if (tp->count++ == 0L)
+		tp->first = annot.time;
+	    tp->last = annot.time;
+	    if (tp->bin)
+		tp->bin[b]++;
+	    ap->bin[b]++;
+	    ap->count++;
+	}
+	if (mp)
+	    lw_merge_end(mp);
+	lw_edits_free(&ed);
+	qsort(ap->type, ap->ntype, sizeof(struct as_type), as_compare);
+	lw_phase_end("annread");
+    }
+
+    lw_phase_begin("output");
+    printf("{ \"annsummary\":\n");
+    printf("  { \"t0\": %ld,\n", (long)ta0);
+    printf("    \"tf\": %ld,\n", (long)(ta0 + nbins * width));
+    printf("    \"bins\": %d,\n", nbins);
+    printf("    \"binwidth\": %ld,\n", (long)width);
+    printf("    \"annotator\": [");
+    for (i = 0, ap = as_ann; i < nann; i++, ap++) {
+	if (ap->count < 0L)
+	    continue;
+	if (!afirst) printf(",");
+	else afirst = 0;
+	printf("\n      { \"name\": %s,\n", p = strjson(annotator[i]));
+	SFREE(p);
+	if (ap->journal)
+	    printf("        \"journal\": true,\n");
+	printf("        \"count\": %ld,\n", ap->count);
+	printf("        \"density\": ");
+	as_print(ap->bin, nbins);
+	out_flush();
+	printf(",\n        \"anntype\": [");
+	for (j = 0; j < ap->ntype; j++) {
+	    struct as_type *tp = &ap->type[j];
+
+	    printf("%s\n          { \"type\": %s,\n", j ? "," : "",
+		   p = strjson(tp->name));
+	    SFREE(p);
+	    printf("            \"count\": %ld,\n", tp->count);
+	    printf("            \"first\": %ld,\n", (long)tp->first);
+	    printf("            \"last\": %ld,\n", (long)tp->last);
+	    printf("            \"density\": ");
+	    as_print(tp->bin, nbins);
+	    out_flush();
+	    printf("\n          }");
+	}
+	printf("\n        ]\n      }");
+    }
+    printf("\n    ]\n  },\n");
+    lw_phase_end("output");
+    lwpass();
+
+    for (i = 0, ap = as_ann; i < nann; i++, ap++) {
+	for (j = 0; j < ap->ntype; j++) {
+	    SFREE(ap->type[j].name);
+	    SFREE(ap->type[j].bin);
+	}
+	SFREE(ap->type);
+	SFREE(ap->bin);
+    }
+}
+
+/* Read frames t0 through tf-1 into the frame buffer v, and append each sample
+   of each selected signal to that signal's buffer (sp[n] points to the next
+   free element of the buffer for signal n).  The frame map, m, gives the
+   signal number of each sample in a frame, or -1 for samples of signals that
+   were not selected;  imin and imax are the indices of the first and last
+   selected samples in the frame. */
+void read_frames(WFDB_Sample *v, int *m, int imin, int imax, WFDB_Sample **sp)
+{
+    lw_phase_begin("seek");
+    isigsettime(t0);
+    lw_phase_end("seek");
+    lw_phase_begin("read");
+    read_next_frames(v, m, imin, imax, sp, tf - t0);
+    lw_phase_end("read");
+}
+
+/* Read up to n frames, starting at the current position in the record, as for
+   read_frames().  Return the number of frames read. */
+long read_next_frames(WFDB_Sample *v, int *m, int imin, int imax,
+		      WFDB_Sample **sp, long n)
+{
+    int i, *mp, k;
+    long t;
+
+    for (t = 0; t < n && getframe(v) > 0; t++)
+	for (i = imin, mp = m + imin; i <= imax; i++, mp++)
+	    if ((k = *mp) >= 0) *(sp[k]++) = v[i];
+    return (t);
+}
+
+/* Print the samples from sb up to (but not including) se, as the first sample
+   followed by first differences.  (fetchsignals() formats samples in the same
+   way, using the functions in pipeline.c.) */
+void print_samples(WFDB_Sample *sb, WFDB_Sample *se)
+{
+    int delta, prev;
+    WFDB_Sample *sbo, *spo;
+
+    for (sbo = sb, prev = 0, spo = se-1; sbo < spo; sbo++) {
+	delta = *sbo - prev;
+	printf("%d,", delta);
+	prev = *sbo;
+    }
+    printf("%d", *sbo - prev);
+}
+
+/* The frames needed by fetchsignals() are read by decode_signals(), which
+   runs in a thread of its own (see pipeline.c) while fetchsignals() writes the
+   samples.  The state shared by the two functions is kept in a struct decoder,
+   and the times spent by decode_signals() in each phase of the request are
+   recorded there, since only one thread can use lw_phase_begin() and
+   lw_phase_end(). */
+struct decoder {
+    WFDB_Sample **sb;		/* buffers for each signal */
+    WFDB_Sample **sp;		/* next free element of each buffer */
+    WFDB_Sample *v;		/* frame buffer */
+    int *m, imin, imax;		/* frame map (see read_frames()) */
+    struct lw_resampler *rs;	/* filters for signals to be resampled */
+    struct lw_store *store;	/* the record's store, or NULL */
+    WFDB_Time ta, tb;		/* frames to be read */
+    double tseek, tread, tresample;	/* times spent in each phase (ms) */
+};
+
+/* While play() is streaming, the record's store (if any) stays open, and
+   tnext is the frame at which the signals are positioned after the last
+   window was read (or -1 if unknown), so that the next window can be read
+   without seeking. */
+static struct lw_store *play_store;
+static WFDB_Time tnext = -1;
+
+/* Return the number of samples of signal n in the requested interval that
+   have been read so far, and set *start to the index in the buffer of the
+   first of them. */
+static long samples_read(struct decoder *d, int n, long *start)
+{
+    long k;
+
+    *start = (t0 - d->ta) * s[n].spf;
+    if ((k = (d->sp[n] - d->sb[n]) - *start) > (tf - t0) * s[n].spf)
+	k = (tf - t0) * s[n].spf;
+    return (k > 0 ? k : 0);
+}
+
+/* Read the selected signals from the record's store, one after another,
+   passing the samples of those that are not to be resampled to the pipeline
+   after each chunk. */
+static void read_store(struct lw_pipeline *p, struct decoder *d)
+{
+    struct lw_store *st = d->store;
+    struct lw_store_chunk *c;
+    double t = lw_timing_elapsed();
+    int n, spfmax;
+    long j, k, start;
+    WFDB_Sample *cb;
+    WFDB_Time ta, tb;
+
+    for (n = spfmax = 0; n < nsig; n++)
+	if (s[n].spf > spfmax) spfmax = s[n].spf;
+    SUALLOC(cb, st->chunk * spfmax, sizeof(WFDB_Sample));
+    tb = (d->tb < st->nframes) ? d->tb : st->nframes;
+    for (n = 0; n < nsig; n++) {
+	if (sigmap[n] < 0)
+	    continue;
+	for (j = d->ta / st->chunk; j * st->chunk < tb; j++) {
+	    if (lw_store_read(st, n, j, cb) < 0)
+		break;
+	    /* Copy the samples of the frames in the chunk from ta to tb. */
+	    c = lw_store_chunk(st, n, j);
+	    ta = (c->t0 > d->ta) ? c->t0 : d->ta;
+	    k = ((c->tf < tb) ? c->tf : tb) - ta;
+	    memcpy(d->sp[n], cb + (ta - c->t0) * s[n].spf,
+		   k * s[n].spf * sizeof(WFDB_Sample));
+	    d->sp[n] += k * s[n].spf;
+	    if (d->rs[n].h == NULL) {
+		k = samples_read(d, n, &start);
+		lw_pipe_lock(p);
+		lw_pipe_update(p, n, d->sb[n] + start, k, 0);
+		lw_pipe_unlock(p);
+	    }
+	}
+	if (d->rs[n].h == NULL) {
+	    k = samples_read(d, n, &start);
+	    lw_pipe_lock(p);
+	    lw_pipe_update(p, n, d->sb[n] + start, k, 1);
+	    lw_pipe_unlock(p);
+	}
+    }
+    SFREE(cb);
+    d->tread = lw_timing_elapsed() - t;
+}
+
+/* Read the frames from the record's signal files in blocks, passing the
+   samples of the signals that are not to be resampled to the pipeline after
+   each block. */
+static void read_signal_files(struct lw_pipeline *p, struct decoder *d)
+{
+    double t;
+    int n;
+    long k, start;
+    WFDB_Time ta, tb;
+
+    t = lw_timing_elapsed();
+    if (!playing || d->ta != tnext)
+	isigsettime(d->ta);
+    d->tseek = lw_timing_elapsed() - t;
+
+    tnext = -1;
+    for (ta = d->ta; ta < d->tb; ta = tb) {
+	tb = (d->tb - ta > DECODE_BLOCK) ? ta + DECODE_BLOCK : d->tb;
+	t = lw_timing_elapsed();
+	k = read_next_frames(d->v, d->m, d->imin, d->imax, d->sp, tb - ta);
+	d->tread += lw_timing_elapsed() - t;
+	lw_pipe_lock(p);
+	for (n = 0; n < nsig; n++)
+	    if (sigmap[n] >= 0 && d->rs[n].h == NULL) {
+		long nr = samples_read(d, n, &start);
+
+		lw_pipe_update(p, n, d->sb[n] + start, nr, k < tb - ta);
+	    }
+	lw_pipe_unlock(p);
+	if (k < tb - ta) break;	/* end of record */
+    }
+    if (ta >= d->tb)
+	tnext = d->tb;
+}
+
+static void decode_signals(struct lw_pipeline *p, void *arg)
+{
+    struct decoder *d = arg;
+    double t;
+    int n;
+    long k, nout, start;
+    WFDB_Sample *ob;
+
+    if (d->store)
+	read_store(p, d);
+    else
+	read_signal_files(p, d);
+
+    /* Resample the other signals, now that all of their samples (including
+       those needed by the filters on either side of the interval) are in. */
+    t = lw_timing_elapsed();
+    for (n = 0; n < nsig; n++)
+	if (sigmap[n] >= 0 && d->rs[n].h) {
+	    k = samples_read(d, n, &start);
+	    nout = (k * d->rs[n].up + d->rs[n].down - 1) / d->rs[n].down;
+	    SUALLOC(ob, nout + 1, sizeof(WFDB_Sample));
+	    lw_resample(&d->rs[n], d->sb[n], d->sp[n] - d->sb[n], start, ob,
+			nout);
+	    SFREE(d->sb[n]);
+	    d->sb[n] = ob;
+	    d->sp[n] = ob + nout;
+	    lw_pipe_lock(p);
+	    lw_pipe_update(p, n, ob, nout, 1);
+	    lw_pipe_unlock(p);
+	}
+    d->tresample = lw_timing_elapsed() - t;
+}
+
+/* If the client appears to be reading the record sequentially (see
+   readahead.c), ask the kernel to start reading the parts of the signal files
+   that the next windows will need.  This is done only for local records, and
+   only for signal files in formats with a fixed number of bytes per frame;
+   the offsets ignore any prolog at the beginning of a signal file, which is
+   rare (and small) enough not to matter for a hint. */
+static void readahead_signals(void)
+{
+    char *dir = NULL, *hea, *path = NULL;
+    double b, fbytes;
+    int g, k, n;
+    long ta, tb;
+
+    if ((k = lw_ra_note(recpath, t0, tf)) == 0 ||
+	(hea = local_header()) == NULL)
+	return;
+    if (k > 0) {
+	ta = tf;
+	tb = tf + k * (tf - t0);
     }
     else {
-	ts0 = t0;
-	tsf = tf;
+	ta = t0 + k * (tf - t0);
+	tb = t0;
+	if (ta < 0) ta = 0;
+    }
+    SSTRCPY(dir, hea);
+    if (path = strrchr(dir, '/')) *(path+1) = '\0';
+    else *dir = '\0';
+    path = NULL;
+    for (n = 0; n < nsig; n = g) {
+	/* Signals n through g-1 are stored in the same file. */
+	for (g = n, fbytes = 0.; g < nsig && s[g].group == s[n].group; g++) {
+	    if ((b = lw_ra_sample_bytes(s[g].fmt)) == 0.) fbytes = -1.;
+	    if (fbytes >= 0.) fbytes += b * s[g].spf;
+	}
+	if (fbytes > 0. && s[n].fname && s[n].fname[0] != '/' &&
+	    strcmp(s[n].fname, "-")) {
+	    SALLOC(path, strlen(dir) + strlen(s[n].fname) + 1, 1);
+	    sprintf(path, "%s%s", dir, s[n].fname);
+	    lw_ra_hint(path, fbytes, ta, tb, k);
+	}
     }
+    SFREE(path);
+    SFREE(dir);
+}
 
-    /* Allocate buffers and buffer pointers for each selected signal. */
-    SUALLOC(sb, nsig, sizeof(WFDB_Sample *));
-    SUALLOC(sp, nsig, sizeof(WFDB_Sample *));
+/* If maxerr=E was requested, return an array of the error bounds for coding
+   each signal (see codec.c), in ADC units.  E is in ADC units, or in the
+   physical units of each signal if maxerrunits=phys was also requested.
+   Return NULL if the samples are to be sent exactly, as first differences. */
+static int *prep_maxerr(void)
+{
+    char *p;
+    double e, g;
+    int *maxerr = NULL, n, phys;
+
+    if ((p = get_param("maxerr")) == NULL || (e = atof(p)) < 0.)
+	return (NULL);
+    phys = (p = get_param("maxerrunits")) && strcmp(p, "phys") == 0;
+    SUALLOC(maxerr, nsig, sizeof(int));
+    for (n = 0; n < nsig; n++) {
+	g = (phys && s[n].gain) ? s[n].gain : phys ? WFDB_DEFGAIN : 1.;
+	maxerr[n] = (e * g < LW_CODE_MAXERR) ? (int)(e * g) : LW_CODE_MAXERR;
+    }
+    return (maxerr);
+}
+
+int fetchsignals(void)
+{
+    double *scale;
+    int first = 1, framelen, i, j, n, resampling = 0, *maxerr;
+    long k, *maxsamp;
+    struct decoder d;
+    struct lw_pipeline pipe;
+    WFDB_Calinfo cal;
+    WFDB_Time ts0, tsf;
+
+    /* Do nothing if no samples were requested. */ 
+    if (nosig < 1 || t0 >= tf) return (0);
+
+    ts0 = t0 * tpf;
+    tsf = tf * tpf;
+
+    /* Set up a filter for each signal to be resampled, and find the number of
+       frames needed on each side of the requested interval by the filters. */
+    memset(&d, 0, sizeof(d));
+    d.store = playing ? play_store : following ? NULL : open_store();
+    SUALLOC(d.rs, nsig, sizeof(struct lw_resampler));
+    for (n = 0, k = 0; n < nsig; n++)
+	if (sigmap[n] >= 0 && rs_up[n] != rs_down[n]) {
+	    if (lw_resample_init(&d.rs[n], rs_up[n], rs_down[n]) < 0) {
+		rs_up[n] = rs_down[n] = 1;	/* send the samples as they are */
+		continue;
+	    }
+	    resampling = 1;
+	    i = (lw_resample_margin(&d.rs[n]) + s[n].spf - 1) / s[n].spf;
+	    if (i > k) k = i;
+	}
+    d.ta = (t0 > k) ? t0 - k : 0;
+    d.tb = tf + k;
+
+    /* Allocate buffers and buffer pointers for each selected signal, and find
+       the largest number of samples of each to be written. */
+    SUALLOC(d.sb, nsig, sizeof(WFDB_Sample *));
+    SUALLOC(d.sp, nsig, sizeof(WFDB_Sample *));
+    SUALLOC(maxsamp, nsig, sizeof(long));
     for (n = framelen = 0; n < nsig; framelen += s[n++].spf)
 	if (sigmap[n] >= 0) {
-	    SUALLOC(sb[n], (int)((tf-t0)*s[n].spf + 0.5), sizeof(WFDB_Sample));
-	    sp[n] = sb[n];
+	    SUALLOC(d.sb[n], (d.tb-d.ta)*s[n].spf, sizeof(WFDB_Sample));
+	    d.sp[n] = d.sb[n];
+	    maxsamp[n] = (tf-t0)*s[n].spf;
+	    if (d.rs[n].h)
+		maxsamp[n] = (maxsamp[n] * d.rs[n].up + d.rs[n].down - 1)
+		    / d.rs[n].down;
 	}
     /* Allocate a frame buffer and construct the frame map. */
-    SUALLOC(v, framelen, sizeof(WFDB_Sample));  /* frame buffer */
-    SUALLOC(m, framelen, sizeof(int));	    /* frame map */
+    SUALLOC(d.v, framelen, sizeof(WFDB_Sample));  /* frame buffer */
+    SUALLOC(d.m, framelen, sizeof(int));	  /* frame map */
     for (i = n = 0; n < nsig; n++) {
 	for (j = 0; j < s[n].spf; j++)
-	    m[i++] = sigmap[n];
+	    d.m[i++] = sigmap[n];
     }
-    for (imax = framelen-1; imax > 0 && m[imax] < 0; imax--)
+    for (d.imax = framelen-1; d.imax > 0 && d.m[d.imax] < 0; d.imax--)
 	;
-    for (imin = 0; imin < imax && m[imin] < 0; imin++)
+    for (d.imin = 0; d.imin < d.imax && d.m[d.imin] < 0; d.imin++)
 	;
 
-    /* Fill the buffers. */
-    isigsettime(t0);
-    for (t = t0; t < tf && getframe(v) > 0; t++)
-	for (i = imin, mp = m + imin; i <= imax; i++, mp++)
-	    if ((n = *mp) >= 0) *(sp[n]++) = v[i];
-
-    /* Generate output. */
+    /* Look up the scale of each selected signal in the signal calibration
+       database (before the decoder starts, since it uses the WFDB library). */
+    lw_phase_begin("cal");
+    SUALLOC(scale, nsig, sizeof(double));
+    (void)calopen(NULL);
+    for (n = 0; n < nsig; n++) {
+	if (sigmap[n] >= 0) {
+	    if (getcal(sname[n], s[n].units, &cal) == 0)
+		scale[n] = cal.scale;
+	    else
+		scale[n] = 1.;
+	}
+    }
+    flushcal();
+    lw_phase_end("cal");
+
+    /* Start reading, and generate output as the samples are formatted. */
+    lw_phase_add("seek", 0.);
+    lw_phase_add("read", 0.);
+    if (resampling) lw_phase_add("resample", 0.);
+    maxerr = prep_maxerr();
+    lw_pipe_start(&pipe, nsig, maxsamp, maxerr, lw_pipe_nencoders(),
+		  decode_signals, &d);
+    lw_phase_begin("output");
     printf("  { \"signal\":\n    [\n");  
+
+    /* If there is more than one chunk to be written, send the headers now,
+       so that each chunk reaches the client as soon as it has been written
+       (see lw_pipe_write()), rather than being held back with the first part
+       of the response (see cgi.c).  The Server-Timing header then omits the
+       phases that follow. */
+    for (n = 0, k = 0L; n < nsig; n++)
+	if (sigmap[n] >= 0) k += maxsamp[n];
+    if (k > LW_PIPE_CHUNK)
+	cgi_flush_output();
     for (n = 0; n < nsig; n++) {
 	if (sigmap[n] >= 0) {
 	    char *p;
-	    int delta, prev; 
 
  	    if (!first) printf(",\n");
 	    else first = 0;
@@ -754,42 +1931,417 @@ int fetchsignals(void)
 	    printf("        \"gain\": %g,\n",
 		   s[n].gain ? s[n].gain : WFDB_DEFGAIN);
 	    printf("        \"base\": %d,\n", s[n].baseline);
-	    printf("        \"tps\": %d,\n", (int)(tfreq/(ffreq*s[n].spf)+0.5));
-	    if (getcal(sname[n], s[n].units, &cal) == 0)
-		printf("        \"scale\": %g,\n", cal.scale);
-	    else
-		printf("        \"scale\": 1,\n");
-	    printf("        \"samp\": [ ");
-	    for (sbo = sb[n], prev = 0, spo = sp[n]-1; sbo < spo; sbo++) {
-		delta = *sbo - prev;
-		printf("%d,", delta);
-		prev = *sbo;
+	    printf("        \"tps\": %.10g,\n",
+		   (double)tpf * rs_down[n] / (s[n].spf * rs_up[n]));
+	    printf("        \"scale\": %g,\n", scale[n]);
+	    if (maxerr) {
+		printf("        \"code\": [ ");
+		nsamples += lw_pipe_write(&pipe, n, stdout);
+		printf(" ],\n        \"maxerr\": %d\n      }",
+		       lw_pipe_error(&pipe, n));
+	    }
+	    else {
+		printf("        \"samp\": [ ");
+		nsamples += lw_pipe_write(&pipe, n, stdout);
+		printf(" ]\n      }");
 	    }
-	    printf("%d ]\n      }", *sbo - prev);
 	}
     }
     printf("\n    ]%s", nann ? ",\n" : "\n  }\n");
-    flushcal();
-    for (n = 0; n < nsig; n++)
-	SFREE(sb[n]);
-    SFREE(sb);
-    SFREE(sp);
-    SFREE(v);
-    SFREE(m);
+    lw_phase_end("output");
+    lw_pipe_end(&pipe);
+    lw_phase_add("seek", d.tseek);
+    lw_phase_add("read", d.tread);
+    if (resampling) lw_phase_add("resample", d.tresample);
+    if (d.store == NULL && !following)
+	readahead_signals();
+    else if (d.store && !playing)
+	lw_store_close(d.store);
+
+    for (n = 0; n < nsig; n++) {
+	SFREE(d.sb[n]);
+	lw_resample_free(&d.rs[n]);
+    }
+    SFREE(d.rs);
+    SFREE(d.sb);
+    SFREE(d.sp);
+    SFREE(d.v);
+    SFREE(d.m);
+    SFREE(maxsamp);
+    SFREE(maxerr);
+    SFREE(scale);
     return (1);	/* output was written */
 }
 
 void fetch(void)
 {
+    char *error;
+
     prep_signals();
     if (nsig > 0) map_signals();
     prep_annotators();
     prep_times();
+    if (error = prep_resample()) {
+	lwfail(error);
+	return;
+    }
     printf("{ \"fetch\":\n");
     if ((fetchsignals() + fetchannotations()) == 0) printf("null");
+    print_timing(",\n  \"timing\": ", "\n");
+    print_alloc(",\n  \"alloc\": ", "\n");
     printf("}\n");
 }
 
+/* Write the response to a fetch request for the current window (t0 to tf) to
+   a buffer, and then copy it to the output on one line, and send it.  The
+   newlines in fetch output appear only between tokens (strings are escaped),
+   so they can be dropped, along with the indentation that follows them.
+   Return 0 if successful, or -1 if the buffer could not be allocated. */
+static int write_fetch_line(void)
+{
+    char *line = NULL, *p, *q;
+    size_t len;
+    FILE *ofile = stdout;
+
+    if ((stdout = open_memstream(&line, &len)) == NULL) {
+	stdout = ofile;
+	return (-1);
+    }
+    printf("{ \"fetch\": ");
+    if ((fetchsignals() + fetchannotations()) == 0) printf("null");
+    printf(" }");
+    fclose(stdout);
+    stdout = ofile;
+    for (p = q = line; *p; p++) {
+	if (*p == '\n')
+	    while (p[1] == ' ') p++;
+	else
+	    *q++ = *p;
+    }
+    *q++ = '\n';
+    fwrite(line, 1, q - line, stdout);
+    free(line);
+    cgi_flush_output();
+    return (0);
+}
+
+/* Stream successive windows of dt seconds, beginning at t0, as newline-
+   delimited JSON:  each line is the response to a fetch request for the next
+   window, in the format written by fetch(), without the newlines.  Playback
+   of the first window is taken to begin when the request arrives, and window k
+   is sent when the playback (at the requested speed) is no more than the lead
+   (in seconds) behind it, so that the client has each window before it is
+   needed without the server getting far ahead of the client.  The stream ends
+   at the end of the record, or after dur seconds of the record if dur is
+   given, or when the client closes the connection (SIGPIPE). */
+void play(void)
+{
+    char *error, *p;
+    double lead, speed, wait;
+    struct timespec start, now, ts;
+    WFDB_Time tend, tstart;
+
+    if (get_param("callback")) {
+	lwfail("Streaming requests cannot be made using JSONP");
+	return;
+    }
+    prep_signals();
+    if (nsig > 0) map_signals();
+    prep_annotators();
+    prep_times();
+    if (error = prep_resample()) {
+	lwfail(error);
+	return;
+    }
+    if ((p = get_param("speed")) == NULL || (speed = atof(p)) <= 0.)
+	speed = 1.;
+    if ((p = get_param("lead")) == NULL || (lead = atof(p)) < 0.)
+	lead = 1.;
+    if (lead > PLAY_MAXLEAD) lead = PLAY_MAXLEAD;
+    if ((tend = strtim("e")) < 0L) tend = -tend;
+    if ((p = get_param("dur")) && atof(p) > 0. &&
+	(tend <= 0L || t0 + atof(p) * ffreq < tend))
+	tend = t0 + (WFDB_Time)(atof(p) * ffreq);
+    if (nosig + nann < 1 || dt < 1 || t0 >= tend) {
+	lwfail("Your request did not specify anything to play");
+	return;
+    }
+
+    playing = 1;
+    play_store = open_store();
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (tstart = t0; t0 < tend; t0 = tf, tf = t0 + dt) {
+	if (tf > tend) tf = tend;
+
+	/* Wait until this window is due. */
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	wait = (t0 - tstart) / (ffreq * speed) - lead
+	    - (now.tv_sec - start.tv_sec) - (now.tv_nsec - start.tv_nsec)*1e-9;
+	if (wait > 0.) {
+	    ts.tv_sec = (time_t)wait;
+	    ts.tv_nsec = (long)((wait - ts.tv_sec) * 1e9);
+	    nanosleep(&ts, NULL);
+	}
+
+	if (write_fetch_line() < 0)
+	    break;
+    }
+    if (play_store)
+	lw_store_close(play_store);
+    playing = 0;
+}
+
+/* While follow() is running, the signal files of the record are kept open, so
+   that the number of frames in them can be found from their sizes (see
+   frames_available()). */
+static struct {
+    int fd;
+    double fbytes;	/* bytes per frame */
+    long offset;	/* bytes preceding the first frame */
+} *sfollow;
+static int nsfollow;
+
+/* Watch the directory containing the file named by path, so that follow() is
+   woken when any file in it is written. */
+static void watch_dir(int ifd, char *path)
+{
+    char *dir = NULL, *p;
+
+    SSTRCPY(dir, path);
+    if (p = strrchr(dir, '/')) *(p+1) = '\0';
+    else strcpy(dir, ".");
+    inotify_add_watch(ifd, dir, IN_MODIFY | IN_CLOSE_WRITE | IN_CREATE |
+		      IN_MOVED_TO);
+    SFREE(dir);
+}
+
+/* Open and watch the signal files of the record, for follow().  Return 0 if
+   successful, or -1 if the record has more than one segment, or has a signal
+   file in a format without a fixed number of bytes per frame.  The header is
+   read once more here, for the byte offsets of the signal files (which the
+   WFDB library does not report), in the same way as by readahead_signals(). */
+static int follow_signal_files(int ifd)
+{
+    char *dir = NULL, *hea, *line = NULL, *path = NULL, *p, fmt[64],
+	name[MFNLEN];
+    double b, fbytes;
+    int fd, g, i, n;
+    long *offset;
+    size_t len = 0;
+    FILE *hfile;
+
+    if (nsig < 1 || (hea = local_header()) == NULL ||
+	(hfile = fopen(hea, "r")) == NULL)
+	return (-1);
+    SUALLOC(offset, nsig, sizeof(long));
+    for (i = -1; i < nsig && getline(&line, &len, hfile) > 0; ) {
+	if (sscanf(line, "%1023s %63s", name, fmt) < 1 || name[0] == '#')
+	    continue;
+	if (i++ < 0) {		/* the record line */
+	    if (strchr(name, '/')) break;	/* a multi-segment record */
+	}
+	else if (p = strchr(fmt, '+'))
+	    offset[i-1] = atol(p+1);
+    }
+    fclose(hfile);
+    free(line);
+    SSTRCPY(dir, hea);
+    if (p = strrchr(dir, '/')) *(p+1) = '\0';
+    else *dir = '\0';
+    SUALLOC(sfollow, nsig, sizeof(*sfollow));
+    for (n = 0; i == nsig && n < nsig; n = g) {
+	/* Signals n through g-1 are stored in the same file. */
+	for (g = n, fbytes = 0.; g < nsig && s[g].group == s[n].group; g++) {
+	    if ((b = lw_ra_sample_bytes(s[g].fmt)) == 0.) fbytes = -1.;
+	    if (fbytes >= 0.) fbytes += b * s[g].spf;
+	}
+	if (fbytes <= 0. || s[n].fname == NULL || strcmp(s[n].fname, "-") == 0)
+	    break;
+	SALLOC(path, strlen(dir) + strlen(s[n].fname) + 1, 1);
+	sprintf(path, "%s%s", s[n].fname[0] == '/' ? "" : dir, s[n].fname);
+	if ((fd = open(path, O_RDONLY)) < 0)
+	    break;
+	watch_dir(ifd, path);
+	sfollow[nsfollow].fd = fd;
+	sfollow[nsfollow].fbytes = fbytes;
+	sfollow[nsfollow].offset = offset[n];
+	nsfollow++;
+    }
+    SFREE(path);
+    SFREE(dir);
+    SFREE(offset);
+    if (n < nsig) {
+	while (nsfollow > 0)
+	    close(sfollow[--nsfollow].fd);
+	return (-1);
+    }
+    return (0);
+}
+
+/* Return the number of complete frames in the signal files, or -1 if it
+   cannot be found. */
+static WFDB_Time frames_available(void)
+{
+    int i;
+    struct stat st;
+    WFDB_Time n, nmin = -1;
+
+    for (i = 0; i < nsfollow; i++) {
+	if (fstat(sfollow[i].fd, &st) != 0)
+	    return (-1);
+	n = (st.st_size > sfollow[i].offset) ?
+	    (WFDB_Time)((st.st_size - sfollow[i].offset) / sfollow[i].fbytes) : 0;
+	if (nmin < 0 || n < nmin) nmin = n;
+    }
+    return (nmin);
+}
+
+/* Mark the annotation files that have grown since they were last read by
+   follow(), opening (and watching) any that did not exist before.  Return the
+   number of files that have grown. */
+static int annotations_grown(int ifd)
+{
+    char *p;
+    int i, n = 0;
+    struct stat st;
+
+    for (i = 0; i < nann; i++) {
+	if (afollow[i].fd < 0 && (p = wfdbfile(annotator[i], recpath)) &&
+	    strstr(p, "://") == NULL &&
+	    (afollow[i].fd = open(p, O_RDONLY)) >= 0)
+	    watch_dir(ifd, p);
+	if (afollow[i].fd >= 0 && fstat(afollow[i].fd, &st) == 0 &&
+	    st.st_size != afollow[i].size) {
+	    afollow[i].size = st.st_size;
+	    afollow[i].grown = 1;
+	}
+	n += afollow[i].grown;
+    }
+    return (n);
+}
+
+/* Stream the signals and annotations that are appended to a local record
+   while it is being written, as newline-delimited JSON in the format written
+   by play().  The stream begins at t0, or if t0 is not given, dt seconds
+   before the end of the signals when the request arrives.  The header is read
+   only at the beginning;  after that, the length of the record is found from
+   the sizes of its signal files, and the directories containing its files are
+   watched (using inotify), so that each line is sent as soon as possible
+   (but no more often than every FOLLOW_INTERVAL seconds) after the record is
+   written.  Each line contains the frames written since the previous line
+   (up to dt seconds of them), and the annotations appended to each annotation
+   file since it was last read.  The stream ends after dur seconds (no more
+   than FOLLOW_MAXDUR), or after FOLLOW_MAXIDLE seconds without new data, or
+   when the client closes the connection (SIGPIPE). */
+void follow(void)
+{
+    char ebuf[4096]
+	__attribute__ ((aligned(__alignof__(struct inotify_event))));
+    char *error, *hea, *p;
+    double dur, elapsed, tsent = 0., wait;
+    int grown, i, ifd, tail;
+    struct pollfd pfd;
+    struct timespec start, now, ts;
+    WFDB_Time tavail = 0;
+
+    if (get_param("callback")) {
+	lwfail("Streaming requests cannot be made using JSONP");
+	return;
+    }
+    tail = (get_param("t0") == NULL);
+    prep_signals();
+    if (nsig > 0) map_signals();
+    prep_annotators();
+    prep_times();
+    if (error = prep_resample()) {
+	lwfail(error);
+	return;
+    }
+    if ((p = get_param("dur")) == NULL || (dur = atof(p)) <= 0. ||
+	dur > FOLLOW_MAXDUR)
+	dur = FOLLOW_MAXDUR;
+    if (nosig + nann < 1 || (nosig > 0 && dt < 1)) {
+	lwfail("Your request did not specify anything to follow");
+	return;
+    }
+    if ((hea = local_header()) == NULL || (ifd = inotify_init1(0)) < 0) {
+	lwfail("This record cannot be followed");
+	return;
+    }
+    watch_dir(ifd, hea);
+    if (follow_signal_files(ifd) < 0 && nosig > 0) {
+	lwfail("Signals can be followed only in single-segment records in"
+	       " formats with a fixed number of bytes per frame");
+	close(ifd);
+	return;
+    }
+
+    following = 1;
+    if (tail && (tavail = frames_available()) > 0)
+	t0 = (tavail > dt) ? tavail - dt : 0;
+    for (i = 0; i < nann; i++) {
+	afollow[i].time = t0 * tpf;
+	afollow[i].count = 0;
+	afollow[i].size = 0;
+	afollow[i].fd = -1;
+	afollow[i].grown = 0;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (;;) {
+	/* Send whatever has been written since the last line, in windows of
+	   no more than dt. */
+	grown = annotations_grown(ifd);
+	do {
+	    tf = t0;
+	    if (nosig > 0 && (tavail = frames_available()) > t0)
+		tf = (tavail - t0 > dt) ? t0 + dt : tavail;
+	    if (tf == t0 && grown == 0)
+		break;
+	    if (write_fetch_line() < 0)
+		goto done;
+	    for (i = grown = 0; i < nann; i++)
+		afollow[i].grown = 0;
+	    t0 = tf;
+	    clock_gettime(CLOCK_MONOTONIC, &now);
+	    tsent = (now.tv_sec - start.tv_sec)
+		+ (now.tv_nsec - start.tv_nsec)*1e-9;
+	} while (tavail > t0);
+
+	/* Wait for the record to be written. */
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	elapsed = (now.tv_sec - start.tv_sec)
+	    + (now.tv_nsec - start.tv_nsec)*1e-9;
+	if ((wait = dur - elapsed) > tsent + FOLLOW_MAXIDLE - elapsed)
+	    wait = tsent + FOLLOW_MAXIDLE - elapsed;
+	if (wait <= 0.)
+	    break;
+	pfd.fd = ifd;
+	pfd.events = POLLIN;
+	if (poll(&pfd, 1, (int)(wait * 1000.) + 1) < 0)
+	    break;
+	if ((pfd.revents & POLLIN) == 0)
+	    continue;
+
+	/* Let writes made together accumulate, and then discard the events
+	   (which say only that something in the record has been written). */
+	ts.tv_sec = 0;
+	ts.tv_nsec = (long)(FOLLOW_INTERVAL * 1e9);
+	nanosleep(&ts, NULL);
+	while (poll(&pfd, 1, 0) > 0 && read(ifd, ebuf, sizeof(ebuf)) > 0)
+	    ;
+    }
+
+ done:
+    for (i = 0; i < nsfollow; i++)
+	close(sfollow[i].fd);
+    SFREE(sfollow);
+    nsfollow = 0;
+    for (i = 0; i < nann; i++)
+	if (afollow[i].fd >= 0) close(afollow[i].fd);
+    close(ifd);
+    following = 0;
+}
+
 /* force_unique_signames() tries to ensure that each signal has a unique name.
    By default, the name of signal i is s[i].desc.  The names of any signals
    that are not unique are modified by appending a unique suffix to each
@@ -856,10 +2408,54 @@ int ufindsig(char *p) {
   return (-1);    
 }
 
+/* If timing was requested (debug=timing), print the phase times so far as
+   a JSON object member. */
+void print_timing(char *prefix, char *suffix)
+{
+    if (debug_timing) {
+	printf("%s", prefix);
+	lw_timing_json(stdout);
+	printf("%s", suffix);
+    }
+}
+
+/* If allocation accounting was requested (debug=alloc), print the server's
+   allocations so far (see alloc.c) as a JSON object member. */
+void print_alloc(char *prefix, char *suffix)
+{
+    if (debug_alloc) {
+	printf("%s", prefix);
+	lw_alloc_json(stdout);
+	printf("%s", suffix);
+    }
+}
+
+/* Send the rest of the response to the client, count the request in the
+   server's statistics, and, if timing or allocation accounting was requested,
+   append a log line (to the web server's error log) summarizing the request.
+   Requests are counted by database only if they read something from it, so
+   that clients cannot fill the statistics table with made-up names. */
+void end_request(void)
+{
+    cgi_end_output();
+    lw_stats_record(action, db_read ? db : NULL, failed, lw_timing_elapsed(),
+		    cgi_bytes_out(), nsamples);
+    if (debug_timing || debug_alloc) {
+	fprintf(stderr, "lightwave: action=%s db=%s record=%s signals=%d"
+		" samples=%ld bytes=%lu", action ? action : "-",
+		db ? db : "-", record ? record : "-", nosig, nsamples,
+		(unsigned long)cgi_bytes_out());
+	lw_timing_log(stderr);
+	if (debug_alloc) lw_alloc_log(stderr);
+	fprintf(stderr, "\n");
+    }
+}
+
 void cleanup(void)
 {
     /* Close open files and release allocated memory. */
     wfdbquit();
+    ann_table_free();
 
     SFREE(recpath);
     while (--nann >= 0)
@@ -869,6 +2465,8 @@ void cleanup(void)
 	SFREE(s);
 	SFREE(sigmap);
     }
+    SFREE(rs_up);
+    SFREE(rs_down);
     if (sname) {
 	while (--nsig >= 0)
 	    SFREE(sname[nsig]);
@@ -0,0 +1,177 @@
+/* file: lwannstats.c		18 October 2026
+
+Build an annotation statistics index for the LightWAVE server
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+_______________________________________________________________________________
+
+Usage:
+    lwannstats [-j NWORKERS] [-o FILE] DATABASE
+
+lwannstats reads DATABASE/RECORDS and DATABASE/ANNOTATORS from the WFDB path,
+reads every annotation file of every record, and writes an index of the
+number of annotations of each type, and the times of the first and last of
+them (see annstats.c), to FILE, or to the standard output if no FILE is
+given.  Install the index as DATABASE/ANNSTATS in the LightWAVE server's WFDB
+path to enable 'annquery' requests.
+
+As for lwcatalog, records are scanned by NWORKERS processes in parallel (by
+default, one per CPU), and when FILE is given, the index is written to a
+temporary file and renamed only when it is complete.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <wfdb/wfdblib.h>
+#include "annstats.h"
+#include "catalog.h"
+#include "pool.h"
+
+static char *db, **rname, **aname;
+static long nrec, nann;
+
+/* The statistics of one type of annotation in one annotation file. */
+struct typestats {
+    char type[LW_ANNSTATS_TYPEMAX];
+    long count;
+    WFDB_Time first, last;
+};
+
+static int compare_types(const void *a, const void *b)
+{
+    return (strcmp(((const struct typestats *)a)->type,
+                   ((const struct typestats *)b)->type));
+}
+
+/* Index the annotations of record i (a pool job). */
+static int index_record(long i, FILE *ofile, void *arg)
+{
+    char *recpath, type[LW_ANNSTATS_TYPEMAX];
+    double freq;
+    int j, k, ntypes;
+    struct lw_annstats_entry e;
+    struct typestats *ts = NULL;
+    WFDB_Anninfo ai;
+    WFDB_Annotation annot;
+
+    /* Records whose names end with '/' are directories of subrecords. */
+    if (rname[i][strlen(rname[i]) - 1] == '/')
+        return (0);
+
+    SUALLOC(recpath, strlen(db) + strlen(rname[i]) + 2, 1);
+    sprintf(recpath, "%s/%s", db, rname[i]);
+    setgvmode(WFDB_LOWRES);
+    if ((freq = sampfreq(recpath)) <= 0.)
+        freq = WFDB_DEFFREQ;
+    e.record = rname[i];
+    e.freq = freq;
+
+    for (j = 0; j < nann; j++) {
+        ai.name = aname[j];
+        ai.stat = WFDB_READ;
+        if (annopen(recpath, &ai, 1) < 0)
+            continue;
+        ntypes = 0;
+        while (getann(0, &annot) == 0) {
+            lw_annstats_type(&annot, type);
+            for (k = 0; k < ntypes && strcmp(ts[k].type, type); k++)
+                ;
+            if (k == ntypes) {
+                SREALLOC(ts, ++ntypes, sizeof(struct typestats));
+                strcpy(ts[k].type, type);
+                ts[k].count = 0;
+                ts[k].first = annot.time;
+            }
+            ts[k].count++;
+            ts[k].last = annot.time;
+        }
+        qsort(ts, ntypes, sizeof(struct typestats), compare_types);
+        e.annotator = aname[j];
+        for (k = 0; k < ntypes; k++) {
+            e.type = ts[k].type;
+            e.count = ts[k].count;
+            e.first = ts[k].first;
+            e.last = ts[k].last;
+            lw_annstats_write(ofile, &e);
+        }
+    }
+    wfdbquit();
+    SFREE(ts);
+    SFREE(recpath);
+    return (0);
+}
+
+static void help(char *pname)
+{
+    fprintf(stderr, "usage: %s [-j NWORKERS] [-o FILE] DATABASE\n", pname);
+}
+
+int main(int argc, char **argv)
+{
+    char *ofname = NULL, *tfname = NULL;
+    int c, nworkers = 0;
+    long failed;
+    FILE *ofile = stdout;
+
+    while ((c = getopt(argc, argv, "j:o:h")) != -1) {
+        switch (c) {
+          case 'j': nworkers = atoi(optarg); break;
+          case 'o': ofname = optarg; break;
+          default: help(argv[0]); exit(1);
+        }
+    }
+    if (optind != argc - 1) {
+        help(argv[0]);
+        exit(1);
+    }
+    db = argv[optind];
+    wfdbquiet();
+
+    if ((nrec = lw_catalog_names(db, "RECORDS", &rname)) < 0) {
+        fprintf(stderr, "%s: can't read %s/RECORDS\n", argv[0], db);
+        exit(2);
+    }
+    if ((nann = lw_catalog_names(db, "ANNOTATORS", &aname)) < 0) {
+        fprintf(stderr, "%s: can't read %s/ANNOTATORS\n", argv[0], db);
+        exit(2);
+    }
+
+    if (ofname) {
+        SUALLOC(tfname, strlen(ofname) + 16, 1);
+        sprintf(tfname, "%s.%ld", ofname, (long)getpid());
+        if ((ofile = fopen(tfname, "w")) == NULL) {
+            fprintf(stderr, "%s: can't write %s\n", argv[0], tfname);
+            exit(2);
+        }
+    }
+    fprintf(ofile, "#LightWAVE annotation statistics of %s: record\tannotator"
+            "\tfreq\ttype\tcount\tfirst\tlast\n", db);
+    failed = lw_pool_run(nrec, nworkers, index_record, NULL, ofile);
+    if (failed < 0) {
+        fprintf(stderr, "%s: can't run worker processes\n", argv[0]);
+        if (tfname) unlink(tfname);
+        exit(3);
+    }
+    if (ofname) {
+        if (fclose(ofile) != 0 || rename(tfname, ofname) != 0) {
+            fprintf(stderr, "%s: can't write %s\n", argv[0], ofname);
+            unlink(tfname);
+            exit(2);
+        }
+        SFREE(tfname);
+    }
+    exit(0);
+}
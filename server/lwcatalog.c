@@ -0,0 +1,196 @@
+/* file: lwcatalog.c		18 October 2026
+
+Build a record catalog for the LightWAVE server
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+_______________________________________________________________________________
+
+Usage:
+    lwcatalog [-j NWORKERS] [-o FILE] DATABASE
+
+lwcatalog reads DATABASE/RECORDS (and DATABASE/ANNOTATORS, if it exists) from
+the WFDB path, opens each record in turn to find its length, sampling
+frequency, base time, signal names, and annotators, and writes a catalog (see
+catalog.c) to FILE, or to the standard output if no FILE is given.  Install the
+catalog as DATABASE/CATALOG in the LightWAVE server's WFDB path to enable
+paged and filtered 'rlist' requests.
+
+Records are scanned by NWORKERS processes in parallel (by default, one per
+CPU).  When FILE is given, the catalog is written to a temporary file and
+renamed only when it is complete, so that it can be rebuilt while the server
+is running.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <wfdb/wfdblib.h>
+#include "catalog.h"
+#include "pool.h"
+
+static char *db, **rname, **aname;
+static long nrec, nann;
+
+/* Catalog record i (a pool job). */
+static int catalog_record(long i, FILE *ofile, void *arg)
+{
+    char *abuf = NULL, *sbuf = NULL, *p, *recpath, base[64];
+    int first, j, nsig;
+    size_t alen = 0, slen = 0;
+    FILE *astr, *sstr;
+    struct lw_catalog_entry e;
+    WFDB_Anninfo ai;
+    WFDB_Siginfo *s = NULL;
+
+    e.record = rname[i];
+    e.freq = 0.;
+    e.nframes = 0L;
+    e.basetime = "";
+    SUALLOC(recpath, strlen(db) + strlen(rname[i]) + 2, 1);
+    sprintf(recpath, "%s/%s", db, rname[i]);
+
+    /* Records whose names end with '/' are directories of subrecords. */
+    if (rname[i][strlen(rname[i]) - 1] == '/') {
+        e.nsig = 0;
+        e.signals = e.annotators = "";
+        lw_catalog_write(ofile, &e);
+        SFREE(recpath);
+        return (0);
+    }
+
+    if ((sstr = open_memstream(&sbuf, &slen)) == NULL) {
+        SFREE(recpath);
+        return (1);
+    }
+    if ((astr = open_memstream(&abuf, &alen)) == NULL) {
+        fclose(sstr);
+        free(sbuf);
+        SFREE(recpath);
+        return (1);
+    }
+    setgvmode(WFDB_LOWRES);
+    if ((nsig = isigopen(recpath, NULL, 0)) > 0) {
+        SUALLOC(s, nsig, sizeof(WFDB_Siginfo));
+        nsig = isigopen(recpath, s, nsig);
+    }
+    e.nsig = nsig;
+    for (j = 0; j < nsig; j++) {
+        if (strncmp(s[j].desc, "record ", 7) == 0) {
+            if (j)
+                putc(LW_CATALOG_SEP, sstr);
+            fprintf(sstr, "v[%d]", j);
+        }
+        else
+            lw_catalog_putname(sstr, s[j].desc, j == 0);
+    }
+    fclose(sstr);
+    e.signals = sbuf;
+    if (nsig >= 0) {
+        e.freq = sampfreq(NULL);
+        if ((e.nframes = strtim("e")) < 0L)
+            e.nframes = -e.nframes;
+        p = timstr(0);
+        if (*p == '[') {
+            strncpy(base, p + 1, sizeof(base) - 1);
+            base[sizeof(base) - 1] = '\0';
+            if ((p = strchr(base, ']')) != NULL)
+                *p = '\0';
+            e.basetime = base;
+        }
+    }
+
+    /* An annotator is present if its annotation file can be opened. */
+    for (j = 0, first = 1; j < nann; j++) {
+        ai.name = aname[j];
+        ai.stat = WFDB_READ;
+        if (annopen(recpath, &ai, 1) >= 0) {
+            lw_catalog_putname(astr, aname[j], first);
+            first = 0;
+        }
+    }
+    fclose(astr);
+    e.annotators = abuf;
+
+    lw_catalog_write(ofile, &e);
+    wfdbquit();
+    free(sbuf);
+    free(abuf);
+    SFREE(s);
+    SFREE(recpath);
+    return (nsig < 0);
+}
+
+static void help(char *pname)
+{
+    fprintf(stderr, "usage: %s [-j NWORKERS] [-o FILE] DATABASE\n", pname);
+}
+
+int main(int argc, char **argv)
+{
+    char *ofname = NULL, *tfname = NULL;
+    int c, nworkers = 0;
+    long failed;
+    FILE *ofile = stdout;
+
+    while ((c = getopt(argc, argv, "j:o:h")) != -1) {
+        switch (c) {
+          case 'j': nworkers = atoi(optarg); break;
+          case 'o': ofname = optarg; break;
+          default: help(argv[0]); exit(1);
+        }
+    }
+    if (optind != argc - 1) {
+        help(argv[0]);
+        exit(1);
+    }
+    db = argv[optind];
+    wfdbquiet();
+
+    if ((nrec = lw_catalog_names(db, "RECORDS", &rname)) < 0) {
+        fprintf(stderr, "%s: can't read %s/RECORDS\n", argv[0], db);
+        exit(2);
+    }
+    if ((nann = lw_catalog_names(db, "ANNOTATORS", &aname)) < 0)
+        nann = 0;
+
+    if (ofname) {
+        SUALLOC(tfname, strlen(ofname) + 16, 1);
+        sprintf(tfname, "%s.%ld", ofname, (long)getpid());
+        if ((ofile = fopen(tfname, "w")) == NULL) {
+            fprintf(stderr, "%s: can't write %s\n", argv[0], tfname);
+            exit(2);
+        }
+    }
+    fprintf(ofile, "#LightWAVE catalog of %s: record\tfreq\tnframes\tnsig"
+            "\tbasetime\tsignals\tannotators\n", db);
+    failed = lw_pool_run(nrec, nworkers, catalog_record, NULL, ofile);
+    if (failed < 0) {
+        fprintf(stderr, "%s: can't run worker processes\n", argv[0]);
+        if (tfname) unlink(tfname);
+        exit(3);
+    }
+    if (failed > 0)
+        fprintf(stderr, "%s: %ld of %ld records could not be read\n",
+                argv[0], failed, nrec);
+    if (ofname) {
+        if (fclose(ofile) != 0 || rename(tfname, ofname) != 0) {
+            fprintf(stderr, "%s: can't write %s\n", argv[0], ofname);
+            unlink(tfname);
+            exit(2);
+        }
+        SFREE(tfname);
+    }
+    exit(0);
+}
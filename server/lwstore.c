@@ -0,0 +1,225 @@
+/* file: lwstore.c		18 October 2026
+
+Convert a WFDB record into a columnar store for the LightWAVE server
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+_______________________________________________________________________________
+
+Usage:
+    lwstore [-c SECONDS] [-o FILE] RECORD
+
+lwstore reads all of the samples of RECORD from the WFDB path, and writes them
+to FILE (by default, the last component of RECORD followed by ".lwc", in the
+current directory) as a store (see store.c), in chunks of SECONDS (by default,
+LW_STORE_CHUNKSEC) seconds each.  Install the store in the record's directory,
+alongside its header, to allow the LightWAVE server to read signals from it
+rather than from the record's signal files.  The server ignores a store that
+is older than the record's header, so the store should be rebuilt whenever
+the header is changed.
+
+Chunks are limited to LW_CODE_MAXN samples of each signal, so they may be
+shorter than SECONDS for records with high sampling frequencies.  The store
+is written to a temporary file and renamed only when it is complete, so that
+it can be rebuilt while the server is running.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <wfdb/wfdb.h>
+#include "codec.h"
+#include "store.h"
+
+#ifndef WFDB_INVALID_SAMPLE	/* defined by WFDB 10.5.0 and later */
+#define WFDB_INVALID_SAMPLE (-32768)
+#endif
+
+static void help(char *pname)
+{
+    fprintf(stderr, "usage: %s [-c SECONDS] [-o FILE] RECORD\n", pname);
+}
+
+/* Code the first n samples of signal i in sb as chunk j (of frames t0 through
+   tf-1), appending it to tfile and recording it in the chunk index. */
+static int write_chunk(struct lw_store *st, int i, long j, WFDB_Time t0,
+                       WFDB_Time tf, WFDB_Sample *sb, long n, FILE *tfile,
+                       unsigned char *buf)
+{
+    struct lw_store_chunk *c;
+    int err;
+    long k;
+
+    if (j >= st->nchunks) {
+        st->nchunks = j + 1;
+        SREALLOC(st->index, (size_t)st->nsig * st->nchunks,
+                 sizeof(struct lw_store_chunk));
+    }
+    /* The index is rearranged by signal when the record has been read (see
+       main()), so that the entries can be appended as the chunks are coded. */
+    c = &st->index[(size_t)j * st->nsig + i];
+    c->t0 = t0;
+    c->tf = tf;
+    c->offset = ftell(tfile);
+    c->len = lw_code_block(sb, n, 0, buf, &err);
+    c->min = 1;
+    c->max = 0;
+    for (k = 0; k < n; k++)
+        if (sb[k] != WFDB_INVALID_SAMPLE) {
+            if (c->min > c->max) c->min = c->max = sb[k];
+            else if (sb[k] < c->min) c->min = sb[k];
+            else if (sb[k] > c->max) c->max = sb[k];
+        }
+    return (fwrite(buf, 1, c->len, tfile) == c->len ? 0 : -1);
+}
+
+int main(int argc, char **argv)
+{
+    char *ofname = NULL, *p, *record, *tfname = NULL;
+    double sec = LW_STORE_CHUNKSEC;
+    int c, i, j, k, nsig, spfmax;
+    long chunk, n, nchunks;
+    unsigned char *buf;
+    FILE *ofile, **tfile;
+    struct lw_store st;
+    struct lw_store_chunk *index;
+    WFDB_Sample **sb, *v;
+    WFDB_Siginfo *s;
+    WFDB_Time t, tc;
+
+    while ((c = getopt(argc, argv, "c:o:h")) != -1) {
+        switch (c) {
+          case 'c': sec = atof(optarg); break;
+          case 'o': ofname = optarg; break;
+          default: help(argv[0]); exit(1);
+        }
+    }
+    if (optind != argc - 1 || sec <= 0.) {
+        help(argv[0]);
+        exit(1);
+    }
+    record = argv[optind];
+
+    /* Open the record as the server does (see prep_signals()). */
+    setgvmode(WFDB_LOWRES);
+    if ((nsig = isigopen(record, NULL, 0)) < 1) {
+        fprintf(stderr, "%s: can't read signals of record %s\n", argv[0],
+                record);
+        exit(2);
+    }
+    SUALLOC(s, nsig, sizeof(WFDB_Siginfo));
+    if ((nsig = isigopen(record, s, nsig)) < 1)
+        exit(2);
+
+    memset(&st, 0, sizeof(st));
+    st.nsig = nsig;
+    if ((st.freq = sampfreq(NULL)) <= 0.)
+        st.freq = WFDB_DEFFREQ;
+    SUALLOC(st.sig, nsig, sizeof(struct lw_store_signal));
+    for (i = spfmax = 0; i < nsig; i++) {
+        st.sig[i].desc = s[i].desc;
+        st.sig[i].units = s[i].units;
+        st.sig[i].gain = s[i].gain;
+        st.sig[i].initval = s[i].initval;
+        st.sig[i].group = s[i].group;
+        st.sig[i].fmt = s[i].fmt;
+        st.sig[i].spf = s[i].spf;
+        st.sig[i].bsize = s[i].bsize;
+        st.sig[i].adcres = s[i].adcres;
+        st.sig[i].adczero = s[i].adczero;
+        st.sig[i].baseline = s[i].baseline;
+        st.sig[i].nsamp = s[i].nsamp;
+        st.sig[i].cksum = s[i].cksum;
+        if (s[i].spf > spfmax) spfmax = s[i].spf;
+    }
+    if ((chunk = (long)(sec * st.freq + 0.5)) < 1)
+        chunk = 1;
+    if (chunk > LW_CODE_MAXN / spfmax)
+        chunk = LW_CODE_MAXN / spfmax;
+    st.chunk = chunk;
+
+    /* The chunks of each signal are collected in a temporary file of their
+       own, and copied to the store when the whole record has been read. */
+    SUALLOC(tfile, nsig, sizeof(FILE *));
+    SUALLOC(sb, nsig, sizeof(WFDB_Sample *));
+    for (i = 0; i < nsig; i++) {
+        if ((tfile[i] = tmpfile()) == NULL) {
+            fprintf(stderr, "%s: can't create temporary files\n", argv[0]);
+            exit(3);
+        }
+        SUALLOC(sb[i], chunk * s[i].spf, sizeof(WFDB_Sample));
+    }
+    SUALLOC(buf, lw_code_size(chunk * spfmax), 1);
+    SUALLOC(v, nsig * spfmax, sizeof(WFDB_Sample));
+
+    for (t = 0, nchunks = 0; ; ) {
+        for (tc = 0; tc < chunk && getframe(v) > 0; tc++) {
+            for (i = k = 0; i < nsig; i++)
+                for (j = 0; j < s[i].spf; j++)
+                    sb[i][tc * s[i].spf + j] = v[k++];
+        }
+        if (tc == 0)
+            break;
+        for (i = 0; i < nsig; i++)
+            if (write_chunk(&st, i, nchunks, t, t + tc, sb[i], tc * s[i].spf,
+                            tfile[i], buf)) {
+                fprintf(stderr, "%s: can't write temporary files\n", argv[0]);
+                exit(3);
+            }
+        nchunks++;
+        t += tc;
+        if (tc < chunk)
+            break;
+    }
+    st.nframes = t;
+    st.nchunks = nchunks;
+
+    /* Write the store, with the chunks and their index entries arranged by
+       signal. */
+    if (ofname == NULL) {
+        p = (p = strrchr(record, '/')) ? p + 1 : record;
+        SUALLOC(ofname, strlen(p) + strlen(LW_STORE_SUFFIX) + 1, 1);
+        sprintf(ofname, "%s%s", p, LW_STORE_SUFFIX);
+    }
+    SUALLOC(tfname, strlen(ofname) + 16, 1);
+    sprintf(tfname, "%s.%ld", ofname, (long)getpid());
+    if ((ofile = fopen(tfname, "w+b")) == NULL) {
+        fprintf(stderr, "%s: can't write %s\n", argv[0], tfname);
+        exit(2);
+    }
+    lw_store_write_header(ofile, &st);
+    SUALLOC(index, (size_t)nsig * nchunks + 1, sizeof(struct lw_store_chunk));
+    for (i = 0; i < nsig; i++) {
+        long base = ftell(ofile);
+
+        for (n = 0; n < nchunks; n++) {
+            index[(size_t)i * nchunks + n] = st.index[(size_t)n * nsig + i];
+            index[(size_t)i * nchunks + n].offset += base;
+        }
+        rewind(tfile[i]);
+        while ((k = fread(buf, 1, lw_code_size(chunk * spfmax), tfile[i])) > 0)
+            fwrite(buf, 1, k, ofile);
+        fclose(tfile[i]);
+    }
+    SFREE(st.index);
+    st.index = index;
+    if (lw_store_write_index(ofile, &st) || fclose(ofile) != 0 ||
+        rename(tfname, ofname) != 0) {
+        fprintf(stderr, "%s: can't write %s\n", argv[0], ofname);
+        unlink(tfname);
+        exit(2);
+    }
+    wfdbquit();
+    exit(0);
+}
@@ -1,5 +1,5 @@
 /* file: patchann.c		G. Moody	27 March 2013
-				Last revised:	 13 May 2013
+				Last revised:	18 October 2026
 Create or patch a PhysioBank-compatible annotation file from a LightWAVE editlog
 
 Copyright (C) 2012-2013 George B. Moody
@@ -40,6 +40,44 @@ new annotation file.  If the annotator name does not begin with 'new' or end
 with '_', a set of original annotations exists, a '_' is appended to the name of
 the new annotation file so that they can be distinguished from each other.
 
+With the -s option, patchann runs in streaming mode:  it reads the entire edit
+log first (as a single block, rather than line by line) and sorts its entries,
+then reads the original annotations once, merging the edits into them as the
+new annotation file is written.  In this mode, memory use depends only on the
+size of the edit log, not on the number of original annotations.  Streaming
+requires that the original annotations are in canonical order;  if they are
+not, patchann falls back to its in-memory mode.  The output is the same in
+either mode.
+
+With the -b option, patchann processes a batch of edit logs:  all of the files
+in a directory (in order of modification time), or those listed one per line
+in a manifest file.  The logs are grouped by record and annotator, and those
+in each group are applied in order (as if they had been concatenated) in
+streaming mode, so that each annotation file is read and written only once.
+If any log in a group can't be read, the group is skipped and its annotation
+file is left unchanged.
+Groups are processed in parallel by up to NWORKERS processes (-j NWORKERS; by
+default, one per CPU).
+
+With the -c N option, patchann skips the first N entries of the edit log, and
+applies the rest to the annotation file that it produced from those N entries
+in an earlier run (rather than to the original annotations), replacing that
+file.  The LightWAVE scribe uses this to apply only the entries that have been
+added to a log since it was last saved, so that the cost of each save does not
+grow with the length of the editing session.  If that file is missing and N
+is greater than 0, patchann writes nothing and exits with status 3, and the
+scribe asks the client to send the entire log.  With -c 0, a missing file is
+created from the original annotations, as in a run without -c.
+
+With the -m JOURNAL option, patchann folds an edit journal (see editlog.c)
+into the annotation file that it amends.  JOURNAL is the pathname of the
+journal (DIR/RECORD.ANNOTATOR.jnl), and the annotation file (RECORD.ANNOTATOR)
+must be in the same directory.  The entries of the journal are merged into the
+annotations in streaming mode, the result replaces the annotation file, and the
+journal is truncated.  The journal is locked throughout, so that the LightWAVE
+server and scribe see either the original annotations and the whole journal,
+or the new annotations and an empty journal.
+
 LightWAVE edit log format spec:
     http://physionet.org/lightwave/doc/edit-log-format.html
 PhysioBank annotation file format spec:
@@ -50,21 +88,35 @@ _______________________________________________________________________________
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/file.h>
+#include <sys/stat.h>
 #include <wfdb/wfdb.h>
 #include <wfdb/ecgcodes.h>
+#include "editlog.h"
+#include "pool.h"
 
 /* In-memory annotation array
 
-The in-memory annotation array is a doubly-linked list of elements, beginning
-with aphead and ending with aptail.  aphead is the root element of the array
-and never contains an annotation;  aptail marks the end of the array and
-contains the last annotation unless the array is empty.
-
-At all times, the contents of the array are kept in canonical order (sorted
-first by time, then by chan, and then by num).  This property of the array is
-established and maintained by insert_ann().  For efficiency, a 48-bit sort key
-(t0) is created by insert_ann by concatenating the 32-bit time with the 8-bit
-chan and the 8-bit num fields of the annotations.
+The in-memory annotation array is a vector (ann) of elements kept in
+canonical order (sorted first by time, then by chan, and then by num), plus an
+unsorted buffer (pending) of recent insertions.  For efficiency, a 48-bit sort
+key (t0) is created by insert_ann by concatenating the 32-bit time with the
+8-bit chan and the 8-bit num fields of the annotations.
+
+insert_ann() appends an annotation directly to ann if it follows all of the
+others (as when reading an annotation file), and otherwise adds it to pending.
+When pending grows larger than the square root of the size of ann (and at
+least PENDMIN), flush_pending() sorts it and merges it into ann in a single
+pass.  delete_ann() finds an annotation in ann by binary search, or in pending
+by a linear search, and marks it as deleted;  deleted elements of ann are
+removed by the next merge.  Annotations with equal sort keys appear in reverse
+order of insertion, and delete_ann() removes the last such annotation that
+matches, as in earlier versions of this program, which kept the array as a
+linked list.
 
 Although the output annotation file is sorted in canonical order, note that
 this program does not require that its inputs (neither the original annotation
@@ -72,128 +124,276 @@ file or the edit log) are in canonical order, so it is not necessary to use
 sortann to reorder either its input or its output.
 */
 
-struct ax {		/* in-memory annotation array structure */
+#define PENDMIN	256	/* minimum size of pending before it is merged */
+
+struct ax {		/* in-memory annotation array element */
     long long t0;	/* array is ordered by t0 (48 bits needed) */
+    long seq;		/* insertion sequence number */
     int anntyp;		/* annotation type, as in WFDB_Annotation */
     char subtyp;	/* annotation subtype, as in WFDB_Annotation */
+    char deleted;	/* nonzero if the annotation has been deleted */
     char *aux;		/* annotation aux string, as in WFDB_Annotation */
-    struct ax *next, *prev;  /* successor and predecessor pointers */
 };
 
-struct ax *aphead; 	/* head of annotation array (aphead->next points to the
-			   first annotation; aphead does not contain an
-			   annotation) */
-struct ax *aptail;	/* tail of annotation array (contains an annotation
-			   unless aptail = aphead, i.e., unless the array is
-			   empty) */
-
-char *record, *annotator, logtext[500];
+struct axvec {
+    struct ax *a;	/* elements */
+    long n, size;	/* number of elements in use, number allocated */
+} ann, pending;
+
+long ndeleted;		/* number of deleted elements in ann */
+long nseq;		/* number of annotations inserted so far */
+
+struct lw_edits edits;	/* edit log entries (streaming mode only) */
+long nskip = -1;	/* number of log entries already applied (-c), or -1 */
+
+struct batchlog {	/* edit log to be processed in batch mode */
+    char *path;		/* pathname of the log */
+    char *record;	/* record name, from the log's header */
+    char *annotator;	/* annotator name, from the log's header */
+    long order;		/* position of the log in the batch */
+    struct timespec mtime;  /* modification time (if read from a directory) */
+} *blog;
+long nblog;		/* number of entries in blog */
+long *bgroup;		/* index in blog of the first log of each group */
+
+char *record, *annotator, logtext[LW_EDIT_MAXLEN];
+FILE *logfile;		/* edit log (the standard input, except in batch mode) */
 double sps;
 WFDB_Annotation annot;	/* current annotation to be processed */
 
-int delete_ann(), insert_ann(), get_log_entry(), parse_log_header();
+int delete_ann(), insert_ann(), get_log_entry(), parse_log_header(),
+    stream_merge(), patch(), write_output(), batch(), compact(),
+    created_here();
+void flush_pending(), clear_anns(), replay_edits(), put_ax(),
+    update_annotators();
 
 int main(int argc, char **argv) {
-    char *abuf, buf[256], *fname, *oaname = NULL, *p, *pname = argv[0];
-    FILE *afile;
-    int match = 0, n;
-    struct ax *ap, *apthis;
-    WFDB_Anninfo ai;
+    char *pname = argv[0], *source = NULL, *journal = NULL;
+    int c, nworkers = 0, status, stream = 0;
+
+    while ((c = getopt(argc, argv, "b:c:j:m:s")) != -1) {
+	switch (c) {
+	  case 'b': source = optarg; break;
+	  case 'c': nskip = atol(optarg); stream = 1; break;
+	  case 'j': nworkers = atoi(optarg); break;
+	  case 'm': journal = optarg; break;
+	  case 's': stream = 1; break;
+	  default:
+	    fprintf(stderr, "usage: %s [-s] [-c N] <EDITLOG\n", pname);
+	    fprintf(stderr, "   or: %s -b DIRECTORY|MANIFEST [-j NWORKERS]\n",
+		    pname);
+	    fprintf(stderr, "   or: %s -m JOURNAL\n", pname);
+	    exit(1);
+	}
+    }
+    wfdbquiet();
+    if (source)
+	exit(batch(pname, source, nworkers));
+    if (journal)
+	exit(compact(pname, journal));
 
+    logfile = stdin;
     if (parse_log_header() == 0) {
 	fprintf(stderr, "%s: can't parse input file (format error)\n", pname);
 	exit(1);
     }
+    if (stream)
+	lw_edits_read(&edits, logfile, nskip);
+    status = patch(pname, stream);
+    SFREE(record);
+    SFREE(annotator);
+    exit(status);
+}
 
-    SUALLOC(aphead, sizeof(struct ax), 1);
-    aptail = aphead;
-    wfdbquiet();
-    ai.name = annotator;
-    ai.stat = WFDB_READ;
+/* Create or patch the annotation file for record and annotator, using the
+   edits read by read_edits() if stream is nonzero, or reading the edit log
+   entry by entry otherwise.  Return 0 if successful, 2 if the output
+   annotation file can't be written, or 3 if continuing from a checkpoint
+   (-c) and the output of the earlier run can't be read. */
+int patch(char *pname, int stream) {
+    char *oaname = NULL, *ofname = NULL, *tfname = NULL, *tpath = NULL;
+    int have_input, in_place = 0, status;
+    WFDB_Anninfo ai[2];
+
+    ai[0].name = annotator;
+    ai[0].stat = WFDB_READ;
     SUALLOC(oaname, strlen(annotator) + 2, 1);
     if (strncmp(annotator, "new", 3) && annotator[strlen(annotator)-1] != '_')
 	sprintf(oaname, "%s_", annotator);
     else
 	sprintf(oaname, "%s", annotator);
-    if (annopen(record, &ai, 1) == 0){ /* input annotator opened successfully */
-	while (getann(0, &annot) == 0)  /* read the original annotations */
-	    (void)insert_ann();    /* copy them into the in-memory array */
-	ai.name = oaname;	/* use oaname only if input annotator exists */
-    }
     /* Failure to open the original annotation file is not an error (it simply
        means that the edit log will be used to create an entirely new set of
        annotations).  Failure to open the output is fatal, however. */
-    ai.stat = WFDB_WRITE;
-    if (annopen(record, &ai, 1) != 0) {  /* can't open output annotator */
-	fprintf(stderr, "%s: can't write output annotation file '%s.%s\n",
-		record, ai.name);
-	SFREE(oaname);
-	SFREE(record);
-	SFREE(annotator);
+    have_input = (annopen(record, ai, 1) == 0);
+    ai[1].name = have_input ? oaname : annotator;  /* use oaname only if input
+						      annotator exists */
+    ai[1].stat = WFDB_WRITE;
+
+    /* When continuing from a checkpoint, the input is the output of the
+       earlier run (named oaname, or annotator if there were no original
+       annotations).  The new output is written to a temporary file that
+       replaces it when complete.  If the earlier output is missing, the
+       entries that were applied to it are not available, so nothing is
+       written (the scribe then asks the client for the entire log), unless
+       no entries were applied (-c 0), in which case this is a plain run that
+       reads the original annotations and writes oaname. */
+    if (nskip >= 0 && have_input) {
+	ai[0].name = oaname;
+	in_place = 1;
+	if (!(have_input = (annopen(record, ai, 1) == 0))) {
+	    ai[0].name = annotator;
+	    in_place = (strcmp(oaname, annotator) == 0 ||
+			created_here(annotator));
+	    if (in_place || nskip == 0)
+		have_input = (annopen(record, ai, 1) == 0);
+	}
+	if (have_input && in_place) {
+	    SUALLOC(tfname, strlen(ai[0].name) + 2, 1);
+	    sprintf(tfname, "%s~", ai[0].name);
+	    ai[1].name = tfname;
+	}
+    }
+    if (nskip > 0 && !have_input) {
+	fprintf(stderr, "%s: can't read the annotations saved from the first"
+		" %ld entries of the log ('%s.%s')\n", pname, nskip, record,
+		oaname);
 	wfdbquit();
-	exit(2);
+	lw_edits_free(&edits);
+	SFREE(oaname);
+	return 3;
+    }
+
+    status = write_output(pname, ai, have_input, stream);
+    wfdbquit();
+    if (status == 0 && tfname) {
+	SUALLOC(ofname, strlen(record) + strlen(ai[0].name) + 2, 1);
+	sprintf(ofname, "%s.%s", record, ai[0].name);
+	SUALLOC(tpath, strlen(record) + strlen(tfname) + 2, 1);
+	sprintf(tpath, "%s.%s", record, tfname);
+	if (rename(tpath, ofname) != 0) {
+	    unlink(tpath);
+	    status = 2;
+	}
+	ai[1].name = ai[0].name;
+	SFREE(tpath);
+	SFREE(ofname);
     }
+    if (status == 0)
+	update_annotators(ai[1].name);
+    else
+	fprintf(stderr, "%s: can't write output annotation file '%s.%s'\n",
+		pname, record, ai[1].name);
+
+    lw_edits_free(&edits);
+    SFREE(tfname);
+    SFREE(oaname);
+    return status;
+}
+
+/* Return nonzero if ANNOTATORS in the record's directory shows that the
+   annotation file for name was created by patchann (see update_annotators()),
+   rather than being an original annotation file. */
+int created_here(char *name) {
+    char *abuf, buf[256], *fname, *p;
+    FILE *afile;
+    int match = 0;
+    size_t n;
+
+    for (p = record + strlen(record) - 1; p > record && *p != '/'; p--)
+	;
+    n = (*p == '/') ? p - record + 1 : 0;
+    SUALLOC(fname, n + 11, 1);
+    sprintf(fname, "%.*sANNOTATORS", (int)n, record);
+    SUALLOC(abuf, strlen(name) + 30, 1);
+    sprintf(abuf, "%s\tcreated using LightWAVE\n", name);
+    if (afile = fopen(fname, "r")) {
+	while (!match && fgets(buf, sizeof(buf), afile))
+	    if (strcmp(abuf, buf) == 0) match = 1;
+	fclose(afile);
+    }
+    SFREE(abuf);
+    SFREE(fname);
+    return match;
+}
+
+/* Merge the edits with the original annotations (if have_input is nonzero),
+   and write the output annotation file.  Return 0 if successful, or 2 if the
+   output can't be opened. */
+int write_output(char *pname, WFDB_Anninfo *ai, int have_input, int stream) {
+    int n;
+    long i;
+    struct ax *ap;
+
+    if (stream) {
+	/* open the output annotator (and reopen the input, if any) */
+	if (annopen(record, have_input ? ai : ai+1, have_input ? 2 : 1) != 0)
+	    return 2;
+	if (stream_merge(have_input) == 0)
+	    return 0;
+	fprintf(stderr, "%s: %s.%s is not in canonical order, merging edits"
+		" in memory\n", pname, record, annotator);
+	annopen(record, ai, 1);
+    }
+
+    if (have_input)
+	while (getann(0, &annot) == 0)  /* read the original annotations */
+	    (void)insert_ann();    /* copy them into the in-memory array */
+    if (annopen(record, ai+1, 1) != 0)  /* can't open output annotator */
+	return 2;
 
     /* read the edit log and merge it with the in-memory array */
-    while (n = get_log_entry()) {
+    if (stream)
+	replay_edits();
+    else while (n = get_log_entry()) {
 	switch (n) {
 	  case 1: insert_ann(); break;
 	  case 2: delete_ann(); break;
 	  default: break;	/* warn about bad input, continue processing */
 	}
+	SFREE(annot.aux);
     }
 
     /* Write the in-memory array to the output annotation file */
-    ap = aphead->next;
-    while (ap) {
-	SFREE(ap->prev);
-	annot.anntyp = ap->anntyp;
-	annot.subtyp = ap->subtyp;
-	annot.chan = ((ap->t0) >> 8) & 255;
-	annot.num = ((ap->t0) & 255) - 128;
-	annot.time = (ap->t0) >> 16;
-	annot.aux = ap->aux;
-	putann(0, &annot);
-	ap = ap->next;
-	SFREE(annot.aux);
-    }
-    SFREE(aptail);
+    flush_pending();
+    for (i = 0, ap = ann.a; i < ann.n; i++, ap++)
+	if (!ap->deleted) put_ax(ap);
+    clear_anns();
+    return 0;
+}
+
+/* Create or update ANNOTATORS in the record's directory, so that it lists the
+   output annotator.  The file is locked while it is checked and updated, since
+   other patchann processes may be updating it at the same time. */
+void update_annotators(char *name) {
+    char *abuf, buf[256], *fname, *p;
+    FILE *afile;
+    int match = 0;
 
-    /* Create or update ANNOTATORS. */
     for (p = record + strlen(record) - 1; p > record && *p != '/'; p--)
 	;
     *p = '\0';  /* what's left of record is the directory name */
     SUALLOC(fname, strlen(record) + 12, 1);
     sprintf(fname, "%s/ANNOTATORS", record);  /* pathname of ANNOTATORS */
-    SUALLOC(abuf, strlen(ai.name) + 30, 1);
-    sprintf(abuf, "%s\tcreated using LightWAVE\n", ai.name);
-    if (afile = fopen(fname, "r")) {
+    SUALLOC(abuf, strlen(name) + 30, 1);
+    sprintf(abuf, "%s\tcreated using LightWAVE\n", name);
+    if (afile = fopen(fname, "a+")) {
+	flock(fileno(afile), LOCK_EX);
 	while (!match && fgets(buf, sizeof(buf), afile))
-	    if (strncmp(abuf, buf, strlen(ai.name) + 1) == 0) match = 1;
-	fclose(afile);
-    }
-    if (!match && (afile = fopen(fname, "a"))) {
-	fprintf(afile, "%s", abuf);
-	fclose(afile);
+	    if (strncmp(abuf, buf, strlen(name) + 1) == 0) match = 1;
+	if (!match)
+	    fprintf(afile, "%s", abuf);
+	fclose(afile);		/* this also releases the lock */
     }
     SFREE(abuf);
     SFREE(fname);
-
-    SFREE(oaname);
-    SFREE(record);
-    SFREE(annotator);
-
-    wfdbquit();
-    exit(0);
 }
 
-/* Get the record and annotator names, and the sampling frequency, from
-   the header.  Return 1 if successful, 0 otherwise. */
 int parse_log_header() {
     char *p, *q;
 
     /* Read and parse header line 1. */
-    fgets(logtext, sizeof(logtext), stdin);
+    if (!fgets(logtext, sizeof(logtext), logfile)) return 0;
 
     if (strncmp(logtext, "[LWEditLog-1.0] Record ", 23)) return 0;
 
@@ -224,8 +424,8 @@ int parse_log_header() {
     sscanf(p, "%lf", &sps);
 
     /* Read header line 2, which should be empty. */
-    fgets(logtext, sizeof(logtext), stdin);
-    if (*logtext != '\r' && *logtext != '\n') {
+    if (!fgets(logtext, sizeof(logtext), logfile) ||
+	(*logtext != '\r' && *logtext != '\n')) {
 	SFREE(record);
 	SFREE(annotator);
 	return 0;
@@ -234,175 +434,447 @@ int parse_log_header() {
     return 1;	/* success! */
 }
 
+/* Read the next log entry, return 0 if no more entries. */
 int get_log_entry() {
-    char p[500], *q;
-    int edittype, i, j, len;
-    WFDB_Time ti, tf;
-
-    /* Read the next log entry, return 0 if no more entries. */
-    if (!fgets(logtext, sizeof(logtext), stdin)) return 0;
-
-    /* Fill in the default fields of annot. */
-    annot.anntyp = NORMAL;
-    annot.subtyp = annot.chan = annot.num = 0;
-    annot.aux = NULL;
-
-    /* Copy the entry to p and replace the line ending with a null (logtext will
-       not be modified below). */
-    len = strlen(logtext);
-    strncpy(p, logtext, len + 1);
-    if (p[len - 1] == '\n') {
-	if (p[len - 2] == '\r') p[len - 2] = '\0';
-	else p[len - 1] = '\0';
-    }
-
-    /* Identify the action associated with this log entry. */
-    if (logtext[0] == '-') { edittype = 2; i = 1; } /* deletion */
-    else	       { edittype = 1; i = 0; } /* insertion */
-
-    /* Parse the rest of the entry to fill in the time and any non-default
-       fields of annot. */
-
-    /* find and isolate digits */
-    q = p+i;
-    for ( ; p[i]; i++)
-	if (p[i] < '0' || p[i] > '9') break;
-    p[i] = '\0';
-    if (strlen(q) == 0 || sscanf(q, "%ld", &ti) != 1 || ti < 0) return -1;
-    annot.time = ti;
-    
-    /* is there anything else on this line? */
-    if (logtext[i] == '\r' || logtext[i] == '\n')
-	return edittype;	/* nothing more to parse */
-
-    else if (logtext[i] != ',' && logtext[i] != '-') return -1;
-	/* something else is there but it can't be parsed */
-
-    else if (logtext[i] == '-') {
-	/* it looks like tf is there */
-	q = p + i+1;
-	for (++i; p[i]; i++)
-	    if (p[i] < '0' || p[i] > '9') break;
-	p[i] = '\0';
-	if (strlen(q) == 0 || sscanf(q, "%ld", &tf) != 1 || tf < ti)
-	    return -1;
-
-	/* no support for tf in the WFDB library yet; warn, but continue
-	   parsing the rest of this log entry */
-	fprintf(stderr, "(warning): no support for tf at %ld", annot.time);
-
-	if (logtext[i] == '\r' || logtext[i] == '\n')
-	    return edittype;	/* nothing more to parse */
-    }
-    
-    /* next should be anntype */
-    q = p + i+1;
-    /* look for end of anntype, but skip the first character since it
-       might be '{' or ',' if a non-standard type was defined */
-    for (i += 2; p[i] && p[i] != ',' && p[i] != '{'; i++)
-	;
-    p[i] = '\0';
-    annot.anntyp = strann(q);
-    if (annot.anntyp == NOTQRS) {
-	/* unrecognized type string: set anntyp to NOTE, copy string to aux */
-	annot.anntyp = NOTE;
-	*(q-1) = strlen(q);	/* aux strings have byte count prefix */
-	SSTRCPY(annot.aux, q-1);
-    }
-    
-    /* is (subtype/chan/num) present? */
-    if (logtext[i] == '{') {
-	for (j = ++i; p[j] && p[j] != '/'; j++)
-	    ;
-	if (p[j] != '/') return -1;
-	if (j > i) { p[j] = '\0'; annot.subtyp = atoi(p+i); }
-	i = j+1;
-	
-	for (j = i; p[j] && p[j] != '/'; j++)
-	    ;
-	if (p[j] != '/') return -1;
-	if (j > i) { p[j] = '\0'; annot.chan = atoi(p+i); }
-	i = j+1;
-	
-	for (j = i; p[j] && p[j] != '}'; j++)
-	    ;
-	if (p[j] != '}') return -1;
-	if (j > i) { p[j] = '\0'; annot.num = atoi(p+i); }
-	i = j+1;
-    }
-    
-    /* is aux present? */
-    if (logtext[i] == ',') {
-	int len = strlen(p+i+1), maxlen = 255;
-
-	if (annot.aux) {  /* true if type was unrecognized, see above */
-	    unsigned char *s = annot.aux + strlen(annot.aux) - 1;
-	    p[i--] = ':';   /* prefix user-specified aux with type and colon */
-	    while (s > annot.aux)
-		p[i--] = *s--; /* safe (annot.aux is a substring of p[0..i]) */
-	}
-	len = strlen(p+i+1);
-	if (len > 255) {  /* check length and truncated if necessary */
-	    fprintf(stderr, "(warning): aux will be truncated at %ld",
-		    annot.time);
-	    len = 255;
-	    p[i+len+1] == '\0';
-	}
-	p[i] = len;	/* aux strings have byte count prefix */
-	SSTRCPY(annot.aux, p+i);
+    if (!fgets(logtext, sizeof(logtext), logfile)) return 0;
+    return lw_edit_parse(logtext, &annot);
+}
+
+/* Make room for at least one more element in v. */
+static void grow(struct axvec *v)
+{
+    if (v->n >= v->size) {
+	v->size = v->size ? 2 * v->size : 1024;
+	SREALLOC(v->a, v->size, sizeof(struct ax));
     }
+}
+
+/* Return the sort key of annot. */
+static long long sort_key() {
+    return lw_edit_key(&annot);
+}
+
+/* Load the fields of annot into *ap. */
+static void get_ax(struct ax *ap) {
+    ap->t0 = sort_key();
+    ap->seq = nseq++;
+    ap->anntyp = annot.anntyp;
+    ap->subtyp = annot.subtyp;
+    ap->deleted = 0;
+    ap->aux = NULL;
+    if (annot.aux && *(annot.aux)) SSTRCPY(ap->aux, annot.aux);
+}
+
+/* Set the fields of annot from *ap. */
+static void set_annot(struct ax *ap) {
+    annot.anntyp = ap->anntyp;
+    annot.subtyp = ap->subtyp;
+    annot.chan = ((ap->t0) >> 8) & 255;
+    annot.num = ((ap->t0) & 255) - 128;
+    annot.time = (ap->t0) >> 16;
+    annot.aux = ap->aux;
+}
 
-    return edittype;  /* 1 (insertion), or 2 (deletion) */
+/* Write *ap to the output annotation file. */
+void put_ax(struct ax *ap) {
+    set_annot(ap);
+    putann(0, &annot);
 }
 
 /* Insert annot into the in-memory annotation array in time/chan/num order. */
 int insert_ann() {
-    struct ax *ap, *apthis;
-
-    /* Allocate memory for the annotation to be inserted. */
-    SUALLOC(apthis, sizeof(struct ax), 1);
-
-    /* Load the fields of annot into *apthis. */
-    apthis->anntyp = annot.anntyp;
-    apthis->subtyp = annot.subtyp;
-    apthis->t0 = (annot.time << 16) |
-	((annot.chan & 255) << 8) | ((annot.num + 128) & 255);
-    if (annot.aux && *(annot.aux)) SSTRCPY(apthis->aux, annot.aux);
-
-    /* Find the correct position for *apthis and insert it there. */
-    for (ap = aptail; ap; ap = ap->prev) {
-	if (ap->t0 < apthis->t0) { /* insert apthis between ap and ap->next */
-	    apthis->prev = ap;		/* link apthis to its predecessor ... */
-	    apthis->next = ap->next;   /* and to its successor (may be null) */
-	    apthis->prev->next = apthis;  /* link its predecessor to apthis */
-	    if (apthis->next)	       /* if apthis has a successor ... */
-		apthis->next->prev = apthis;  /* link it back to apthis */
-	    else aptail = apthis;      /* otherwise apthis is now the tail */
-	    break;
-	}
+    struct ax *ap;
+    long long t0 = sort_key();
+
+    /* An annotation that sorts after all of the others can be
+       appended to ann;  others wait in pending until the next merge. */
+    if (pending.n == 0 && (ann.n == 0 || ann.a[ann.n-1].t0 < t0)) {
+	grow(&ann);
+	ap = &ann.a[ann.n++];
+    }
+    else {
+	grow(&pending);
+	ap = &pending.a[pending.n++];
     }
+
+    get_ax(ap);
+    if (pending.n > PENDMIN && pending.n * pending.n > ann.n)
+	flush_pending();
     return 1;
 }
 
-/* delete an exact match of annot, if it exists, from the in-memory array */
-int delete_ann() {
-    long long t0;
-    struct ax *ap;
+/* Return nonzero if *ap is an exact match for annot (with sort key t0). */
+static int match_ann(struct ax *ap, long long t0) {
+    char *aux = (annot.aux && *(annot.aux)) ? (char *)annot.aux : NULL;
 
-    t0 = (annot.time << 16) | ((annot.chan&255) << 8) | ((annot.num+128) & 255);
-    for (ap = aptail; ap; ap = ap->prev) {
-	if (t0 == ap->t0 &&
+    return (!ap->deleted && t0 == ap->t0 &&
 	    annot.anntyp == ap->anntyp && annot.subtyp == ap->subtyp &&
-	    (!annot.aux && !ap->aux) ||
-	     (annot.aux && ap->aux && !strcmp(annot.aux, ap->aux))) {
-	    ap->prev->next = ap->next;     /* link predecessor to successor */
-	    if (ap->next)		   /* if ap has a successor ... */
-		ap->next->prev = ap->prev; /* link successor to predecessor */
-	    else aptail = ap->prev; /* otherwise predecessor is now the tail */ 
+	    ((!aux && !ap->aux) || (aux && ap->aux && !strcmp(aux, ap->aux))));
+}
+
+/* delete an exact match of annot, if it exists, from the in-memory array */
+int delete_ann() {
+    long long t0 = sort_key();
+    long i, lo, hi, mid;
+    struct ax *ap, *found = NULL;
+
+    /* Find the first element of ann with a key greater than t0, then search
+       backward through those with a key equal to t0. */
+    for (lo = 0, hi = ann.n; lo < hi; ) {
+	mid = lo + (hi - lo) / 2;
+	if (ann.a[mid].t0 <= t0) lo = mid + 1;
+	else hi = mid;
+    }
+    for (i = lo - 1; i >= 0 && ann.a[i].t0 == t0; i--) {
+	if (match_ann(&ann.a[i], t0)) {
+	    ap = &ann.a[i];
+	    ap->deleted = 1;
 	    SFREE(ap->aux);
-	    SFREE(ap);
+	    ndeleted++;
 	    return 1;
 	}
     }
+
+    /* Pending annotations precede those in ann with equal keys, and the
+       oldest of them is the last. */
+    for (i = 0, ap = pending.a; i < pending.n; i++, ap++)
+	if (match_ann(ap, t0) && (!found || ap->seq < found->seq))
+	    found = ap;
+    if (found) {
+	SFREE(found->aux);
+	*found = pending.a[--pending.n];
+	return 1;
+    }
     return 0;
 }
+
+/* Comparison function for sorting pending by key, and in reverse order of
+   insertion for equal keys. */
+static int compare_ax(const void *a, const void *b) {
+    const struct ax *x = a, *y = b;
+
+    if (x->t0 != y->t0) return (x->t0 < y->t0) ? -1 : 1;
+    return (x->seq > y->seq) ? -1 : (x->seq < y->seq);
+}
+
+/* Merge pending into ann, removing deleted elements of ann. */
+void flush_pending() {
+    long i, j, k;
+
+    if (ndeleted > 0) {
+	for (i = j = 0; i < ann.n; i++)
+	    if (!ann.a[i].deleted) ann.a[j++] = ann.a[i];
+	ann.n = j;
+	ndeleted = 0;
+    }
+    if (pending.n == 0) return;
+    qsort(pending.a, pending.n, sizeof(struct ax), compare_ax);
+    if (ann.size < ann.n + pending.n) {
+	ann.size = ann.n + pending.n;
+	SREALLOC(ann.a, ann.size, sizeof(struct ax));
+    }
+
+    /* Merge from the end, so that no extra space is needed.  Elements of
+       pending precede elements of ann with equal keys. */
+    i = ann.n - 1;
+    j = pending.n - 1;
+    for (k = ann.n + pending.n - 1; j >= 0; k--) {
+	if (i >= 0 && ann.a[i].t0 >= pending.a[j].t0)
+	    ann.a[k] = ann.a[i--];
+	else
+	    ann.a[k] = pending.a[j--];
+    }
+    ann.n += pending.n;
+    pending.n = 0;
+}
+
+/* Release the in-memory annotation array. */
+void clear_anns() {
+    long i;
+
+    for (i = 0; i < ann.n; i++)
+	SFREE(ann.a[i].aux);
+    for (i = 0; i < pending.n; i++)
+	SFREE(pending.a[i].aux);
+    SFREE(ann.a);
+    SFREE(pending.a);
+    ann.n = ann.size = pending.n = pending.size = 0;
+    ndeleted = 0;
+}
+
+/* Comparison function for restoring the original order of edits. */
+static int compare_seq(const void *a, const void *b) {
+    const struct lw_edit *x = a, *y = b;
+
+    return (x->seq > y->seq) - (x->seq < y->seq);
+}
+
+/* Apply the saved edits to the in-memory array, in their original order. */
+void replay_edits() {
+    long i;
+
+    qsort(edits.e, edits.n, sizeof(struct lw_edit), compare_seq);
+    for (i = 0; i < edits.n; i++) {
+	lw_edit_annot(&edits.e[i], &annot);
+	if (edits.e[i].type == LW_EDIT_INSERT) insert_ann();
+	else delete_ann();
+    }
+}
+
+/* Merge the saved edits into the original annotations (if have_input is
+   nonzero) while copying them to the output annotation file (see editlog.c).
+   The result is the same as that of applying them to the in-memory array.
+   Return 0 if successful, or -1 if the original annotations are not in
+   canonical order (in which case the output is incomplete). */
+int stream_merge(int have_input) {
+    struct lw_merge m;
+    int status;
+
+    lw_edits_sort(&edits);
+    lw_merge_start(&m, &edits, have_input, 0, 0LL);
+    while ((status = lw_merge_next(&m, &annot)) == 0)
+	putann(0, &annot);
+    lw_merge_end(&m);
+    return (status == -2) ? -1 : 0;
+}
+
+/* Fold the journal jname into the annotation file in the same directory, and
+   truncate the journal.  Return 0 if successful, 1 if the journal can't be
+   read, or 2 if the annotation file can't be replaced. */
+int compact(char *pname, char *jname) {
+    char *path = NULL, *dir, *p, *q, *tfname = NULL, *tpath = NULL,
+	*ofname = NULL;
+    int have_input, status;
+    size_t len;
+    FILE *jfile;
+    WFDB_Anninfo ai[2];
+
+    /* Find the directory, record, and annotator names. */
+    SSTRCPY(path, jname);
+    if (p = strrchr(path, '/')) { *p++ = '\0'; dir = path; }
+    else { p = path; dir = "."; }
+    len = strlen(p);
+    q = strchr(p, '.');
+    if (len <= strlen(LW_JOURNAL_SUFFIX) || q == NULL || q == p ||
+	strcmp(p + (len -= strlen(LW_JOURNAL_SUFFIX)), LW_JOURNAL_SUFFIX) ||
+	q >= p + len - 1) {
+	fprintf(stderr, "%s: %s is not a journal (RECORD.ANNOTATOR%s)\n",
+		pname, jname, LW_JOURNAL_SUFFIX);
+	SFREE(path);
+	return 1;
+    }
+    p[len] = *q = '\0';
+    SSTRCPY(record, p);
+    SSTRCPY(annotator, q + 1);
+
+    /* Read the journal, and keep it locked until it has been truncated. */
+    if ((jfile = fopen(jname, "r+")) == NULL ||
+	flock(fileno(jfile), LOCK_EX) != 0 || chdir(dir) != 0) {
+	fprintf(stderr, "%s: can't read %s\n", pname, jname);
+	if (jfile) fclose(jfile);
+	SFREE(path);
+	return 1;
+    }
+    lw_edits_read(&edits, jfile, 0);
+    setwfdb(".");
+
+    ai[0].name = annotator;
+    ai[0].stat = WFDB_READ;
+    SUALLOC(tfname, strlen(annotator) + 2, 1);
+    sprintf(tfname, "%s~", annotator);
+    ai[1].name = tfname;
+    ai[1].stat = WFDB_WRITE;
+    have_input = (annopen(record, ai, 1) == 0);
+    status = write_output(pname, ai, have_input, 1);
+    wfdbquit();
+    SUALLOC(tpath, strlen(record) + strlen(tfname) + 2, 1);
+    sprintf(tpath, "%s.%s", record, tfname);
+    SUALLOC(ofname, strlen(record) + strlen(annotator) + 2, 1);
+    sprintf(ofname, "%s.%s", record, annotator);
+    if (status == 0 && rename(tpath, ofname) != 0) {
+	unlink(tpath);
+	status = 2;
+    }
+    if (status == 0) {
+	fflush(jfile);
+	if (ftruncate(fileno(jfile), 0) != 0)
+	    fprintf(stderr, "%s: can't truncate %s\n", pname, jname);
+    }
+    else
+	fprintf(stderr, "%s: can't write output annotation file '%s/%s'\n",
+		pname, dir, ofname);
+    fclose(jfile);		/* this also releases the lock */
+
+    lw_edits_free(&edits);
+    SFREE(ofname);
+    SFREE(tpath);
+    SFREE(tfname);
+    SFREE(record);
+    SFREE(annotator);
+    SFREE(path);
+    return status;
+}
+
+/* Add an edit log to blog. */
+static void add_log(char *path, struct stat *sp) {
+    if (nblog % 256 == 0)
+	SREALLOC(blog, nblog + 256, sizeof(struct batchlog));
+    memset(&blog[nblog], 0, sizeof(struct batchlog));
+    SSTRCPY(blog[nblog].path, path);
+    if (sp) blog[nblog].mtime = sp->st_mtim;
+    blog[nblog].order = nblog;
+    nblog++;
+}
+
+/* Comparison function for sorting the logs in a directory by their
+   modification times, and then by name. */
+static int compare_mtime(const void *a, const void *b) {
+    const struct batchlog *x = a, *y = b;
+
+    if (x->mtime.tv_sec != y->mtime.tv_sec)
+	return (x->mtime.tv_sec < y->mtime.tv_sec) ? -1 : 1;
+    if (x->mtime.tv_nsec != y->mtime.tv_nsec)
+	return (x->mtime.tv_nsec < y->mtime.tv_nsec) ? -1 : 1;
+    return strcmp(x->path, y->path);
+}
+
+/* Comparison function for grouping the logs by record and annotator, keeping
+   those in each group in order. */
+static int compare_logs(const void *a, const void *b) {
+    const struct batchlog *x = a, *y = b;
+    int c;
+
+    if ((c = strcmp(x->record, y->record)) != 0) return c;
+    if ((c = strcmp(x->annotator, y->annotator)) != 0) return c;
+    return (x->order > y->order) - (x->order < y->order);
+}
+
+/* Read the edit logs in group i and apply them (a pool job). */
+static int patch_group(long i, FILE *ofile, void *arg) {
+    char *pname = arg;
+    int status = 0;
+    long j;
+
+    for (j = bgroup[i]; j < bgroup[i+1] && status == 0; j++) {
+	if ((logfile = fopen(blog[j].path, "r")) == NULL ||
+	    parse_log_header() == 0) {
+	    fprintf(stderr, "%s: can't read %s\n", pname, blog[j].path);
+	    status = 1;
+	}
+	else
+	    lw_edits_read(&edits, logfile, 0);
+	if (logfile) fclose(logfile);
+    }
+
+    /* The later logs in a group may delete annotations inserted by the one
+       that can't be read, so the group is skipped rather than applied in
+       part, and its annotation file is left as it was. */
+    if (status) {
+	fprintf(stderr, "%s: skipping the edit logs for %s, annotator %s\n",
+		pname, blog[bgroup[i]].record, blog[bgroup[i]].annotator);
+	lw_edits_free(&edits);
+	SFREE(record);
+	SFREE(annotator);
+	return status;
+    }
+    SSTRCPY(record, blog[bgroup[i]].record);
+    SSTRCPY(annotator, blog[bgroup[i]].annotator);
+    if (patch(pname, 1) != 0)
+	status = 2;
+    SFREE(record);
+    SFREE(annotator);
+    return status;
+}
+
+/* Process the edit logs in source (a directory, or a manifest listing their
+   pathnames), using up to nworkers processes.  Return the exit status. */
+int batch(char *pname, char *source, int nworkers) {
+    char *line = NULL, *path = NULL;
+    int bad = 0;
+    long failed, i, j, ngroup;
+    size_t size = 0;
+    struct dirent *dp;
+    struct stat st;
+    DIR *dir;
+    FILE *mfile;
+
+    if (stat(source, &st) != 0) {
+	fprintf(stderr, "%s: can't read %s\n", pname, source);
+	return 1;
+    }
+    if (S_ISDIR(st.st_mode)) {
+	if ((dir = opendir(source)) == NULL) {
+	    fprintf(stderr, "%s: can't read %s\n", pname, source);
+	    return 1;
+	}
+	while (dp = readdir(dir)) {
+	    if (*(dp->d_name) == '.') continue;
+	    SALLOC(path, strlen(source) + strlen(dp->d_name) + 2, 1);
+	    sprintf(path, "%s/%s", source, dp->d_name);
+	    if (stat(path, &st) == 0 && S_ISREG(st.st_mode))
+		add_log(path, &st);
+	}
+	closedir(dir);
+	SFREE(path);
+	qsort(blog, nblog, sizeof(struct batchlog), compare_mtime);
+	for (i = 0; i < nblog; i++)
+	    blog[i].order = i;
+    }
+    else if (mfile = fopen(source, "r")) {
+	while (getline(&line, &size, mfile) > 0) {
+	    line[strcspn(line, "\r\n")] = '\0';
+	    if (*line && *line != '#')
+		add_log(line, NULL);
+	}
+	free(line);
+	fclose(mfile);
+    }
+    else {
+	fprintf(stderr, "%s: can't read %s\n", pname, source);
+	return 1;
+    }
+
+    /* Read the header of each log, and drop those that can't be parsed. */
+    for (i = j = 0; i < nblog; i++) {
+	if ((logfile = fopen(blog[i].path, "r")) && parse_log_header()) {
+	    blog[i].record = record;
+	    blog[i].annotator = annotator;
+	    record = annotator = NULL;
+	    blog[j++] = blog[i];
+	}
+	else {
+	    fprintf(stderr, "%s: can't parse %s (format error)\n", pname,
+		    blog[i].path);
+	    SFREE(blog[i].path);
+	    bad++;
+	}
+	if (logfile) fclose(logfile);
+    }
+    nblog = j;
+
+    /* Group the logs, and process the groups in parallel. */
+    qsort(blog, nblog, sizeof(struct batchlog), compare_logs);
+    SUALLOC(bgroup, nblog + 1, sizeof(long));
+    for (i = ngroup = 0; i < nblog; i++)
+	if (i == 0 || strcmp(blog[i-1].record, blog[i].record) ||
+	    strcmp(blog[i-1].annotator, blog[i].annotator))
+	    bgroup[ngroup++] = i;
+    bgroup[ngroup] = nblog;
+    failed = lw_pool_run(ngroup, nworkers, patch_group, pname, stdout);
+    if (failed < 0) {
+	fprintf(stderr, "%s: can't run worker processes\n", pname);
+	return 3;
+    }
+    if (failed > 0)
+	fprintf(stderr, "%s: %ld of %ld annotation files could not be"
+		" written\n", pname, failed, ngroup);
+
+    for (i = 0; i < nblog; i++) {
+	SFREE(blog[i].path);
+	SFREE(blog[i].record);
+	SFREE(blog[i].annotator);
+    }
+    SFREE(blog);
+    SFREE(bgroup);
+    return (failed > 0 || bad > 0) ? 2 : 0;
+}
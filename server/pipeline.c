@@ -0,0 +1,304 @@
+/* file: pipeline.c		18 October 2026
+
+Pipelined decoding and formatting of signals for the LightWAVE server
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+_______________________________________________________________________________
+
+A fetch request is answered in three stages that run concurrently:
+
+ - a decoder thread reads frames with the WFDB library and appends the samples
+   of each signal to its track (the WFDB library is not thread-safe, so this is
+   the only thread that may use it while the pipeline runs);
+
+ - encoder threads format each track, LW_PIPE_CHUNK samples at a time, as
+   first differences in decimal (as print_samples() does), or as an
+   error-bounded code (see codec.c) if the track has an error bound, into a
+   buffer of its own for each chunk;  and
+
+ - the writer (the thread that started the pipeline) copies the chunks to the
+   output in order, one track after another, as soon as each is ready.
+
+The first chunk can thus be sent soon after the first frames are read, rather
+than after the whole window has been read and formatted, and the formatting of
+many signals is spread over all of the available processors.  Encoders claim
+the first ready chunk of the lowest-numbered track that has one, so that the
+chunks that the writer needs next are formatted first.  While it waits, the
+writer encodes the next chunk itself if no encoder has claimed it, so the
+pipeline makes progress even without encoder threads;  if the decoder thread
+can't be created, the decoder runs to completion before anything is written.
+*/
+
+#define _GNU_SOURCE
+#include <sched.h>
+#include <stdlib.h>
+#include "alloc.h"
+#include "codec.h"
+#include "emit.h"
+#include "pipeline.h"
+
+/* Return the number of encoder threads to be used:  one for each processor
+   that this process can use, other than the one taken by the decoder. */
+int lw_pipe_nencoders(void)
+{
+    cpu_set_t cpus;
+    int n;
+
+    if (sched_getaffinity(0, sizeof(cpus), &cpus) != 0)
+        return (0);
+    n = CPU_COUNT(&cpus) - 1;
+    return (n < LW_PIPE_MAXENCODERS ? n : LW_PIPE_MAXENCODERS);
+}
+
+/* Return nonzero if chunk j of track t can be encoded (the caller holds the
+   lock). */
+static int chunk_ready(const struct lw_pipe_track *t, long j)
+{
+    return ((j + 1) * LW_PIPE_CHUNK <= t->avail ||
+            (t->done && j * LW_PIPE_CHUNK < t->avail));
+}
+
+/* Return nonzero if track t has no chunk j (the caller holds the lock). */
+static int chunk_absent(const struct lw_pipe_track *t, long j)
+{
+    return (j >= t->nchunks || (t->done && j * LW_PIPE_CHUNK >= t->avail));
+}
+
+/* Format chunk j of track t, of which the first n samples of samp have been
+   decoded.  This is called without the lock, after the chunk has been
+   claimed, so that chunks can be encoded concurrently. */
+static void encode(struct lw_pipe_track *t, const WFDB_Sample *samp, long n,
+                   long j)
+{
+    struct lw_pipe_chunk *c = &t->chunk[j];
+    const WFDB_Sample *sp = samp + j * LW_PIPE_CHUNK, *se;
+    char *q;
+    int prev = (j > 0) ? sp[-1] : 0;
+
+    se = (n - j * LW_PIPE_CHUNK < LW_PIPE_CHUNK) ? samp + n
+        : sp + LW_PIPE_CHUNK;
+    if (t->maxerr >= 0) {
+        SUALLOC(c->buf, lw_code_bound(se - sp) + 1, 1);
+        q = c->buf;
+        if (j > 0)
+            *q++ = ',';
+        q += lw_code(sp, se - sp, t->maxerr, q, &c->err);
+        c->len = q - c->buf;
+        return;
+    }
+    SUALLOC(c->buf, (se - sp) * (OUT_LONGMAX + 1), 1);
+    for (q = c->buf; sp < se; sp++) {
+        if (sp > samp)
+            *q++ = ',';
+        q += lw_fmt_long(q, *sp - prev);
+        prev = *sp;
+    }
+    c->len = q - c->buf;
+}
+
+/* Claim the next chunk to be encoded, if any is ready (the caller holds the
+   lock).  Return its track number and set *jp to its chunk number, or return
+   -1. */
+static int claim(struct lw_pipeline *p, long *jp)
+{
+    struct lw_pipe_track *t;
+    int i;
+
+    for (i = 0, t = p->track; i < p->ntracks; i++, t++)
+        if (t->nclaimed < t->nchunks && chunk_ready(t, t->nclaimed)) {
+            *jp = t->nclaimed++;
+            return (i);
+        }
+    return (-1);
+}
+
+static void *encoder_main(void *arg)
+{
+    struct lw_pipeline *p = arg;
+    struct lw_pipe_track *t;
+    const WFDB_Sample *samp;
+    long j, n;
+    int i;
+
+    pthread_mutex_lock(&p->lock);
+    for (;;) {
+        if ((i = claim(p, &j)) >= 0) {
+            t = &p->track[i];
+            samp = t->samp;
+            n = t->avail;
+            pthread_mutex_unlock(&p->lock);
+            encode(t, samp, n, j);
+            pthread_mutex_lock(&p->lock);
+            t->chunk[j].encoded = 1;
+            pthread_cond_broadcast(&p->ready);
+        }
+        else if (p->finished)
+            break;
+        else
+            pthread_cond_wait(&p->work, &p->lock);
+    }
+    pthread_mutex_unlock(&p->lock);
+    return (NULL);
+}
+
+/* Run the decoder, then mark all tracks as complete. */
+static void *decoder_main(void *arg)
+{
+    struct lw_pipeline *p = arg;
+    int i;
+
+    p->decode(p, p->arg);
+    lw_pipe_lock(p);
+    for (i = 0; i < p->ntracks; i++)
+        p->track[i].done = 1;
+    p->finished = 1;
+    lw_pipe_unlock(p);
+    return (NULL);
+}
+
+/* Start a pipeline with ntracks tracks, of which track i will have no more
+   than maxsamp[i] samples, coded with an error bound of maxerr[i] if that is
+   not negative (or in decimal if maxerr is NULL), using up to nencoders
+   encoder threads.  The decoder is called (in a thread of its own, if
+   possible) with arg as its second argument. */
+void lw_pipe_start(struct lw_pipeline *p, int ntracks, const long *maxsamp,
+                   const int *maxerr, int nencoders, lw_pipe_decoder decode,
+                   void *arg)
+{
+    pthread_attr_t attr;
+    int i;
+
+    p->ntracks = ntracks;
+    SUALLOC(p->track, ntracks, sizeof(struct lw_pipe_track));
+    for (i = 0; i < ntracks; i++) {
+        p->track[i].nchunks = (maxsamp[i] + LW_PIPE_CHUNK - 1) / LW_PIPE_CHUNK;
+        p->track[i].maxerr = maxerr ? maxerr[i] : -1;
+        SUALLOC(p->track[i].chunk, p->track[i].nchunks,
+                sizeof(struct lw_pipe_chunk));
+    }
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->work, NULL);
+    pthread_cond_init(&p->ready, NULL);
+    p->finished = 0;
+    p->decode = decode;
+    p->arg = arg;
+
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, LW_PIPE_STACKSIZE);
+    if (nencoders > LW_PIPE_MAXENCODERS)
+        nencoders = LW_PIPE_MAXENCODERS;
+    for (p->nencoders = 0; p->nencoders < nencoders; p->nencoders++)
+        if (pthread_create(&p->encoder[p->nencoders], &attr, encoder_main, p))
+            break;
+    p->threaded = (pthread_create(&p->decoder, &attr, decoder_main, p) == 0);
+    pthread_attr_destroy(&attr);
+    if (!p->threaded)
+        decoder_main(p);
+}
+
+/* The decoder calls lw_pipe_update() to report that the first avail samples
+   of track i (starting at samp) have been decoded, and that there will be no
+   more if done is nonzero.  Several tracks can be updated between a call to
+   lw_pipe_lock() and a call to lw_pipe_unlock(), which wakes the encoders and
+   the writer. */
+void lw_pipe_lock(struct lw_pipeline *p)
+{
+    pthread_mutex_lock(&p->lock);
+}
+
+void lw_pipe_update(struct lw_pipeline *p, int i, const WFDB_Sample *samp,
+                    long avail, int done)
+{
+    struct lw_pipe_track *t = &p->track[i];
+
+    t->samp = samp;
+    t->avail = (avail < t->nchunks * LW_PIPE_CHUNK) ? avail
+        : t->nchunks * LW_PIPE_CHUNK;
+    t->done = done;
+}
+
+void lw_pipe_unlock(struct lw_pipeline *p)
+{
+    pthread_cond_broadcast(&p->work);
+    pthread_cond_broadcast(&p->ready);
+    pthread_mutex_unlock(&p->lock);
+}
+
+/* Write the samples of track i to ofile as they become available, and return
+   the number of samples written. */
+long lw_pipe_write(struct lw_pipeline *p, int i, FILE *ofile)
+{
+    struct lw_pipe_track *t = &p->track[i];
+    struct lw_pipe_chunk *c;
+    const WFDB_Sample *samp;
+    long j, n;
+
+    pthread_mutex_lock(&p->lock);
+    for (j = 0; ; j++) {
+        while (!chunk_absent(t, j) && !t->chunk[j].encoded) {
+            if (t->nclaimed == j && chunk_ready(t, j)) {
+                t->nclaimed++;
+                samp = t->samp;
+                n = t->avail;
+                pthread_mutex_unlock(&p->lock);
+                encode(t, samp, n, j);
+                pthread_mutex_lock(&p->lock);
+                t->chunk[j].encoded = 1;
+            }
+            else
+                pthread_cond_wait(&p->ready, &p->lock);
+        }
+        if (chunk_absent(t, j))
+            break;
+        c = &t->chunk[j];
+        if (c->err > t->err)
+            t->err = c->err;
+        pthread_mutex_unlock(&p->lock);
+        fwrite(c->buf, 1, c->len, ofile);
+        fflush(ofile);
+        SFREE(c->buf);
+        pthread_mutex_lock(&p->lock);
+    }
+    n = t->avail;
+    pthread_mutex_unlock(&p->lock);
+    return (n);
+}
+
+/* Return the largest error in the coded samples of track i written so far. */
+int lw_pipe_error(struct lw_pipeline *p, int i)
+{
+    return (p->track[i].err);
+}
+
+/* Wait for the decoder and the encoders to finish, and release the
+   pipeline's resources. */
+void lw_pipe_end(struct lw_pipeline *p)
+{
+    int i;
+    long j;
+
+    if (p->threaded)
+        pthread_join(p->decoder, NULL);
+    for (i = 0; i < p->nencoders; i++)
+        pthread_join(p->encoder[i], NULL);
+    for (i = 0; i < p->ntracks; i++) {
+        for (j = 0; j < p->track[i].nchunks; j++)
+            SFREE(p->track[i].chunk[j].buf);
+        SFREE(p->track[i].chunk);
+    }
+    SFREE(p->track);
+    pthread_cond_destroy(&p->ready);
+    pthread_cond_destroy(&p->work);
+    pthread_mutex_destroy(&p->lock);
+}
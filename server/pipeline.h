@@ -0,0 +1,86 @@
+/* file: pipeline.h		18 October 2026
+
+Pipelined decoding and formatting of signals for the LightWAVE server
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LIGHTWAVE_PIPELINE_H
+#define LIGHTWAVE_PIPELINE_H
+
+#include <pthread.h>
+#include <stdio.h>
+#include <wfdb/wfdb.h>
+
+/* Number of samples of a track that are formatted as a unit (a chunk). */
+#define LW_PIPE_CHUNK	4096
+
+/* Largest number of encoder threads. */
+#define LW_PIPE_MAXENCODERS 8
+
+/* Stack size of the decoder and encoder threads. */
+#define LW_PIPE_STACKSIZE (1024 * 1024)
+
+struct lw_pipe_chunk {
+    char *buf;		/* formatted samples (NULL until encoded) */
+    size_t len;		/* length of buf */
+    int encoded;	/* nonzero if buf is complete */
+    int err;		/* largest coding error (see codec.c) */
+};
+
+/* A track is the sequence of samples of one signal to be written. */
+struct lw_pipe_track {
+    const WFDB_Sample *samp;	/* samples */
+    long avail;			/* number of samples in samp so far */
+    int done;			/* nonzero if there will be no more samples */
+    long nchunks;		/* largest number of chunks */
+    long nclaimed;		/* number of chunks claimed for encoding */
+    int maxerr;			/* error bound for coding, or -1 if none */
+    int err;			/* largest coding error in chunks written */
+    struct lw_pipe_chunk *chunk;
+};
+
+struct lw_pipeline;
+
+/* A decoder fills the tracks, using lw_pipe_update(). */
+typedef void (*lw_pipe_decoder)(struct lw_pipeline *p, void *arg);
+
+struct lw_pipeline {
+    int ntracks;
+    struct lw_pipe_track *track;
+    pthread_mutex_t lock;
+    pthread_cond_t work;	/* signalled when samples are added */
+    pthread_cond_t ready;	/* signalled when a chunk has been encoded */
+    int finished;		/* nonzero when the decoder has returned */
+    lw_pipe_decoder decode;
+    void *arg;
+    int threaded;		/* nonzero if the decoder runs in a thread */
+    pthread_t decoder;
+    int nencoders;
+    pthread_t encoder[LW_PIPE_MAXENCODERS];
+};
+
+int lw_pipe_nencoders(void);
+void lw_pipe_start(struct lw_pipeline *p, int ntracks, const long *maxsamp,
+                   const int *maxerr, int nencoders, lw_pipe_decoder decode,
+                   void *arg);
+void lw_pipe_lock(struct lw_pipeline *p);
+void lw_pipe_update(struct lw_pipeline *p, int i, const WFDB_Sample *samp,
+                    long avail, int done);
+void lw_pipe_unlock(struct lw_pipeline *p);
+long lw_pipe_write(struct lw_pipeline *p, int i, FILE *ofile);
+int lw_pipe_error(struct lw_pipeline *p, int i);
+void lw_pipe_end(struct lw_pipeline *p);
+
+#endif
@@ -0,0 +1,175 @@
+/* file: pool.c			18 October 2026
+
+Fork-based worker pool for database-wide LightWAVE tools
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+_______________________________________________________________________________
+
+The WFDB library keeps all of its state (open signal and annotation files,
+calibration data, the current record) in static variables, so it cannot be
+used by more than one thread at a time.  Tools that scan every record of a
+database therefore run their jobs in forked worker processes instead.
+
+lw_pool_run() runs njobs jobs using up to nworkers processes.  Workers take
+the next unclaimed job number from a counter in shared memory, so that a few
+slow records (on a remote server, for example) do not hold up the others.
+Each worker collects the output of its jobs in a temporary file; when all of
+the workers have finished, the outputs are copied to ofile in job order, so
+the result does not depend on the number of workers or on scheduling.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "pool.h"
+
+/* Return the default number of workers (the number of online CPUs). */
+int lw_pool_nworkers(void)
+{
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return (n > 0 ? (int)n : 1);
+}
+
+/* Run job i, capturing its output, and append a record of the form
+   "i status length\n" followed by the output itself to tfile. */
+static int pool_run_one(long i, lw_pool_job job, void *arg, FILE *tfile)
+{
+    char *obuf = NULL;
+    size_t olen = 0;
+    FILE *ostr;
+    int status;
+
+    if ((ostr = open_memstream(&obuf, &olen)) == NULL)
+        return (-1);
+    status = job(i, ostr, arg);
+    fclose(ostr);
+    fprintf(tfile, "%ld %d %lu\n", i, status, (unsigned long)olen);
+    fwrite(obuf, 1, olen, tfile);
+    free(obuf);
+    return (status);
+}
+
+/* Run jobs 0 ... njobs-1 and return the number of jobs that failed (or -1 if
+   the workers could not be started). */
+long lw_pool_run(long njobs, int nworkers, lw_pool_job job, void *arg,
+                 FILE *ofile)
+{
+    FILE **tfile;
+    char **out;
+    long failed = 0, i, *next;
+    size_t *outlen;
+    int *status, w, wstatus;
+    pid_t *pid;
+
+    if (njobs <= 0)
+        return (0);
+    if (nworkers < 1)
+        nworkers = lw_pool_nworkers();
+    if (nworkers > njobs)
+        nworkers = (int)njobs;
+
+    /* With a single worker, run the jobs in this process. */
+    if (nworkers == 1) {
+        for (i = 0; i < njobs; i++)
+            if (job(i, ofile ? ofile : stdout, arg) != 0)
+                failed++;
+        return (failed);
+    }
+
+    next = mmap(NULL, sizeof(long), PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (next == MAP_FAILED)
+        return (-1);
+    *next = 0;
+
+    tfile = calloc(nworkers, sizeof(FILE *));
+    pid = calloc(nworkers, sizeof(pid_t));
+    if (!tfile || !pid) {
+        munmap(next, sizeof(long));
+        free(tfile);
+        free(pid);
+        return (-1);
+    }
+
+    if (ofile) fflush(ofile);
+    fflush(stdout);
+    fflush(stderr);
+    for (w = 0; w < nworkers; w++) {
+        if ((tfile[w] = tmpfile()) == NULL || (pid[w] = fork()) < 0) {
+            failed = -1;
+            break;
+        }
+        if (pid[w] == 0) {	/* worker process */
+            while ((i = __atomic_fetch_add(next, 1, __ATOMIC_RELAXED))
+                   < njobs)
+                pool_run_one(i, job, arg, tfile[w]);
+            fflush(tfile[w]);
+            _exit(ferror(tfile[w]) ? 1 : 0);
+        }
+    }
+    while (--w >= 0) {
+        if (waitpid(pid[w], &wstatus, 0) != pid[w]
+            || !WIFEXITED(wstatus) || WEXITSTATUS(wstatus) != 0)
+            failed = -1;
+    }
+    munmap(next, sizeof(long));
+
+    /* Collect the outputs and write them in job order.  Jobs that produced
+       no record (because their worker crashed) count as failures. */
+    out = calloc(njobs, sizeof(char *));
+    outlen = calloc(njobs, sizeof(size_t));
+    status = calloc(njobs, sizeof(int));
+    if (!out || !outlen || !status)
+        failed = -1;
+    for (i = 0; failed >= 0 && i < njobs; i++)
+        status[i] = -1;
+    for (w = 0; w < nworkers; w++) {
+        unsigned long len;
+        int st;
+
+        if (!tfile[w])
+            continue;
+        rewind(tfile[w]);
+        while (failed >= 0
+               && fscanf(tfile[w], "%ld %d %lu", &i, &st, &len) == 3
+               && getc(tfile[w]) == '\n' && i >= 0 && i < njobs) {
+            if ((out[i] = malloc(len + 1)) == NULL
+                || fread(out[i], 1, len, tfile[w]) != len) {
+                failed = -1;
+                break;
+            }
+            outlen[i] = len;
+            status[i] = st;
+        }
+        fclose(tfile[w]);
+    }
+    for (i = 0; failed >= 0 && i < njobs; i++) {
+        if (out[i] && ofile)
+            fwrite(out[i], 1, outlen[i], ofile);
+        if (status[i] != 0)
+            failed++;
+    }
+    for (i = 0; out && i < njobs; i++)
+        free(out[i]);
+    free(out);
+    free(outlen);
+    free(status);
+    free(tfile);
+    free(pid);
+    return (failed);
+}
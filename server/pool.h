@@ -0,0 +1,32 @@
+/* file: pool.h			18 October 2026
+
+Fork-based worker pool for database-wide LightWAVE tools
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LIGHTWAVE_POOL_H
+#define LIGHTWAVE_POOL_H
+
+#include <stdio.h>
+
+/* A pool job processes item i, writing any output to ofile, and returns 0 on
+   success or nonzero on failure. */
+typedef int (*lw_pool_job)(long i, FILE *ofile, void *arg);
+
+int lw_pool_nworkers(void);
+long lw_pool_run(long njobs, int nworkers, lw_pool_job job, void *arg,
+                 FILE *ofile);
+
+#endif
@@ -0,0 +1,181 @@
+/* file: readahead.c		18 October 2026
+
+Read-ahead of signal files for sequential access
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+_______________________________________________________________________________
+
+When the client plays a record or scrolls through it, it fetches consecutive
+windows, each in a new server process.  The kernel's own read-ahead does not
+help much across processes (and not at all when scrolling backward), so each
+fetch of a local record asks the kernel (with posix_fadvise) to start reading
+the parts of the signal files that the next windows will need, while the
+client is busy with the current one.
+
+Whether access is sequential is decided from the previous fetch of the same
+record, which is remembered in a file (LW_RA_FILE) that every process maps
+into its memory, as for the statistics file (see stats.c).  The file holds a
+fixed table of slots, indexed by a hash of the record name;  a record whose
+slot is taken by another record simply starts again.  A fetch that starts
+within one window after the end of the previous one continues a forward run,
+and one that ends within one window before the start of the previous one
+continues a backward run;  the number of windows read ahead grows with the
+length of the run, up to LW_RA_MAXWINDOWS.  Slots are updated without locks,
+so concurrent requests for one record may occasionally lose an update, but
+the table is used only for hints.
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "readahead.h"
+#include "shmfile.h"
+
+#define LW_RA_MAGIC	0x4c575241	/* "LWRA" */
+#define LW_RA_NSLOT	1024		/* must be a power of 2 */
+
+struct lw_ra_slot {
+    uint64_t key;	/* hash of the record name, or 0 if unused */
+    int64_t t0, tf;	/* frames fetched by the previous request */
+    int32_t dir;	/* direction of the current run (1, -1, or 0) */
+    int32_t run;	/* length of the current run */
+    int64_t when;	/* time of the previous request (seconds) */
+};
+
+struct lw_ra_region {
+    uint32_t magic;
+    uint32_t nslot;
+    struct lw_ra_slot slot[LW_RA_NSLOT];
+};
+
+static struct lw_ra_region *region;
+
+#define LOAD(x)		__atomic_load_n(&(x), __ATOMIC_RELAXED)
+#define STORE(x, v)	__atomic_store_n(&(x), (v), __ATOMIC_RELAXED)
+
+/* Open (creating if necessary) and map the read-ahead state file in dir.  If
+   this fails, read-ahead is disabled. */
+void lw_ra_attach(const char *dir)
+{
+    void *p;
+    int status;
+
+    if (region || !dir)
+        return;
+    if ((status = lw_shm_attach(dir, LW_RA_FILE, sizeof(struct lw_ra_region),
+                                LW_RA_MAGIC, &p)) < 0)
+        return;
+    region = p;
+    if (status == 1)
+        region->nslot = LW_RA_NSLOT;
+}
+
+static uint64_t hash_name(const char *name)
+{
+    uint64_t h = 14695981039346656037ULL;
+
+    while (*name)
+        h = (h ^ (unsigned char) *name++) * 1099511628211ULL;
+    return (h ? h : 1);
+}
+
+/* Record a fetch of frames t0 through tf-1 of record, and return the number
+   of windows of the same length that should be read ahead:  positive to read
+   forward from tf, negative to read backward from t0, or 0 if access does
+   not appear to be sequential. */
+int lw_ra_note(const char *record, long t0, long tf)
+{
+    struct lw_ra_slot *sl;
+    uint64_t key;
+    int64_t lt0, ltf, now = time(NULL);
+    long dt = tf - t0;
+    int dir = 0, run = 0;
+
+    if (region == NULL || dt <= 0)
+        return (0);
+    key = hash_name(record);
+    sl = &region->slot[key & (LW_RA_NSLOT - 1)];
+    if (LOAD(sl->key) == key && now - LOAD(sl->when) <= LW_RA_TIMEOUT) {
+        lt0 = LOAD(sl->t0);
+        ltf = LOAD(sl->tf);
+        if (t0 > lt0 && t0 <= ltf + dt)
+            dir = 1;
+        else if (t0 < lt0 && tf >= lt0 - dt)
+            dir = -1;
+        if (dir)
+            run = (dir == LOAD(sl->dir)) ? LOAD(sl->run) + 1 : 1;
+    }
+    STORE(sl->key, key);
+    STORE(sl->t0, t0);
+    STORE(sl->tf, tf);
+    STORE(sl->dir, dir);
+    STORE(sl->run, run);
+    STORE(sl->when, now);
+    if (run > LW_RA_MAXWINDOWS)
+        run = LW_RA_MAXWINDOWS;
+    return (dir * run);
+}
+
+/* Return the number of bytes occupied by a sample in a signal file of the
+   given WFDB storage format, or 0 if samples are not stored at fixed
+   intervals (as in compressed formats). */
+double lw_ra_sample_bytes(int fmt)
+{
+    switch (fmt) {
+      case 8: case 80:
+        return (1.);
+      case 16: case 61: case 160:
+        return (2.);
+      case 212:
+        return (1.5);
+      case 310: case 311:
+        return (4. / 3.);
+      case 24:
+        return (3.);
+      case 32:
+        return (4.);
+      default:
+        return (0.);
+    }
+}
+
+/* Ask the kernel to read frames ta through tb-1 of the signal file named by
+   path, in which each frame occupies frame_bytes bytes, without waiting for
+   the data.  If the range is too long, the part nearest the current window
+   (which precedes it if dir is positive, or follows it otherwise) is kept. */
+void lw_ra_hint(const char *path, double frame_bytes, long ta, long tb,
+                int dir)
+{
+    int fd;
+    off_t begin, end;
+
+    if (frame_bytes <= 0. || ta >= tb)
+        return;
+    if ((fd = open(path, O_RDONLY)) < 0)
+        return;
+    begin = (off_t)(ta * frame_bytes);
+    end = (off_t)(tb * frame_bytes) + 1;
+    if (end - begin > LW_RA_MAXBYTES) {
+        if (dir > 0)
+            end = begin + LW_RA_MAXBYTES;
+        else
+            begin = end - LW_RA_MAXBYTES;
+    }
+    posix_fadvise(fd, begin, end - begin, POSIX_FADV_WILLNEED);
+    close(fd);
+}
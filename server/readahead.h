@@ -0,0 +1,41 @@
+/* file: readahead.h		18 October 2026
+
+Read-ahead of signal files for sequential access
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LIGHTWAVE_READAHEAD_H
+#define LIGHTWAVE_READAHEAD_H
+
+/* Name of the read-ahead state file, which is created in the LightWAVE root
+   directory ($LIGHTWAVE_ROOT). */
+#define LW_RA_FILE ".lightwave-readahead"
+
+/* Largest number of windows to be read ahead. */
+#define LW_RA_MAXWINDOWS 4
+
+/* Largest number of bytes of a signal file to be read ahead at once. */
+#define LW_RA_MAXBYTES (64L * 1024 * 1024)
+
+/* Number of seconds after which a record's access pattern is forgotten. */
+#define LW_RA_TIMEOUT 120
+
+void lw_ra_attach(const char *dir);
+int lw_ra_note(const char *record, long t0, long tf);
+double lw_ra_sample_bytes(int fmt);
+void lw_ra_hint(const char *path, double frame_bytes, long ta, long tb,
+                int dir);
+
+#endif
@@ -0,0 +1,173 @@
+/* file: resample.c		18 October 2026
+
+Rational arithmetic and polyphase resampling for the LightWAVE server
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+_______________________________________________________________________________
+
+The sampling frequencies of the signals in a WFDB record are all integer
+multiples (the numbers of samples per frame) of the frame frequency, so the
+server keeps time in "ticks" whose frequency is the frame frequency times the
+largest number of samples per frame (the units of WFDB_HIGHRES annotation
+times).  Times in frames are converted to ticks, and samples of the signals
+whose numbers of samples per frame divide the largest one to ticks, by integer
+multiplication, without rounding.  The other signals are resampled onto the
+tick grid.
+
+A signal is resampled by a rational factor up/down by (conceptually)
+inserting up-1 zeros between its samples, low-pass filtering the result, and
+keeping every down'th sample of the output.  lw_resample() computes only the
+output samples that are kept, using only the taps of the filter that meet
+input samples (the polyphase form), so that the cost per output sample is
+about 2 * LW_RESAMPLE_ZEROS * max(up, down) / up multiplications.  The filter
+is a Blackman-windowed sinc whose cutoff is 90% of the lower of the input and
+output Nyquist frequencies.  The taps used for each output phase are scaled to
+sum to 1, so that a constant input is reproduced exactly.
+*/
+
+#include <limits.h>
+#include <math.h>
+#include <stdlib.h>
+#include "alloc.h"
+#include "resample.h"
+
+#ifndef M_PI
+#define M_PI	3.14159265358979323846
+#endif
+
+#define ROLLOFF	0.9	/* cutoff, as a fraction of the lower Nyquist rate */
+
+/* Return the greatest common divisor of two positive numbers. */
+long lw_gcd(long a, long b)
+{
+    long t;
+
+    while (b > 0) {
+        t = a % b;
+        a = b;
+        b = t;
+    }
+    return (a);
+}
+
+/* Find the fraction num/den (with den <= maxden) that is closest to x > 0,
+   using its continued fraction expansion.  Return 0 if num/den equals x (to
+   within one part in 10^12), 1 if it is an approximation, or -1 if x is too
+   small to be approximated with a denominator no larger than maxden. */
+int lw_rational(double x, long maxden, long *num, long *den)
+{
+    long a, h0 = 0, h1 = 1, k0 = 1, k1 = 0, t;
+    double f = x;
+
+    if (!(x > 0.) || x > (double)(LONG_MAX / 2) / maxden)
+        return (-1);
+    for (;;) {
+        a = (long)floor(f);
+        if (k1 > 0 && a > (maxden - k0) / k1)
+            break;		/* the next denominator would be too large */
+        t = a * h1 + h0; h0 = h1; h1 = t;
+        t = a * k1 + k0; k0 = k1; k1 = t;
+        if (fabs(x - (double)h1 / k1) <= 1e-12 * x || f - a <= 0.)
+            break;
+        f = 1. / (f - a);
+    }
+    if (h1 < 1)
+        return (-1);
+    *num = h1;
+    *den = k1;
+    return (fabs(x - (double)h1 / k1) > 1e-12 * x);
+}
+
+/* Design the filter for resampling by up/down (which should be in lowest
+   terms).  Return 0 if successful, or -1 if either factor is too large. */
+int lw_resample_init(struct lw_resampler *r, long up, long down)
+{
+    double fc, *sum, w, x;
+    long d, m = (up > down) ? up : down;
+
+    r->up = up;
+    r->down = down;
+    r->h = NULL;
+    if (up < 1 || down < 1 || m > LW_RESAMPLE_MAX)
+        return (-1);
+
+    /* The cutoff, fc, is in cycles per upsampled interval. */
+    fc = 0.5 * ROLLOFF / m;
+    r->half = (long)ceil(LW_RESAMPLE_ZEROS / (2. * fc));
+    SUALLOC(r->h, 2 * r->half + 1, sizeof(double));
+    SUALLOC(sum, up, sizeof(double));
+    for (d = -r->half; d <= r->half; d++) {
+        x = 2. * fc * d;
+        w = 0.42 + 0.5 * cos(M_PI * d / r->half)
+            + 0.08 * cos(2. * M_PI * d / r->half);
+        r->h[d + r->half] = w * ((d == 0) ? 1. : sin(M_PI * x) / (M_PI * x));
+        sum[((d % up) + up) % up] += r->h[d + r->half];
+    }
+    for (d = -r->half; d <= r->half; d++)
+        r->h[d + r->half] /= sum[((d % up) + up) % up];
+    SFREE(sum);
+    return (0);
+}
+
+/* Return the number of input samples needed on each side of the samples to
+   be resampled. */
+long lw_resample_margin(const struct lw_resampler *r)
+{
+    return (r->half / r->up + 1);
+}
+
+/* Return floor(a / b), for b > 0. */
+static long long floor_div(long long a, long b)
+{
+    return ((a >= 0) ? a / b : -((-a + b - 1) / b));
+}
+
+/* Compute nout output samples, the first of which coincides with input sample
+   in[start].  Input samples before in[0] or after in[nin-1] are taken to be
+   equal to them.  An output sample is invalid if any of the input samples that
+   contribute to it are invalid. */
+void lw_resample(const struct lw_resampler *r, const WFDB_Sample *in,
+                 long nin, long start, WFDB_Sample *out, long nout)
+{
+    double acc;
+    int invalid;
+    long i, k;
+    long long j, jhi, pos;
+    WFDB_Sample v;
+
+    for (k = 0; k < nout; k++) {
+        pos = (long long)start * r->up + (long long)k * r->down;
+        jhi = floor_div(pos + r->half, r->up);
+        acc = 0.;
+        invalid = 0;
+        for (j = -floor_div(r->half - pos, r->up); j <= jhi; j++) {
+            i = (j < 0) ? 0 : (j >= nin) ? nin - 1 : (long)j;
+            if ((v = in[i]) == WFDB_INVALID_SAMPLE) {
+                invalid = 1;
+                break;
+            }
+            acc += r->h[pos - j * r->up + r->half] * v;
+        }
+        if (invalid)
+            out[k] = WFDB_INVALID_SAMPLE;
+        else if ((out[k] = (WFDB_Sample)floor(acc + 0.5))
+                 == WFDB_INVALID_SAMPLE)
+            out[k]++;
+    }
+}
+
+void lw_resample_free(struct lw_resampler *r)
+{
+    SFREE(r->h);
+}
@@ -0,0 +1,50 @@
+/* file: resample.h		18 October 2026
+
+Rational arithmetic and polyphase resampling for the LightWAVE server
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LIGHTWAVE_RESAMPLE_H
+#define LIGHTWAVE_RESAMPLE_H
+
+#include <wfdb/wfdb.h>
+
+#ifndef WFDB_INVALID_SAMPLE	/* defined by WFDB 10.5.0 and later */
+#define WFDB_INVALID_SAMPLE (-32768)
+#endif
+
+/* Largest interpolation or decimation factor accepted by lw_resample_init()
+   (the filter table has about 2 * LW_RESAMPLE_ZEROS * factor entries). */
+#define LW_RESAMPLE_MAX	4096
+
+/* Number of zero crossings of the filter's impulse response on each side of
+   its center. */
+#define LW_RESAMPLE_ZEROS 8
+
+struct lw_resampler {
+    long up, down;	/* output rate / input rate = up / down */
+    long half;		/* half-length of h, in upsampled intervals */
+    double *h;		/* filter (2*half + 1 taps, centered at h[half]) */
+};
+
+long lw_gcd(long a, long b);
+int lw_rational(double x, long maxden, long *num, long *den);
+int lw_resample_init(struct lw_resampler *r, long up, long down);
+long lw_resample_margin(const struct lw_resampler *r);
+void lw_resample(const struct lw_resampler *r, const WFDB_Sample *in,
+                 long nin, long start, WFDB_Sample *out, long nout);
+void lw_resample_free(struct lw_resampler *r);
+
+#endif
@@ -23,12 +23,20 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <errno.h>
 #include <fcntl.h>
+#include <sched.h>
+#include <sys/file.h>
 #include <sys/mman.h>
 #include <sys/resource.h>
 #include <sys/prctl.h>
 #include <signal.h>
+#include <linux/filter.h>
+#include <linux/seccomp.h>
 #include <seccomp.h>
+#include "readahead.h"
+#include "sandbox.h"
+#include "stats.h"
 
 #ifndef SYS_SECCOMP
 # define SYS_SECCOMP 1
@@ -100,13 +108,60 @@ static void handle_sigsys(int signum, siginfo_t *info, void *context0)
     raise(signum);
 }
 
-void lightwave_sandbox()
+/* Per-process state prepared by sandbox_prepare(), and used by
+   lightwave_sandbox() to enter the sandbox.  In zygote mode (see zygote.c)
+   the state is prepared once, in the zygote, and inherited by each child. */
+static scmp_filter_ctx ctx;
+static struct sock_fprog filter;  /* compiled filter, if exported */
+static char *calbuf;		  /* contents of $LIGHTWAVE_WFDBCAL */
+static size_t callen;
+static int calfd = -1, prepared, zygote;
+
+static void set_rlimits(void)
+{
+    set_hard_rlimit(RLIMIT_CORE, 0);
+    set_hard_rlimit(RLIMIT_SIGPENDING, 256);
+    set_hard_rlimit(RLIMIT_MEMLOCK, 1024 * 1024);
+    set_hard_rlimit(RLIMIT_NOFILE, 256);
+    set_hard_rlimit(RLIMIT_MSGQUEUE, 0);
+    set_hard_rlimit(RLIMIT_NPROC, 1000);
+    set_hard_rlimit(RLIMIT_AS, 512 * 1024 * 1024);
+}
+
+/* These limits are set in each child of the zygote rather than in the
+   zygote itself, since the zygote runs indefinitely and needs to write the
+   compiled filter and each child's copy of the calibration file. */
+static void set_child_rlimits(void)
+{
+    set_hard_rlimit(RLIMIT_FSIZE, 0);
+    set_hard_rlimit(RLIMIT_CPU, 60);
+}
+
+/* Read the calibration file into memory, so that each child of the zygote
+   can be given its own copy as its standard input. */
+static void read_calfile(const char *dbcalfile)
+{
+    FILE *f;
+    size_t n, size = 0;
+
+    if ((f = fopen(dbcalfile, "r")) == NULL)
+        FAILERR("cannot read $LIGHTWAVE_WFDBCAL");
+    do {
+        size = size ? 2 * size : 8192;
+        if ((calbuf = realloc(calbuf, size)) == NULL)
+            FAIL("out of memory");
+        n = fread(calbuf + callen, 1, size - callen, f);
+        callen += n;
+    } while (callen == size);
+    fclose(f);
+}
+
+static void sandbox_prepare(void)
 {
     uid_t realuid = getuid();
     gid_t realgid = getgid();
     char *rootdir, *dbcalfile;
     struct sigaction sa;
-    scmp_filter_ctx ctx;
 
     /* chdir and chroot into $LIGHTWAVE_ROOT, so only files in that
        directory can be read */
@@ -128,13 +183,22 @@ void lightwave_sandbox()
        calibration file stored outside the root directory. */
     dbcalfile = getenv("LIGHTWAVE_WFDBCAL");
     if (dbcalfile) {
-        if (!freopen(dbcalfile, "r", stdin))
+        if (zygote)
+            read_calfile(dbcalfile);
+        else if (!freopen(dbcalfile, "r", stdin))
             FAILERR("cannot read $LIGHTWAVE_WFDBCAL");
         setenv("WFDBCAL", "-", 1);
     }
 
     if (chdir(rootdir) != 0)
         FAILERR("cannot chdir to $LIGHTWAVE_ROOT");
+
+    /* map the statistics and read-ahead state files (see stats.c and
+       readahead.c) while they can still be created, before the root is
+       locked down */
+    lw_stats_attach(".");
+    lw_ra_attach(".");
+
     if (seteuid(0) != 0)
         FAILERR("cannot set effective user ID");
     if (chroot(".") != 0)
@@ -145,15 +209,9 @@ void lightwave_sandbox()
         FAILERR("cannot set no-new-privs");
 
     /* resource limits */
-    set_hard_rlimit(RLIMIT_CORE, 0);
-    set_hard_rlimit(RLIMIT_FSIZE, 0);
-    set_hard_rlimit(RLIMIT_SIGPENDING, 256);
-    set_hard_rlimit(RLIMIT_MEMLOCK, 1024 * 1024);
-    set_hard_rlimit(RLIMIT_NOFILE, 256);
-    set_hard_rlimit(RLIMIT_MSGQUEUE, 0);
-    set_hard_rlimit(RLIMIT_CPU, 60);
-    set_hard_rlimit(RLIMIT_NPROC, 1000);
-    set_hard_rlimit(RLIMIT_AS, 512 * 1024 * 1024);
+    set_rlimits();
+    if (!zygote)
+        set_child_rlimits();
 
     /* handle SIGSYS by displaying an error message and exiting */
     sa.sa_sigaction = &handle_sigsys;
@@ -175,6 +233,18 @@ void lightwave_sandbox()
     seccomp_rule_add_exact(ctx, SCMP_ACT_ALLOW, SCMP_SYS(exit_group), 0);
     seccomp_rule_add_exact(ctx, SCMP_ACT_ALLOW, SCMP_SYS(getcwd), 0);
     seccomp_rule_add_exact(ctx, SCMP_ACT_ALLOW, SCMP_SYS(munmap), 0);
+    seccomp_rule_add_exact(ctx, SCMP_ACT_ALLOW, SCMP_SYS(clock_gettime), 0);
+    /* for reporting the peak memory use of requests (debug=alloc) */
+    seccomp_rule_add_exact(ctx, SCMP_ACT_ALLOW, SCMP_SYS(getrusage), 0);
+    /* for pacing 'play' requests */
+    seccomp_rule_add_exact(ctx, SCMP_ACT_ALLOW, SCMP_SYS(nanosleep), 0);
+    seccomp_rule_add_exact(ctx, SCMP_ACT_ALLOW, SCMP_SYS(clock_nanosleep), 0);
+    /* for watching growing records in 'follow' requests */
+    seccomp_rule_add_exact(ctx, SCMP_ACT_ALLOW, SCMP_SYS(inotify_init1), 0);
+    seccomp_rule_add_exact
+        (ctx, SCMP_ACT_ALLOW, SCMP_SYS(inotify_add_watch), 0);
+    seccomp_rule_add_exact(ctx, SCMP_ACT_ALLOW, SCMP_SYS(poll), 0);
+    seccomp_rule_add_exact(ctx, SCMP_ACT_ALLOW, SCMP_SYS(ppoll), 0);
 
     /* permit open(..., O_RDONLY) and openat(AT_FDCWD, ..., O_RDONLY)
        (openat without AT_FDCWD would allow a local attacker to escape
@@ -188,15 +258,123 @@ void lightwave_sandbox()
          SCMP_A0(SCMP_CMP_EQ, (uint32_t) AT_FDCWD),
          SCMP_A2(SCMP_CMP_EQ, O_RDONLY));
 
+    /* permit flock(..., LOCK_SH), so that edit journals (see editlog.h)
+       can be read while they are not being compacted */
+    seccomp_rule_add_exact
+        (ctx, SCMP_ACT_ALLOW, SCMP_SYS(flock), 1,
+         SCMP_A1(SCMP_CMP_EQ, LOCK_SH));
+
     /* permit mmap(..., PROT_READ|PROT_WRITE, MAP_ANONYMOUS|MAP_PRIVATE, ...)
        (typically lightwave doesn't allocate any huge blocks of memory
-       that would make this necessary, but it's good future-proofing) */
+       that would make this necessary, but it's good future-proofing);
+       thread stacks add MAP_STACK, and the malloc arenas of threads
+       add MAP_NORESERVE */
     seccomp_rule_add_exact
         (ctx, SCMP_ACT_ALLOW, SCMP_SYS(mmap), 2,
          SCMP_A2(SCMP_CMP_MASKED_EQ, ~(PROT_READ | PROT_WRITE), 0),
          SCMP_A3(SCMP_CMP_EQ, (MAP_ANONYMOUS | MAP_PRIVATE)));
+    seccomp_rule_add_exact
+        (ctx, SCMP_ACT_ALLOW, SCMP_SYS(mmap), 2,
+         SCMP_A2(SCMP_CMP_MASKED_EQ, ~(PROT_READ | PROT_WRITE), 0),
+         SCMP_A3(SCMP_CMP_EQ, (MAP_ANONYMOUS | MAP_PRIVATE | MAP_STACK)));
+    seccomp_rule_add_exact
+        (ctx, SCMP_ACT_ALLOW, SCMP_SYS(mmap), 2,
+         SCMP_A2(SCMP_CMP_MASKED_EQ, ~(PROT_READ | PROT_WRITE), 0),
+         SCMP_A3(SCMP_CMP_EQ,
+                 (MAP_ANONYMOUS | MAP_PRIVATE | MAP_NORESERVE)));
+
+    /* permit the system calls used to run the threads of the fetch
+       pipeline (see pipeline.c):  clone only for new threads (not new
+       processes), mprotect only without PROT_EXEC, and the calls made by
+       the C library to start, synchronize, and end threads.  clone3 can't
+       be filtered by its flags (they are passed in memory), so it fails
+       with ENOSYS, and the C library then falls back to clone. */
+    seccomp_rule_add_exact
+        (ctx, SCMP_ACT_ALLOW, SCMP_SYS(clone), 1,
+         SCMP_A0(SCMP_CMP_MASKED_EQ, CLONE_THREAD, CLONE_THREAD));
+    seccomp_rule_add_exact(ctx, SCMP_ACT_ERRNO(ENOSYS), SCMP_SYS(clone3), 0);
+    seccomp_rule_add_exact
+        (ctx, SCMP_ACT_ALLOW, SCMP_SYS(mprotect), 1,
+         SCMP_A2(SCMP_CMP_MASKED_EQ, ~(PROT_READ | PROT_WRITE), 0));
+    seccomp_rule_add_exact(ctx, SCMP_ACT_ALLOW, SCMP_SYS(futex), 0);
+    seccomp_rule_add_exact(ctx, SCMP_ACT_ALLOW, SCMP_SYS(set_robust_list), 0);
+    seccomp_rule_add_exact(ctx, SCMP_ACT_ALLOW, SCMP_SYS(rseq), 0);
+    seccomp_rule_add_exact(ctx, SCMP_ACT_ALLOW, SCMP_SYS(rt_sigprocmask), 0);
+    seccomp_rule_add_exact(ctx, SCMP_ACT_ALLOW, SCMP_SYS(madvise), 0);
+    seccomp_rule_add_exact(ctx, SCMP_ACT_ALLOW, SCMP_SYS(exit), 0);
+    seccomp_rule_add_exact
+        (ctx, SCMP_ACT_ALLOW, SCMP_SYS(sched_getaffinity), 0);
+
+    /* permit posix_fadvise, which only affects the page cache, so that
+       signal files can be read ahead (see readahead.c) */
+    seccomp_rule_add_exact(ctx, SCMP_ACT_ALLOW, SCMP_SYS(fadvise64), 0);
+
+    prepared = 1;
+}
+
+/* Compile the filter to BPF, so that the children of the zygote can load
+   it with a single system call. */
+static void export_filter(void)
+{
+    int fd;
+    off_t len;
+
+    if ((fd = memfd_create("lightwave-seccomp", 0)) < 0)
+        FAILERR("cannot create memory file");
+    if (seccomp_export_bpf(ctx, fd) != 0)
+        FAIL("seccomp_export_bpf failed");
+    if ((len = lseek(fd, 0, SEEK_END)) <= 0 || lseek(fd, 0, SEEK_SET) != 0)
+        FAILERR("cannot read compiled filter");
+    if ((filter.filter = malloc(len)) == NULL)
+        FAIL("out of memory");
+    if (read(fd, filter.filter, len) != len)
+        FAILERR("cannot read compiled filter");
+    filter.len = len / sizeof(struct sock_filter);
+    close(fd);
+}
+
+/* Prepare the sandbox in the zygote (everything but loading the filter). */
+void lightwave_sandbox_zygote()
+{
+    zygote = 1;
+    sandbox_prepare();
+    export_filter();
+}
+
+/* Complete the per-process setup in a new child of the zygote, before it
+   waits for a request. */
+void lightwave_sandbox_child()
+{
+    /* Give this process its own copy of the calibration file, which
+       becomes its standard input in lightwave_sandbox(). */
+    if (calbuf) {
+        if ((calfd = memfd_create("wfdbcal", 0)) < 0
+            || write(calfd, calbuf, callen) != (ssize_t) callen
+            || lseek(calfd, 0, SEEK_SET) != 0)
+            FAILERR("cannot read $LIGHTWAVE_WFDBCAL");
+    }
+    set_child_rlimits();
+}
+
+void lightwave_sandbox()
+{
+    if (!prepared)
+        sandbox_prepare();
+
+    if (calfd >= 0) {
+        if (dup2(calfd, STDIN_FILENO) < 0)
+            FAILERR("cannot read $LIGHTWAVE_WFDBCAL");
+        close(calfd);
+        clearerr(stdin);
+        setenv("WFDBCAL", "-", 1);
+    }
 
     /* activate the filter */
-    if (seccomp_load(ctx) != 0)
+    if (filter.filter) {
+        if (prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &filter, 0UL, 0UL)
+            != 0)
+            FAIL("cannot load seccomp filter");
+    }
+    else if (seccomp_load(ctx) != 0)
         FAIL("seccomp_load failed");
 }
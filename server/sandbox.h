@@ -22,15 +22,35 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #ifndef SANDBOX
 #include <unistd.h>
+#include "readahead.h"
+#include "stats.h"
 static void lightwave_sandbox()
 {
     if (geteuid() == 0 || getegid() == 0) {
         fprintf(stderr, "lightwave: refusing to run as superuser\n");
         abort();
     }
+    lw_stats_attach(getenv("LIGHTWAVE_ROOT"));
+    lw_ra_attach(getenv("LIGHTWAVE_ROOT"));
+}
+
+/* Zygote mode (see zygote.c) is available only in sandboxed-lightwave. */
+static void lightwave_zygote(int argc, char **argv)
+{
+    fprintf(stderr, "lightwave: -z requires sandboxed-lightwave\n");
+    exit(1);
+}
+
+static int lightwave_forward(void)
+{
+    return (0);
 }
 #else
 void lightwave_sandbox();
+void lightwave_sandbox_zygote();
+void lightwave_sandbox_child();
+void lightwave_zygote(int argc, char **argv);
+int lightwave_forward(void);
 #endif
 
 #endif
@@ -0,0 +1,78 @@
+/* file: shmfile.c		18 October 2026
+
+Files shared in memory by LightWAVE server processes
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+_______________________________________________________________________________
+
+The statistics file (see stats.c) and the read-ahead state file (see
+readahead.c) are mapped into the memory of every server process, so that
+state that spans requests can be updated without locks or system calls.
+Each begins with a 32-bit magic number, which is 0 in a file that has just
+been created;  the first process to see a new file sets the magic number (by
+an atomic compare-and-swap) and initializes the rest of the file's header.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "shmfile.h"
+
+/* Open (creating if necessary) the file called name in dir, extend it to at
+   least size bytes, and map the first size bytes into memory, setting *pp
+   to the mapping.  Return 1 if this process set the file's magic number
+   (and should initialize its header), 0 if the file had already been
+   initialized, or -1 if the file could not be mapped or has another magic
+   number (an unknown layout). */
+int lw_shm_attach(const char *dir, const char *name, size_t size,
+                  uint32_t magic, void **pp)
+{
+    char *path;
+    int fd;
+    struct stat st;
+    uint32_t zero = 0;
+    void *p;
+
+    if ((path = malloc(strlen(dir) + strlen(name) + 2)) == NULL)
+        return (-1);
+    sprintf(path, "%s/%s", dir, name);
+    fd = open(path, O_RDWR | O_CREAT, 0644);
+    free(path);
+    if (fd < 0)
+        return (-1);
+    if (fstat(fd, &st) != 0
+        || (st.st_size < (off_t) size && ftruncate(fd, size) != 0)) {
+        close(fd);
+        return (-1);
+    }
+    p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED)
+        return (-1);
+    if (__atomic_compare_exchange_n((uint32_t *) p, &zero, magic, 0,
+                                    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        *pp = p;
+        return (1);
+    }
+    if (zero != magic) {	/* file has an unknown layout */
+        munmap(p, size);
+        return (-1);
+    }
+    *pp = p;
+    return (0);
+}
@@ -0,0 +1,28 @@
+/* file: shmfile.h		18 October 2026
+
+Files shared in memory by LightWAVE server processes
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LIGHTWAVE_SHMFILE_H
+#define LIGHTWAVE_SHMFILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+int lw_shm_attach(const char *dir, const char *name, size_t size,
+                  uint32_t magic, void **pp);
+
+#endif
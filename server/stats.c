@@ -0,0 +1,301 @@
+/* file: stats.c		18 October 2026
+
+Shared-memory performance counters for the LightWAVE server
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+_______________________________________________________________________________
+
+Each LightWAVE request is handled by a separate process, so statistics that
+span requests are kept in a file (LW_STATS_FILE) that every process maps
+into its memory.  The file is attached before the sandbox is set up (see
+sandbox.c), so no system calls are needed to update it afterwards.  If it
+cannot be created or opened (for example, if the LightWAVE root directory is
+not writable by the web server and the file has not been created in advance),
+statistics are silently disabled.
+
+The file contains a table of databases, each with a set of counters and a
+latency histogram for each action.  All updates are atomic additions, so no
+locks are needed.  A database's slot is claimed the first time it is seen,
+by an atomic compare-and-swap of the slot's state;  requests that fail, that
+do not name a database, or that name a database when the table is full are
+counted under the empty name (slot 0).  Names are truncated to fit a slot.
+
+The counters are never reset;  delete the file to start again.
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "shmfile.h"
+#include "stats.h"
+
+#define LW_STATS_MAGIC		0x4c575332	/* "LWS2" */
+#define LW_STATS_NDB		128	/* database slots (including slot 0) */
+#define LW_STATS_NAMELEN	48	/* maximum database name length + 1 */
+
+static const char *action_name[] = {
+    "dblist", "rlist", "alist", "annquery", "info", "annsummary", "fetch",
+    "play", "follow", "stats", "other"
+};
+#define LW_STATS_NACTION (sizeof(action_name) / sizeof(action_name[0]))
+
+/* Streaming actions last as long as the client (or the requested duration)
+   wants, so their durations are not request latencies, and they are left out
+   of the latency histogram. */
+static int streaming(int a)
+{
+    return (strcmp(action_name[a], "play") == 0 ||
+            strcmp(action_name[a], "follow") == 0);
+}
+
+/* Upper bounds of the latency histogram buckets, in milliseconds.  The last
+   bucket (not listed) counts all longer requests. */
+static const double bucket_ms[] = {
+    1, 2.5, 5, 10, 25, 50, 100, 250, 500, 1000, 2500, 5000, 10000, 30000
+};
+#define LW_STATS_NBUCKET (sizeof(bucket_ms) / sizeof(bucket_ms[0]) + 1)
+
+struct lw_stats_cell {
+    uint64_t requests, errors, bytes, samples;
+    uint64_t latency_us;	/* sum of latencies, in microseconds */
+    uint64_t bucket[LW_STATS_NBUCKET];
+};
+
+enum { SLOT_EMPTY, SLOT_CLAIMED, SLOT_READY };
+
+struct lw_stats_db {
+    uint32_t state;
+    char name[LW_STATS_NAMELEN];
+    struct lw_stats_cell cell[LW_STATS_NACTION];
+};
+
+struct lw_stats_region {
+    uint32_t magic;
+    uint32_t ndb;
+    uint64_t started;	/* time when the file was created (seconds) */
+    struct lw_stats_db db[LW_STATS_NDB];
+};
+
+static struct lw_stats_region *region;
+
+#define ADD(x, v)	__atomic_fetch_add(&(x), (v), __ATOMIC_RELAXED)
+#define LOAD(x)		__atomic_load_n(&(x), __ATOMIC_RELAXED)
+
+/* Open (creating if necessary) and map the statistics file in dir. */
+void lw_stats_attach(const char *dir)
+{
+    void *p;
+    int status;
+
+    if (region || !dir)
+        return;
+    if ((status = lw_shm_attach(dir, LW_STATS_FILE,
+                                sizeof(struct lw_stats_region),
+                                LW_STATS_MAGIC, &p)) < 0)
+        return;
+    region = p;
+
+    /* The first process to see a new file initializes its header. */
+    if (status == 1) {
+        region->ndb = LW_STATS_NDB;
+        __atomic_store_n(&region->started, (uint64_t) time(NULL),
+                         __ATOMIC_RELEASE);
+    }
+}
+
+int lw_stats_enabled(void)
+{
+    return (region != NULL);
+}
+
+static unsigned long hash_name(const char *name)
+{
+    unsigned long h = 2166136261UL;
+
+    while (*name)
+        h = (h ^ (unsigned char) *name++) * 16777619UL;
+    return (h);
+}
+
+/* Find or claim the slot for database db. */
+static struct lw_stats_db *find_db(const char *db)
+{
+    char name[LW_STATS_NAMELEN];
+    struct lw_stats_db *d;
+    uint32_t state;
+    int i, j, spin;
+
+    if (!db || !*db)
+        return (&region->db[0]);
+    strncpy(name, db, sizeof(name) - 1);
+    name[sizeof(name) - 1] = '\0';
+    i = 1 + hash_name(name) % (LW_STATS_NDB - 1);
+    for (j = 1; j < LW_STATS_NDB; j++, i = (i % (LW_STATS_NDB - 1)) + 1) {
+        d = &region->db[i];
+        state = __atomic_load_n(&d->state, __ATOMIC_ACQUIRE);
+        if (state == SLOT_EMPTY) {
+            if (__atomic_compare_exchange_n(&d->state, &state, SLOT_CLAIMED,
+                                            0, __ATOMIC_ACQ_REL,
+                                            __ATOMIC_ACQUIRE)) {
+                memcpy(d->name, name, sizeof(name));
+                __atomic_store_n(&d->state, SLOT_READY, __ATOMIC_RELEASE);
+                return (d);
+            }
+        }
+        /* Another process may be writing the name into this slot. */
+        for (spin = 0; state == SLOT_CLAIMED && spin < 100000; spin++)
+            state = __atomic_load_n(&d->state, __ATOMIC_ACQUIRE);
+        if (state == SLOT_READY && strcmp(d->name, name) == 0)
+            return (d);
+    }
+    return (&region->db[0]);
+}
+
+static int find_action(const char *action)
+{
+    int i;
+
+    for (i = 0; action && i < LW_STATS_NACTION - 1; i++)
+        if (strcmp(action, action_name[i]) == 0)
+            return (i);
+    return (LW_STATS_NACTION - 1);
+}
+
+/* Count a request. */
+void lw_stats_record(const char *action, const char *db, int failed,
+                     double ms, unsigned long bytes, unsigned long samples)
+{
+    struct lw_stats_cell *c;
+    int a, b;
+
+    if (!region)
+        return;
+    a = find_action(action);
+    c = &find_db(failed ? NULL : db)->cell[a];
+    ADD(c->requests, 1);
+    if (failed)
+        ADD(c->errors, 1);
+    ADD(c->bytes, bytes);
+    ADD(c->samples, samples);
+    if (streaming(a))
+        return;
+    for (b = 0; b < LW_STATS_NBUCKET - 1 && ms > bucket_ms[b]; b++)
+        ;
+    ADD(c->latency_us, (uint64_t)(ms * 1000. + 0.5));
+    ADD(c->bucket[b], 1);
+}
+
+/* Print a label value, escaped as required by the Prometheus text format. */
+static void print_label(FILE *ofile, const char *s)
+{
+    for ( ; *s; s++) {
+        if (*s == '\\' || *s == '"')
+            fprintf(ofile, "\\%c", *s);
+        else if (*s == '\n')
+            fprintf(ofile, "\\n");
+        else
+            putc(*s, ofile);
+    }
+}
+
+static void print_labels(FILE *ofile, int a, struct lw_stats_db *d)
+{
+    fprintf(ofile, "{action=\"%s\",db=\"", action_name[a]);
+    print_label(ofile, d->name);
+    fprintf(ofile, "\"");
+}
+
+typedef uint64_t (*cell_field)(struct lw_stats_cell *c);
+static uint64_t f_requests(struct lw_stats_cell *c) { return LOAD(c->requests); }
+static uint64_t f_errors(struct lw_stats_cell *c) { return LOAD(c->errors); }
+static uint64_t f_bytes(struct lw_stats_cell *c) { return LOAD(c->bytes); }
+static uint64_t f_samples(struct lw_stats_cell *c) { return LOAD(c->samples); }
+
+static void print_counter(FILE *ofile, const char *name, const char *help,
+                          cell_field f)
+{
+    struct lw_stats_db *d;
+    int a, i;
+
+    fprintf(ofile, "# HELP %s %s\n# TYPE %s counter\n", name, help, name);
+    for (i = 0; i < LW_STATS_NDB; i++) {
+        d = &region->db[i];
+        if (i > 0 && LOAD(d->state) != SLOT_READY)
+            continue;
+        for (a = 0; a < LW_STATS_NACTION; a++) {
+            if (LOAD(d->cell[a].requests) == 0)
+                continue;
+            fprintf(ofile, "%s", name);
+            print_labels(ofile, a, d);
+            fprintf(ofile, "} %llu\n", (unsigned long long) f(&d->cell[a]));
+        }
+    }
+}
+
+/* Print all statistics in the Prometheus text exposition format. */
+void lw_stats_print(FILE *ofile)
+{
+    static const char *hname = "lightwave_request_duration_seconds";
+    struct lw_stats_cell *c;
+    struct lw_stats_db *d;
+    uint64_t n;
+    int a, b, i;
+
+    if (!region)
+        return;
+    fprintf(ofile, "# HELP lightwave_stats_start_time_seconds Time when"
+            " statistics collection began.\n"
+            "# TYPE lightwave_stats_start_time_seconds gauge\n"
+            "lightwave_stats_start_time_seconds %llu\n",
+            (unsigned long long) LOAD(region->started));
+    print_counter(ofile, "lightwave_requests_total",
+                  "Requests handled, by action and database.", f_requests);
+    print_counter(ofile, "lightwave_errors_total",
+                  "Requests that failed, by action.", f_errors);
+    print_counter(ofile, "lightwave_response_bytes_total",
+                  "Bytes of response bodies sent.", f_bytes);
+    print_counter(ofile, "lightwave_samples_total",
+                  "Signal samples sent.", f_samples);
+
+    fprintf(ofile, "# HELP %s Request latency.\n# TYPE %s histogram\n",
+            hname, hname);
+    for (i = 0; i < LW_STATS_NDB; i++) {
+        d = &region->db[i];
+        if (i > 0 && LOAD(d->state) != SLOT_READY)
+            continue;
+        for (a = 0; a < LW_STATS_NACTION; a++) {
+            c = &d->cell[a];
+            if (LOAD(c->requests) == 0 || streaming(a))
+                continue;
+            for (b = 0, n = 0; b < LW_STATS_NBUCKET; b++) {
+                n += LOAD(c->bucket[b]);
+                fprintf(ofile, "%s_bucket", hname);
+                print_labels(ofile, a, d);
+                if (b < LW_STATS_NBUCKET - 1)
+                    fprintf(ofile, ",le=\"%g\"} %llu\n", bucket_ms[b] / 1000.,
+                            (unsigned long long) n);
+                else
+                    fprintf(ofile, ",le=\"+Inf\"} %llu\n",
+                            (unsigned long long) n);
+            }
+            fprintf(ofile, "%s_sum", hname);
+            print_labels(ofile, a, d);
+            fprintf(ofile, "} %.6f\n", LOAD(c->latency_us) / 1e6);
+            fprintf(ofile, "%s_count", hname);
+            print_labels(ofile, a, d);
+            fprintf(ofile, "} %llu\n", (unsigned long long) n);
+        }
+    }
+}
@@ -0,0 +1,34 @@
+/* file: stats.h		18 October 2026
+
+Shared-memory performance counters for the LightWAVE server
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LIGHTWAVE_STATS_H
+#define LIGHTWAVE_STATS_H
+
+#include <stdio.h>
+
+/* Name of the statistics file, which is created in the LightWAVE root
+   directory ($LIGHTWAVE_ROOT). */
+#define LW_STATS_FILE ".lightwave-stats"
+
+void lw_stats_attach(const char *dir);
+int lw_stats_enabled(void);
+void lw_stats_record(const char *action, const char *db, int failed,
+                     double ms, unsigned long bytes, unsigned long samples);
+void lw_stats_print(FILE *ofile);
+
+#endif
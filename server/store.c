@@ -0,0 +1,321 @@
+/* file: store.c		18 October 2026
+
+Columnar record stores for the LightWAVE server
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+_______________________________________________________________________________
+
+WFDB signal files interleave the signals of a record frame by frame, so that
+reading any signal for a window means reading (and demultiplexing) all of
+them.  A store, written by lwstore from a WFDB record, keeps the samples of
+each signal together instead, in chunks of a fixed number of frames, each
+coded losslessly as a block (see codec.c).  The server reads the samples of
+the requested signals from a record's store, if it has one that is no older
+than its header (see fetchsignals()).
+
+A store contains (with all integers in little-endian byte order):
+
+    "LWSTORE1"          8 bytes
+    nsig                u32     number of signals
+    chunk               u32     frames per chunk
+    nframes             i64     record length, in frames
+    freq                f64     frame frequency, in Hz
+    index               i64     offset of the chunk index
+
+followed by a description of each signal, mirroring its WFDB_Siginfo:
+
+    desc, units         u16 length, then that many bytes (units is omitted,
+                        as 0xffff, if the header doesn't specify it)
+    gain                f64
+    initval, group, fmt, spf, bsize, adcres, adczero, baseline
+                        i32 each
+    nsamp               i64
+    cksum               i32
+
+followed by the coded chunks, all those of signal 0 in order, then those of
+signal 1, and so on.  The chunk index consists of an entry for each chunk in
+the same order:
+
+    t0, tf              i64 each  frames t0 through tf-1 are in the chunk
+    offset              i64       location of the coded chunk in the store
+    len                 u32       length of the coded chunk
+    min, max            i32 each  range of the valid samples in the chunk
+*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "alloc.h"
+#include "codec.h"
+#include "store.h"
+
+/* Offset of the 'index' field of the header. */
+#define STORE_INDEX_OFFSET 32
+
+static void put_u16(FILE *f, uint32_t v)
+{
+    putc(v & 0xff, f);
+    putc((v >> 8) & 0xff, f);
+}
+
+static void put_u32(FILE *f, uint32_t v)
+{
+    put_u16(f, v & 0xffff);
+    put_u16(f, v >> 16);
+}
+
+static void put_u64(FILE *f, uint64_t v)
+{
+    put_u32(f, (uint32_t)v);
+    put_u32(f, (uint32_t)(v >> 32));
+}
+
+static void put_f64(FILE *f, double x)
+{
+    uint64_t v;
+
+    memcpy(&v, &x, sizeof(v));
+    put_u64(f, v);
+}
+
+static void put_str(FILE *f, const char *s)
+{
+    size_t n;
+
+    if (s == NULL) {
+        put_u16(f, 0xffff);
+        return;
+    }
+    if ((n = strlen(s)) > 0xfffe)
+        n = 0xfffe;
+    put_u16(f, n);
+    fwrite(s, 1, n, f);
+}
+
+/* The get_ functions set *ok to 0 at the end of the file. */
+static uint64_t get_bytes(FILE *f, int n, int *ok)
+{
+    uint64_t v = 0;
+    int c, i;
+
+    for (i = 0; i < n; i++) {
+        if ((c = getc(f)) == EOF) {
+            *ok = 0;
+            return (0);
+        }
+        v |= (uint64_t)c << (8*i);
+    }
+    return (v);
+}
+
+static int32_t get_i32(FILE *f, int *ok)
+{
+    return ((int32_t)(uint32_t)get_bytes(f, 4, ok));
+}
+
+static double get_f64(FILE *f, int *ok)
+{
+    uint64_t v = get_bytes(f, 8, ok);
+    double x;
+
+    memcpy(&x, &v, sizeof(x));
+    return (x);
+}
+
+static char *get_str(FILE *f, int *ok)
+{
+    char *s = NULL;
+    long n = get_bytes(f, 2, ok);
+
+    if (!*ok || n == 0xffff)
+        return (NULL);
+    SUALLOC(s, n + 1, 1);
+    if (fread(s, 1, n, f) != n)
+        *ok = 0;
+    return (s);
+}
+
+/* Open the store in the file named by path, and read its header and chunk
+   index.  Return NULL if the store can't be read. */
+struct lw_store *lw_store_open(const char *path)
+{
+    char magic[sizeof(LW_STORE_MAGIC) - 1];
+    int i, ok = 1;
+    long j, index;
+    FILE *f;
+    struct lw_store *st;
+    struct lw_store_chunk *c;
+    struct lw_store_signal *sg;
+
+    if ((f = fopen(path, "rb")) == NULL)
+        return (NULL);
+    if (fread(magic, 1, sizeof(magic), f) != sizeof(magic) ||
+        memcmp(magic, LW_STORE_MAGIC, sizeof(magic))) {
+        fclose(f);
+        return (NULL);
+    }
+    SUALLOC(st, 1, sizeof(struct lw_store));
+    st->file = f;
+    st->nsig = get_bytes(f, 4, &ok);
+    st->chunk = get_bytes(f, 4, &ok);
+    st->nframes = get_bytes(f, 8, &ok);
+    st->freq = get_f64(f, &ok);
+    index = get_bytes(f, 8, &ok);
+    if (!ok || st->nsig < 1 || st->chunk < 1 || st->nframes < 0) {
+        lw_store_close(st);
+        return (NULL);
+    }
+    st->nchunks = (st->nframes + st->chunk - 1) / st->chunk;
+
+    SUALLOC(st->sig, st->nsig, sizeof(struct lw_store_signal));
+    for (i = 0, sg = st->sig; ok && i < st->nsig; i++, sg++) {
+        sg->desc = get_str(f, &ok);
+        sg->units = get_str(f, &ok);
+        sg->gain = get_f64(f, &ok);
+        sg->initval = get_i32(f, &ok);
+        sg->group = get_i32(f, &ok);
+        sg->fmt = get_i32(f, &ok);
+        sg->spf = get_i32(f, &ok);
+        sg->bsize = get_i32(f, &ok);
+        sg->adcres = get_i32(f, &ok);
+        sg->adczero = get_i32(f, &ok);
+        sg->baseline = get_i32(f, &ok);
+        sg->nsamp = get_bytes(f, 8, &ok);
+        sg->cksum = get_i32(f, &ok);
+        if (sg->spf < 1 || (long)sg->spf * st->chunk > LW_CODE_MAXN)
+            ok = 0;
+    }
+
+    if (ok && fseek(f, index, SEEK_SET) == 0) {
+        SUALLOC(st->index, (size_t)st->nsig * st->nchunks,
+                sizeof(struct lw_store_chunk));
+        for (i = 0, c = st->index; ok && i < st->nsig; i++)
+            for (j = 0; ok && j < st->nchunks; j++, c++) {
+                c->t0 = get_bytes(f, 8, &ok);
+                c->tf = get_bytes(f, 8, &ok);
+                c->offset = get_bytes(f, 8, &ok);
+                c->len = get_bytes(f, 4, &ok);
+                c->min = get_i32(f, &ok);
+                c->max = get_i32(f, &ok);
+                if (c->t0 != j * st->chunk || c->tf <= c->t0 ||
+                    c->tf - c->t0 > st->chunk)
+                    ok = 0;
+            }
+    }
+    else
+        ok = 0;
+    if (!ok) {
+        lw_store_close(st);
+        return (NULL);
+    }
+    return (st);
+}
+
+/* Return the index entry for chunk j of signal i. */
+struct lw_store_chunk *lw_store_chunk(struct lw_store *st, int i, long j)
+{
+    return (&st->index[(size_t)i * st->nchunks + j]);
+}
+
+/* Read chunk j of signal i into out, which must have room for the samples of
+   st->chunk frames.  Return the number of samples read, or -1 if the chunk
+   can't be read. */
+long lw_store_read(struct lw_store *st, int i, long j, WFDB_Sample *out)
+{
+    struct lw_store_chunk *c = lw_store_chunk(st, i, j);
+    long n = (c->tf - c->t0) * st->sig[i].spf;
+
+    if (c->len > st->bufsize) {
+        SALLOC(st->buf, c->len, 1);
+        st->bufsize = c->len;
+    }
+    if (fseek(st->file, c->offset, SEEK_SET) != 0 ||
+        fread(st->buf, 1, c->len, st->file) != c->len ||
+        lw_decode_block(st->buf, c->len, out, n) != n)
+        return (-1);
+    return (n);
+}
+
+void lw_store_close(struct lw_store *st)
+{
+    int i;
+
+    if (st == NULL)
+        return;
+    if (st->sig)
+        for (i = 0; i < st->nsig; i++) {
+            SFREE(st->sig[i].desc);
+            SFREE(st->sig[i].units);
+        }
+    SFREE(st->sig);
+    SFREE(st->index);
+    SFREE(st->buf);
+    fclose(st->file);
+    SFREE(st);
+}
+
+/* Write the header of st (with a placeholder for the offset of the index).
+   Return 0 if successful, or -1 on a write error. */
+int lw_store_write_header(FILE *ofile, const struct lw_store *st)
+{
+    const struct lw_store_signal *sg;
+    int i;
+
+    fwrite(LW_STORE_MAGIC, 1, sizeof(LW_STORE_MAGIC) - 1, ofile);
+    put_u32(ofile, st->nsig);
+    put_u32(ofile, st->chunk);
+    put_u64(ofile, st->nframes);
+    put_f64(ofile, st->freq);
+    put_u64(ofile, 0);
+    for (i = 0, sg = st->sig; i < st->nsig; i++, sg++) {
+        put_str(ofile, sg->desc);
+        put_str(ofile, sg->units);
+        put_f64(ofile, sg->gain);
+        put_u32(ofile, sg->initval);
+        put_u32(ofile, sg->group);
+        put_u32(ofile, sg->fmt);
+        put_u32(ofile, sg->spf);
+        put_u32(ofile, sg->bsize);
+        put_u32(ofile, sg->adcres);
+        put_u32(ofile, sg->adczero);
+        put_u32(ofile, sg->baseline);
+        put_u64(ofile, sg->nsamp);
+        put_u32(ofile, sg->cksum);
+    }
+    return (ferror(ofile) ? -1 : 0);
+}
+
+/* Write the chunk index of st at the end of ofile, and record its location in
+   the header.  Return 0 if successful, or -1 on a write error. */
+int lw_store_write_index(FILE *ofile, const struct lw_store *st)
+{
+    const struct lw_store_chunk *c = st->index;
+    long index;
+    size_t k;
+
+    if (fseek(ofile, 0L, SEEK_END) != 0 || (index = ftell(ofile)) < 0)
+        return (-1);
+    for (k = 0; k < (size_t)st->nsig * st->nchunks; k++, c++) {
+        put_u64(ofile, c->t0);
+        put_u64(ofile, c->tf);
+        put_u64(ofile, c->offset);
+        put_u32(ofile, c->len);
+        put_u32(ofile, c->min);
+        put_u32(ofile, c->max);
+    }
+    if (fseek(ofile, STORE_INDEX_OFFSET, SEEK_SET) != 0)
+        return (-1);
+    put_u64(ofile, index);
+    return (ferror(ofile) ? -1 : 0);
+}
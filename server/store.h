@@ -0,0 +1,73 @@
+/* file: store.h		18 October 2026
+
+Columnar record stores for the LightWAVE server
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LIGHTWAVE_STORE_H
+#define LIGHTWAVE_STORE_H
+
+#include <stdio.h>
+#include <wfdb/wfdb.h>
+
+/* A store for a record is kept in the record's directory, in a file named by
+   replacing the ".hea" suffix of its header file with LW_STORE_SUFFIX. */
+#define LW_STORE_SUFFIX ".lwc"
+
+/* The first bytes of a store. */
+#define LW_STORE_MAGIC "LWSTORE1"
+
+/* Default duration of a chunk, in seconds (see lwstore.c). */
+#define LW_STORE_CHUNKSEC 10
+
+/* A signal's description, as in its WFDB_Siginfo. */
+struct lw_store_signal {
+    char *desc;		/* signal description */
+    char *units;	/* physical units, or NULL if not specified */
+    double gain;	/* ADC units per physical unit */
+    int initval, group, fmt, spf, bsize, adcres, adczero, baseline, cksum;
+    long nsamp;		/* number of samples (0 if unknown) */
+};
+
+/* An entry in the chunk index. */
+struct lw_store_chunk {
+    WFDB_Time t0, tf;	/* frames t0 through tf-1 are in this chunk */
+    long offset;	/* location of the coded samples in the store */
+    long len;		/* length of the coded samples, in bytes */
+    int min, max;	/* range of valid samples (min > max if none) */
+};
+
+struct lw_store {
+    FILE *file;
+    int nsig;			/* number of signals */
+    double freq;		/* frame frequency */
+    WFDB_Time nframes;		/* record length, in frames */
+    long chunk;			/* frames per chunk */
+    long nchunks;		/* chunks per signal */
+    struct lw_store_signal *sig;
+    struct lw_store_chunk *index;	/* chunk j of signal i is
+					   index[i*nchunks + j] */
+    unsigned char *buf;		/* buffer for coded samples */
+    size_t bufsize;
+};
+
+struct lw_store *lw_store_open(const char *path);
+struct lw_store_chunk *lw_store_chunk(struct lw_store *st, int i, long j);
+long lw_store_read(struct lw_store *st, int i, long j, WFDB_Sample *out);
+void lw_store_close(struct lw_store *st);
+int lw_store_write_header(FILE *ofile, const struct lw_store *st);
+int lw_store_write_index(FILE *ofile, const struct lw_store *st);
+
+#endif
@@ -0,0 +1,135 @@
+/* file: timing.c		18 October 2026
+
+Per-request phase timers for the LightWAVE server
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+_______________________________________________________________________________
+
+A request is divided into named phases (such as "sigopen" or "read"), each
+bracketed by calls to lw_phase_begin() and lw_phase_end().  A phase may be
+entered more than once (once per annotator, for example);  its times are
+summed.  Times are measured with the monotonic clock, in milliseconds from
+the call to lw_timing_start(), and reported in the order in which the phases
+were first entered, followed by the total time for the request so far.
+
+Phase names are used as Server-Timing metric names, JSON object keys, and
+log keys without quoting, so they must be simple tokens.
+*/
+
+#include <string.h>
+#include <time.h>
+#include "timing.h"
+
+static struct {
+    const char *name;
+    double begin;	/* time when the phase was last entered, or -1 */
+    double total;	/* total time spent in the phase */
+} phase[LW_MAXPHASE];
+static int nphase;
+static double t_start;
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec * 1000. + ts.tv_nsec * 1e-6);
+}
+
+void lw_timing_start(void)
+{
+    t_start = now();
+    nphase = 0;
+}
+
+/* Return the time elapsed since lw_timing_start(), in milliseconds. */
+double lw_timing_elapsed(void)
+{
+    return (now() - t_start);
+}
+
+static int find_phase(const char *name)
+{
+    int i;
+
+    for (i = 0; i < nphase; i++)
+        if (phase[i].name == name || strcmp(phase[i].name, name) == 0)
+            return (i);
+    if (nphase >= LW_MAXPHASE)
+        return (-1);
+    phase[nphase].name = name;
+    phase[nphase].begin = -1.;
+    phase[nphase].total = 0.;
+    return (nphase++);
+}
+
+void lw_phase_begin(const char *name)
+{
+    int i = find_phase(name);
+
+    if (i >= 0)
+        phase[i].begin = now();
+}
+
+void lw_phase_end(const char *name)
+{
+    int i = find_phase(name);
+
+    if (i >= 0 && phase[i].begin >= 0.) {
+        phase[i].total += now() - phase[i].begin;
+        phase[i].begin = -1.;
+    }
+}
+
+/* Add ms milliseconds to the total for a phase (for phases timed in another
+   thread, which must not call lw_phase_begin() or lw_phase_end()). */
+void lw_phase_add(const char *name, double ms)
+{
+    int i = find_phase(name);
+
+    if (i >= 0)
+        phase[i].total += ms;
+}
+
+/* Write a Server-Timing response header line. */
+void lw_timing_header(FILE *ofile)
+{
+    int i;
+
+    fprintf(ofile, "Server-Timing: ");
+    for (i = 0; i < nphase; i++)
+        fprintf(ofile, "%s;dur=%.3f, ", phase[i].name, phase[i].total);
+    fprintf(ofile, "total;dur=%.3f\r\n", lw_timing_elapsed());
+}
+
+/* Write the phase times as a JSON object. */
+void lw_timing_json(FILE *ofile)
+{
+    int i;
+
+    fprintf(ofile, "{ ");
+    for (i = 0; i < nphase; i++)
+        fprintf(ofile, "\"%s\": %.3f, ", phase[i].name, phase[i].total);
+    fprintf(ofile, "\"total\": %.3f }", lw_timing_elapsed());
+}
+
+/* Write the phase times as space-separated name=value pairs. */
+void lw_timing_log(FILE *ofile)
+{
+    int i;
+
+    for (i = 0; i < nphase; i++)
+        fprintf(ofile, " %s=%.3f", phase[i].name, phase[i].total);
+    fprintf(ofile, " total=%.3f", lw_timing_elapsed());
+}
@@ -0,0 +1,36 @@
+/* file: timing.h		18 October 2026
+
+Per-request phase timers for the LightWAVE server
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef LIGHTWAVE_TIMING_H
+#define LIGHTWAVE_TIMING_H
+
+#include <stdio.h>
+
+/* Maximum number of distinct phases in a request. */
+#define LW_MAXPHASE 16
+
+void lw_timing_start(void);
+double lw_timing_elapsed(void);
+void lw_phase_begin(const char *name);
+void lw_phase_end(const char *name);
+void lw_phase_add(const char *name, double ms);
+void lw_timing_header(FILE *ofile);
+void lw_timing_json(FILE *ofile);
+void lw_timing_log(FILE *ofile);
+
+#endif
@@ -0,0 +1,381 @@
+/* file: zygote.c		18 October 2026
+
+Pre-forked, pre-sandboxed LightWAVE server processes
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or (at
+your option) any later version.
+
+This program is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+_______________________________________________________________________________
+
+Setting up the sandbox (see sandbox.c) costs more than many requests do.  In
+zygote mode, a long-running process (the zygote) does the setup once, and
+forks children that inherit it:
+
+    LIGHTWAVE_ROOT=/path/to/root sandboxed-lightwave -z SOCKET [NCHILD]
+
+The zygote creates the Unix-domain socket SOCKET (owned by, and accessible
+only to, the user who runs it, which must be the user who runs CGI
+applications), changes its root directory, drops its privileges, sets the
+resource limits, and compiles the seccomp filter.  It then keeps NCHILD (by
+default, LW_ZYGOTE_NCHILD) idle children waiting for connections, forking a
+new one whenever one of them accepts a request or exits while idle.
+
+When sandboxed-lightwave runs as a CGI application with $LIGHTWAVE_ZYGOTE set
+to SOCKET, it does not set up a sandbox itself.  Instead it connects to the
+zygote (as the real user, not as root, and only if the zygote also runs as
+the real user, as shown by SO_PEERCRED), and sends its environment and its
+standard input, output, and error (as SCM_RIGHTS file descriptors) to one of
+the idle children.  The child installs them, loads the precompiled filter
+with a single system call, and handles the request as usual, while the CGI
+process waits for the child to close the connection (when it exits).  If the
+zygote is not running, the CGI process handles the request itself.
+
+The child has the same root directory, credentials, resource limits, and
+filter as a sandboxed-lightwave process that sets up its own sandbox.  The
+filter is loaded after the request has been received (the system calls
+needed to receive it are not allowed by the filter) but before any of it is
+parsed.
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include "sandbox.h"
+
+/* Default number of idle children. */
+#define LW_ZYGOTE_NCHILD 4
+
+/* Maximum size of the environment passed with a request. */
+#define LW_ZYGOTE_MAXENV (256 * 1024)
+
+/* Seconds that a child waits for a request after accepting a connection. */
+#define LW_ZYGOTE_TIMEOUT 10
+
+extern char **environ;
+
+static int lsock, notify[2], nchild;
+static pid_t *idle, zygote_pid;
+
+static void fail(const char *msg)
+{
+    perror(msg);
+    exit(1);
+}
+
+/* Receive a request (the length of the environment block, with the client's
+   standard input, output, and error attached, followed by the environment
+   block) on connection conn, and install it in this process.  Return 0 if
+   successful, -1 otherwise. */
+static int receive_request(int conn)
+{
+    char cbuf[CMSG_SPACE(3 * sizeof(int))], *env, *p, *end;
+    int fd[3], i;
+    ssize_t n;
+    size_t got;
+    uint32_t len;
+    struct cmsghdr *cmsg;
+    struct iovec iov;
+    struct msghdr msg;
+    struct timeval tv;
+
+    tv.tv_sec = LW_ZYGOTE_TIMEOUT;
+    tv.tv_usec = 0;
+    setsockopt(conn, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    memset(&msg, 0, sizeof(msg));
+    iov.iov_base = &len;
+    iov.iov_len = sizeof(len);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cbuf;
+    msg.msg_controllen = sizeof(cbuf);
+    if (recvmsg(conn, &msg, MSG_CMSG_CLOEXEC) != sizeof(len)
+        || (msg.msg_flags & MSG_CTRUNC)
+        || (cmsg = CMSG_FIRSTHDR(&msg)) == NULL
+        || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS
+        || cmsg->cmsg_len != CMSG_LEN(3 * sizeof(int)))
+        return (-1);
+    memcpy(fd, CMSG_DATA(cmsg), sizeof(fd));
+    if (len == 0 || len > LW_ZYGOTE_MAXENV || (env = malloc(len)) == NULL)
+        return (-1);
+    for (got = 0; got < len; got += n)
+        if ((n = read(conn, env + got, len - got)) <= 0)
+            return (-1);
+    if (env[len - 1] != '\0')
+        return (-1);
+
+    for (i = 0; i < 3; i++) {
+        if (dup2(fd[i], i) < 0)
+            return (-1);
+        if (fd[i] > 2)
+            close(fd[i]);
+    }
+
+    /* The strings in env become the environment, and are never freed. */
+    clearenv();
+    for (p = env, end = env + len; p < end; p += strlen(p) + 1)
+        if (strchr(p, '='))
+            putenv(p);
+    return (0);
+}
+
+/* Run in a new child: wait for a request and install it.  Return only if
+   this is successful. */
+static void child(void)
+{
+    int conn;
+    pid_t pid = getpid();
+
+    signal(SIGCHLD, SIG_DFL);
+    signal(SIGPIPE, SIG_DFL);
+    close(notify[0]);
+    lightwave_sandbox_child();
+
+    /* An idle child exits if the zygote does. */
+    prctl(PR_SET_PDEATHSIG, SIGTERM);
+    if (getppid() != zygote_pid)
+        _exit(1);
+    while ((conn = accept4(lsock, NULL, NULL, SOCK_CLOEXEC)) < 0)
+        if (errno != EINTR && errno != ECONNABORTED)
+            _exit(1);
+    prctl(PR_SET_PDEATHSIG, 0);
+
+    /* Tell the zygote to replace this child in the pool. */
+    (void)write(notify[1], &pid, sizeof(pid));
+    close(notify[1]);
+    close(lsock);
+
+    /* The connection stays open (without being used) until this process
+       exits, which tells the client that the request is complete. */
+    if (receive_request(conn) < 0)
+        _exit(1);
+}
+
+/* Fork a new idle child in slot i of the pool.  Return 0 in the child. */
+static pid_t spawn(int i)
+{
+    pid_t pid = fork();
+
+    if (pid == 0)
+        child();
+    else if (pid > 0)
+        idle[i] = pid;
+    else
+        idle[i] = 0;	/* try again later */
+    return (pid);
+}
+
+static int find_idle(pid_t pid)
+{
+    int i;
+
+    for (i = 0; i < nchild; i++)
+        if (idle[i] == pid)
+            return (i);
+    return (-1);
+}
+
+static void on_sigchld(int sig)
+{
+    /* Nothing to do here: the signal interrupts poll() in the main loop,
+       which then reaps the child. */
+}
+
+/* Run the zygote.  This function returns only in a child that has received
+   a request, with its environment and standard I/O set up. */
+void lightwave_zygote(int argc, char **argv)
+{
+    char *path;
+    int i, status;
+    pid_t pid;
+    struct pollfd pfd;
+    struct sigaction sa;
+    struct sockaddr_un addr;
+
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s -z SOCKET [NCHILD]\n", argv[0]);
+        exit(1);
+    }
+    path = argv[2];
+    nchild = (argc > 3) ? atoi(argv[3]) : LW_ZYGOTE_NCHILD;
+    if (nchild < 1)
+        nchild = 1;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "%s: socket path too long\n", argv[0]);
+        exit(1);
+    }
+
+    /* Create the socket as the real user, before changing the root. */
+    if (seteuid(getuid()) != 0)
+        fail("cannot set effective user ID");
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    unlink(path);
+    umask(077);
+    if ((lsock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0
+        || bind(lsock, (struct sockaddr *)&addr, sizeof(addr)) != 0
+        || listen(lsock, 128) != 0)
+        fail(path);
+    if (seteuid(0) != 0)
+        fail("cannot set effective user ID");
+
+    lightwave_sandbox_zygote();
+    zygote_pid = getpid();
+
+    if (pipe2(notify, O_CLOEXEC) != 0
+        || (idle = calloc(nchild, sizeof(pid_t))) == NULL)
+        fail("zygote");
+    sa.sa_handler = on_sigchld;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = 0;	/* not SA_RESTART, so that poll() is interrupted */
+    sigaction(SIGCHLD, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    for (i = 0; i < nchild; i++)
+        if (spawn(i) == 0)
+            return;
+    pfd.fd = notify[0];
+    pfd.events = POLLIN;
+    for (;;) {
+        if (poll(&pfd, 1, 1000) > 0 && read(notify[0], &pid, sizeof(pid))
+            == sizeof(pid) && (i = find_idle(pid)) >= 0) {
+            if (spawn(i) == 0)	/* replace a child that became busy */
+                return;
+        }
+
+        /* Reap finished children, and replace any that exited while idle. */
+        while ((pid = waitpid(-1, &status, WNOHANG)) > 0)
+            if ((i = find_idle(pid)) >= 0 && spawn(i) == 0)
+                return;
+
+        /* Retry failed forks. */
+        while ((i = find_idle(0)) >= 0)
+            if (spawn(i) == 0)
+                return;
+            else if (idle[i] == 0) {
+                sleep(1);
+                break;
+            }
+    }
+}
+
+/* Connect to the zygote listening on the socket at path.  Since this runs in
+   a setuid program, and path comes from the environment, the connection is
+   made as the real user (who must be able to reach the socket), and is kept
+   only if the zygote also runs as the real user (see lightwave_zygote()).
+   Return the connected socket, or -1. */
+static int connect_zygote(const char *path)
+{
+    int sock = -1;
+    uid_t euid = geteuid();
+    socklen_t clen = sizeof(struct ucred);
+    struct sockaddr_un addr;
+    struct ucred cred;
+
+    if (strlen(path) >= sizeof(addr.sun_path))
+        return (-1);
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    if (seteuid(getuid()) != 0)
+        return (-1);
+    if ((sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) >= 0
+        && (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0
+            || getsockopt(sock, SOL_SOCKET, SO_PEERCRED, &cred, &clen) != 0
+            || cred.uid != getuid())) {
+        close(sock);
+        sock = -1;
+    }
+    if (seteuid(euid) != 0) {
+        if (sock >= 0)
+            close(sock);
+        return (-1);
+    }
+    return (sock);
+}
+
+/* If $LIGHTWAVE_ZYGOTE is set, pass this request to a child of the zygote
+   listening on that socket, and wait for it to finish.  Return 1 if the
+   request was handled, or 0 if the zygote is not available. */
+int lightwave_forward(void)
+{
+    char buf[256], *path, **e, *env, *p;
+    char cbuf[CMSG_SPACE(3 * sizeof(int))];
+    int fd[3] = { 0, 1, 2 }, sock;
+    size_t len;
+    ssize_t n;
+    uint32_t ulen;
+    struct cmsghdr *cmsg;
+    struct iovec iov;
+    struct msghdr msg;
+
+    if ((path = getenv("LIGHTWAVE_ZYGOTE")) == NULL
+        || (sock = connect_zygote(path)) < 0)
+        return (0);
+
+    /* Copy the environment into a block of NUL-terminated strings. */
+    for (e = environ, len = 0; *e; e++)
+        len += strlen(*e) + 1;
+    if (len == 0 || len > LW_ZYGOTE_MAXENV || (env = malloc(len)) == NULL) {
+        close(sock);
+        return (0);
+    }
+    for (e = environ, p = env; *e; e++)
+        p = stpcpy(p, *e) + 1;
+
+    memset(&msg, 0, sizeof(msg));
+    ulen = len;
+    iov.iov_base = &ulen;
+    iov.iov_len = sizeof(ulen);
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cbuf;
+    msg.msg_controllen = sizeof(cbuf);
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fd));
+    memcpy(CMSG_DATA(cmsg), fd, sizeof(fd));
+    signal(SIGPIPE, SIG_IGN);
+    if (sendmsg(sock, &msg, 0) != sizeof(ulen)) {
+        free(env);
+        close(sock);
+        return (0);	/* nothing was sent, so handle the request here */
+    }
+
+    /* Once the descriptors have been sent, the request belongs to the
+       child, even if the rest of it cannot be sent. */
+    for (p = env; p < env + len; p += n)
+        if ((n = write(sock, p, env + len - p)) <= 0)
+            break;
+    free(env);
+    shutdown(sock, SHUT_WR);
+    while ((n = read(sock, buf, sizeof(buf))) > 0
+           || (n < 0 && errno == EINTR))
+        ;
+    close(sock);
+    return (1);
+}